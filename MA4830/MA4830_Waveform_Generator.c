@@ -23,9 +23,101 @@
 
  * To change variables through arguments, the following order must be met:
  * Format:  <program_name.exe> <waveform type> <frequency> <mean> <amplitude> <isOn>
- * Waveform type: -sin =sine, -tri =triangular, -squ = square
+ * Waveform type: -sin =sine, -tri =triangular, -squ = square,
+ *                -awg = arbitrary (file loaded with --awg)
  * e.g:  ./wavegen -sin 1000.3 2.4 5 1
 
+ * Options (may appear anywhere in the arguments):
+ * --pacer        DAC conversions are clocked by the board's DAC pacer from
+ *                a preloaded FIFO (frequency up to 5000Hz)
+ * --dds          Direct digital synthesis: fixed output rate, a 32-bit phase
+ *                accumulator indexes a 1024 sample table. Frequency changes
+ *                only update the phase increment (no waveform regeneration)
+ * --dual         Output DAC0 and DAC1 together (implies --dds, software timed)
+ * --dac1 <waveform type> <frequency> <mean> <amplitude> <isOn>
+ *                Settings of DAC1 in dual mode, same format as DAC0
+ * --phase <deg>  Phase offset of DAC1 relative to DAC0 in dual mode
+ * --sweep <start> <stop> <seconds>
+ *                Sweep DAC0 from start to stop Hz in <seconds>, continuous
+ *                in phase (implies --dds). With --sweep-log (logarithmic,
+ *                linear by default), --dwell <s> (time at the stop frequency
+ *                before the next sweep, default 0) and --repeat <n> (sweeps,
+ *                default 0 = until stopped, then the stop frequency is held).
+ *                --sweep off ends a sweep (in an imported configuration)
+ * --mod <am|fm|pm> <waveform type> <frequency> <depth>
+ *                Modulate DAC0 with a second oscillator (implies --dds):
+ *                depth is the AM index [0, 1] (the peak stays at the
+ *                amplitude), the FM deviation in Hz or the PM deviation in
+ *                degrees (0, 180]. --mod off ends the modulation
+ * --playlist <file> Play a sequence of waveforms on DAC0 (implies --dds).
+ *                Each line of <file> is a segment:
+ *                  <seconds> <waveform type> <frequency> <mean> <amplitude>
+ *                where the type may also be -saw (a rising ramp, in
+ *                playlists only), and a line "repeat <n>" plays the list n times (default 1,
+ *                0 = until stopped), after which DAC0 holds the last mean.
+ *                Lines starting with # are comments. --playlist off ends it
+ * --burst <periods> Triggered burst: DAC0 holds its mean and outputs
+ *                <periods> periods each time the trigger bit of Port A
+ *                changes (0 = continuous output, the default). The trigger
+ *                is --trigger <bit> <rising|falling> (default bit 4, rising;
+ *                bits 0-3 are the switches)
+ * --awg <file>   Arbitrary waveform: DAC0 replays the samples of <file> in a
+ *                loop, scaled to the best DAC range. <file> is a CSV (.csv,
+ *                .txt: volts, last number of each line), a --capture file
+ *                (first channel) or raw 32-bit floats in volts (any other
+ *                name). It is memory-mapped and resampled to the output
+ *                rate. The frequency is the repetition rate of the file
+ * --awg-rate <S/s> Sample rate of the --awg file (default 1000, or the
+ *                rate in a capture file)
+ * --capture <file> Log ADC channels to <file> instead of the user interface
+ *                (binary, see CaptureHeader). With --rate <S/s> (default
+ *                100000, all channels), --chans <n> (channels 0..n-1,
+ *                default 2) and --seconds <s> (default 10, 0 = until a key)
+ * --stream <file> Play <file> once through DAC0 instead of the user interface,
+ *                at +/-10V. <file> is a --capture file (first channel) or raw
+ *                32-bit floats in volts, of any length: a reader thread
+ *                converts it ahead of the output (see runStream). With
+ *                --stream-rate <S/s> (default 20000, or the rate in a
+ *                capture file) and --pacer for board timed output
+ * --prefetch <blocks> Blocks of 32768 samples converted ahead of the stream
+ *                output (default 16)
+ * --calibrate    Measure the host timing again instead of using the cached
+ *                values in ~/.wavegen.cal (--calib-file <file> for another file)
+ * --rt <prio>    Run the output threads SCHED_FIFO at <prio> with the process
+ *                memory locked, and the UI and input threads below default
+ * --cpu <n>      Pin the output threads to CPU <n>, the UI and input threads
+ *                to the other CPUs
+ * --ui-hz <Hz>   Refresh rate of the status screen (default 20)
+ * --ctrl         Take parameter changes from other processes (see ctrlApply):
+ *                a resource manager at /dev/wavegen on QNX, a UNIX socket at
+ *                /tmp/wavegen.sock elsewhere. --ctrl-path <path> serves (or
+ *                --send uses) another path
+ * --send <dac> <freq|amp|mean|type|on|status> [<value>] Send one command to
+ *                a running generator and print the parameters it replies
+ *                with, instead of running the generator
+ * --status       Publish the parameters, inputs, output counters and timing
+ *                of the running generator in the shared-memory page /wavegen
+ *                (see statusUpdate), --status-name <name> for another name
+ * --monitor <s>  Print the live rates of a generator running with --status
+ *                once a second for <s> seconds (0 until CTRL+C), instead of
+ *                running the generator
+ * --bench <name> Run a benchmark instead of the user interface. pacer,
+ *                iocount, adcscan, capture, drift, stream, burst, board and
+ *                sink measure the simulated board, with --board sim on QNX
+ * --board <pci|sim> Board backend: the PCI-DAS 1602 (pci, QNX only and the
+ *                default there) or the simulated board (sim). When built
+ *                without QNX (gcc on Linux) the board is always simulated
+ * --sim-record <file> Record the time of every DAC data write of the
+ *                simulated board, the last 2^20 written to <file> on exit
+ * --sim-script <file> Drive the simulated Port A and analog inputs from
+ *                <file>, lines "<seconds> dio <value>" and
+ *                "<seconds> adc <channel> <volts>" timed from start-up
+ * --sink <file>  Write what DAC0 outputs to <file> at a uniform rate, in
+ *                volts: WAV (32-bit float) if the name ends in .wav, raw
+ *                32-bit floats otherwise. The samples are taken from the DAC
+ *                writes with their times, in every output mode and timing
+ *                (see sinkStart). With --sink-rate <S/s> (default 200000)
+
  * The user can change the DAC parameters (waveform properties) from keyboard
  * (MainUI) and switches & potentiometer (PeripheralInput). However, only one
  * device can change parameters at a time. PCI-DAS 1602's switches and ADC inputs
@@ -54,31 +146,93 @@
  *                      change DAC parameters from keyboard,
  *                      import and export DAC configuration, and
  *                      reset the isOperating flag if user quits
- * 3. PeripheralInput - Receive switches and potentiometers inputs,
+ * 3. PeripheralInput - Receive switches and potentiometers inputs
+ *                      (burst ADC scan every 5 ms, completed by interrupt),
  *                      convert data to correct forms,
  *                      changes the DAC parameters with range checking
- * 4. WaveGenManager -  Supervises the isOn and resetWave flag to reconfigure
- *                      DAC data arrays and create thread
- * 5. PushDAC - Dedicated thread to output the data continuously,
- *              thread exits when isOperating/isOn==false or resetWave==true
+ * 4. WaveGenManager -  Waits for change requests (condition variable) to
+ *                      reconfigure DAC data arrays, publish them to PushDAC through a
+ *                      double buffer and create the thread if needed
+ * 5. PushDAC - Dedicated thread to output the data continuously, picks up
+ *              a new waveform at the period boundary, software timed
+ *              samples are sent on absolute CLOCK_MONOTONIC deadlines,
+ *              thread exits when isOperating/isOn==false
 
  * User can import and export the DAC configuration from and to .txt file
- * in command line argument format.
+ * in command line argument format. Options choosing the output loop
+ * (--pacer, --dds, --dual), the board and the files and names used by the
+ * program (--board, --sim-record, --sink, --calib-file, --status-name ...)
+ * only apply at start-up and are ignored on import, as are --sweep, --mod
+ * and --playlist unless the output started with --dds.
 */
+#ifndef __QNX__
+#define _GNU_SOURCE         //for sched_setaffinity in simulated ThreadCtl
+#endif
+#define _FILE_OFFSET_BITS 64  //for stream files over 2 GB on 32-bit targets
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>        //for boolean data type
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>         //for offsetof in statusUpdate
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <termios.h>        //for tcischars();
 #include <unistd.h>
+#include <fcntl.h>
+#ifdef __QNX__
 #include <hw/pci.h>
 #include <hw/inout.h>
 #include <sys/neutrino.h>
+#include <process.h>
+#include <devctl.h>         //for the control endpoint
+#include <sys/iofunc.h>
+#include <sys/dispatch.h>
+#else
+#include <sys/ioctl.h>      //for FIONREAD in simulated tcischars();
+#include <sys/socket.h>     //for the control endpoint
+#include <sys/un.h>
+#include <poll.h>
+#include <sys/syscall.h>    //for the thread id in rtDemote
+#endif
+#include <sys/resource.h>   //for setpriority in rtDemote, getrusage in benchStream
+#include <sched.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
-#include <process.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>       //for the dead owner in benchStatus
 #include <pthread.h>
 #include <math.h>
 
+#ifndef __QNX__
+/*
+ * Non-QNX builds
+ *
+ * When the program is built on plain Linux, the board is always the
+ * simulated PCI-DAS 1602 (see "Board access" and "Simulated board" at the
+ * end of this file), and the few QNX calls used outside the board backend
+ * are replaced below. The DAC FIFO and pacer are modelled against
+ * CLOCK_MONOTONIC so the output threads can be run and measured without
+ * the hardware.
+ * Build: gcc -std=gnu99 -O2 -pthread MA4830_Waveform_Generator.c -lm
+ */
+struct pci_dev_info {
+    uint16_t VendorId;
+    uint16_t DeviceId;
+    uint32_t Irq;
+    uint64_t CpuBaseAddress[6];
+};
+#define PCI_IO_ADDR(x)      ((int)(x))
+#define _NTO_TCTL_RUNMASK   4
+
+int ThreadCtl(int cmd, void* data);
+unsigned delay(unsigned int msec);
+int nanospin_ns(unsigned long nsec);
+int tcischars(int fd);
+#endif
+
 #define	INTERRUPT		iobase[1] + 0			// Badr1 + 0 : also ADC register
 #define	MUXCHAN			iobase[1] + 2			// Badr1 + 2
 #define	TRIGGER			iobase[1] + 4			// Badr1 + 4
@@ -104,20 +258,456 @@
 #define DA_Data		    iobase[4] + 0			// Badr4 + 0
 #define	DA_FIFOCLR		iobase[4] + 2			// Badr4 + 2
 
-#define PI              acos(-1)
+#define PI              3.14159265358979323846
 
 #define HIGHESTFREQ     1750
-#define FIFO_DELAY      6700					//Empirical value for delay of DAC push FIFO operation
+
+// Absolute deadline timing of the software timed output
+#define WRITE_NS		2233					//Port write cost until calibrated
+#ifdef __QNX__
+#define SPIN_NS			2000000					//Spin before a deadline until calibrated (1 ms system tick)
+#else
+#define SPIN_NS			100000					//Spin before a deadline until calibrated
+#endif
+#define SLIP_NS			20000000				//Later than this, the sample clock restarts from now
+
+// Timing trace of the software timed output (see traceRecord)
+#define TRACE_BITS		12						//Trace ring of 4096 samples per output thread
+#define TRACE_SIZE		(1<<TRACE_BITS)
+#define TRACE_MASK		(TRACE_SIZE-1)
+#define HIST_SUB		4						//Lateness histogram buckets per power of two
+#define HIST_BUCKETS	(32*HIST_SUB)			//Up to 2^32 ns, later samples go in the last bucket
+
+// Real-time thread policy (see rtOutput)
+#define RT_BENCH_PRIO	20						//FIFO priority used by --bench rt without --rt
+#define RT_STACK_PREFAULT	(64*1024)			//Stack the output threads touch before running
+#ifdef __QNX__
+#define RT_DEMOTE_PRIO	9						//Priority of the UI and input threads (default 10)
+#else
+#define RT_DEMOTE_NICE	5						//Nice value of the UI and input threads
+#endif
+
+// Start-up timing calibration (see calibrate)
+#define CALIB_FILE		".wavegen.cal"			//Cache of the measured values, in $HOME
+#define CALIB_VERSION	1
+#define CALIB_WRITES	10000					//Port writes timed
+#define CALIB_SLEEPS	200						//Absolute sleeps timed
+#define CALIB_SLEEP_NS	1000000					//Length of each timed sleep
+#define SPIN_MIN_NS		20000					//Range of the derived spin time
+#define SPIN_MAX_NS		10000000
+
+// Hardware-paced output (DAC pacer + DAC FIFO)
+#define PACED_HIGHESTFREQ	5000				//Highest frequency in paced mode
+#define DAC_FIFO_SIZE	1024					//DAC FIFO depth (samples)
+#define DAC_FIFO_HALF	(DAC_FIFO_SIZE/2)		//Refill block size
+#define PACER_CLOCK		10000000				//Pacer counter input clock (Hz)
+#define PACER_MINDIV	100						//Divisor for maximum DAC update rate (100kS/s)
+#define PACER_MAXDIV	65535					//Largest 16-bit counter divisor
+#define PACER_MAXTOTAL	(65535UL*65535UL)		//Largest divisor of two counters in cascade
+#define PACER_SPLITS	64						//Counter 2 divisors tried for an exact product
+#define PACER_C1_MODE2	0x74					//8254: counter 1, LSB then MSB, mode 2, binary
+#define PACER_C2_MODE2	0xb4					//8254: counter 2, LSB then MSB, mode 2, binary
+#define DAC_START		0x0003					//DA_CTLREG: DAC conversions enabled
+#define DAC_PACER_SRC	0x0008					//DA_CTLREG: conversions clocked by the DAC pacer
+#define DAC_HALF_EMPTY	0x0004					//DA_CTLREG read: DAC FIFO is at most half full
+#define MIN_SAMPLES		20						//Fewest samples per period in paced mode
+#define MAX_SAMPLES		1024					//Most samples per period of the standard waveforms
+
+// Arbitrary waveform (AWG) files (waveform type 4)
+#define AWG_CSV			0						//Text, the last number of each line is a sample (V)
+#define AWG_FLOAT		1						//Raw 32-bit floats (V), host byte order
+#define AWG_CAPTURE		2						//--capture file: first channel, ADC counts at +/-10V
+#define AWG_RATE		1000					//Sample rate of a file that has none (S/s)
+#define AWG_MAX_RATE	(HIGHESTFREQ*100)		//Highest software timed AWG rate (S/s)
+#define AWG_MIN_SAMPLES	2						//Fewest output samples per repetition
+#define AWG_NUMBER		64						//Longest number in a CSV file
+
+// Streaming playback (see runStream)
+#define STREAM_BLOCK	32768					//Samples converted per file read
+#define STREAM_DEPTH	16						//Default prefetch depth (blocks)
+#define STREAM_MAX_DEPTH	4096				//Largest prefetch depth (256 MB of samples)
+#define STREAM_RATE		20000					//Sample rate of a stream file that has none (S/s)
+#define STREAM_CTLREG	0x0123					//DA_CTLREG: DAC0, bipolar +/-10V, conversions enabled
+#define STREAM_RES		305.14e-6				//Volts per DAC code at +/-10V
+#define STREAM_DROP		(8*1024*1024)			//Bytes read before they are dropped from the cache
+#define STREAM_BENCH_MB	2048					//Size of the file replayed by --bench stream
+
+// Direct digital synthesis (DDS)
+#define DDS_TABLE_BITS	10						//DDS lookup table holds 2^10 samples
+#define DDS_TABLE_SIZE	(1<<DDS_TABLE_BITS)
+#define DDS_SHIFT		(32-DDS_TABLE_BITS)		//Phase accumulator bits below the table index
+#define DDS_RATE		20000					//Software timed DDS output tick (S/s)
+#define DDS_MIN_SAMPLES	8						//Fewest DDS ticks per period
+
+// Modulation of DAC0 (see ModConfig)
+#define MOD_NONE		0
+#define MOD_AM			1
+#define MOD_FM			2
+#define MOD_PM			3
+#define AM_SHIFT		15						//AM gain is Q15 (1.0 = 2^15)
+
+// Sequencer (see seqLoad)
+#define SEQ_LINE		256						//Longest playlist line
+#define SEQ_RAMP		5						//Waveform type of a ramp (-saw) segment
+
+// Triggered burst (see PushDACBurst)
+#define BURST_BIT		4						//Default trigger bit of Port A
+#define BURST_BENCH_N	200						//Triggers per timing mode in --bench burst
+#define BURST_BENCH_NS	100000					//Largest median trigger latency in --bench burst
+
+// Board access (see BoardOps)
+#define BOARD_BENCH_NS	20000000				//Largest delay of a scripted input in --bench board
+
+// Status dashboard (see dashFrame)
+#define UI_HZ			20						//Default status screen refresh rate (Hz)
+#define DASH_ROWS		64						//Rows of a dashboard frame
+#define DASH_COLS		128						//Columns of a dashboard row
+#define DASH_TEXT		(DASH_ROWS*(DASH_COLS + 1))	//Text of a frame
+#define DASH_OUT		(DASH_ROWS*(DASH_COLS + 32) + 64)	//Escape sequences and text of a frame
+#define DASH_BENCH_FRAMES	1000				//Frames drawn in --bench dash
+
+// Control endpoint (see ctrlApply)
+#ifdef __QNX__
+#define CTRL_PATH		"/dev/wavegen"			//Default --ctrl endpoint (resource manager)
+#define DCMD_WAVEGEN	__DIOTF(_DCMD_MISC, 0x57, CtrlMsg)	//devctl() of a command
+#else
+#define CTRL_PATH		"/tmp/wavegen.sock"		//Default --ctrl endpoint (UNIX socket)
+#endif
+#define CTRL_CLIENTS	8						//Connections served at once (socket)
+#define CTRL_BENCH_N	2000					//Commands of each kind in --bench ctrl
+#define CTRL_FREQ		1						//Commands: set the frequency (Hz)
+#define CTRL_AMP		2						//Set the amplitude (V)
+#define CTRL_MEAN		3						//Set the mean (V)
+#define CTRL_TYPE		4						//Set the waveform type (1-4)
+#define CTRL_ON			5						//Turn the channel off or on (0/1)
+#define CTRL_STATUS		6						//Parameters only
+#define CTRL_OK			0						//Reply status: applied
+#define CTRL_EOP		1						//Unknown command
+#define CTRL_ERANGE		2						//Value out of range, nothing changed
+#define CTRL_ECHAN		3						//No such channel
+#define CTRL_ETIMEOUT	4						//WaveGenManager did not acknowledge
+
+// Status page (see statusUpdate)
+#define STATUS_NAME		"/wavegen"				//Default --status shared-memory name
+#define STATUS_MAGIC	0x57415645				//"WAVE" while the page is updated
+#define STATUS_HZ		100						//Page updates per second
+#define STATUS_READ_MS	100						//Longest wait of statusRead for a snapshot being written
+#define STATUS_BENCH_NAME	"/wavegen_bench"	//Page of --bench status
+#define STATUS_BENCH_N	100000					//Updates timed in --bench status
+#define STATUS_BENCH_TOL	0.02				//Largest relative output rate error in --bench status
+
+// Output sink (see sinkStart)
+#define SINK_RATE		200000					//Default output sink rate (S/s)
+#define SINK_RING_BITS	20						//2^20 DAC writes queued for the sink writer
+#define SINK_RING_SIZE	(1UL << SINK_RING_BITS)
+#define SINK_RING_MASK	(SINK_RING_SIZE - 1)
+#define SINK_BLOCK		65536					//Samples per file write
+#define SINK_GAP_NS		100000000				//Longest hold written while the output is stopped (ns)
+#define SINK_DATA		0						//Queued writes: DA_Data
+#define SINK_CTL		1						//DA_CTLREG
+#define SINK_FIFOCLR	2						//DA_FIFOCLR
+#define SINK_PACER2		3						//PACER2 (a byte of the counter 1 divisor)
+#define SINK_PACERCTL	4						//PACERCTL, counter 1 or 2 mode
+#define SINK_PACER3		5						//PACER3 (a byte of the counter 2 divisor)
+#define SINK_BENCH_TOL	0.001					//Largest relative frequency error in --bench sink
+#ifdef __QNX__
+#define BOARD_NAMES		"pci or sim"
+#else
+#define BOARD_NAMES		"sim (no PCI board without QNX)"
+#endif
+
+// ADC knob scan, one paced burst per end of acquisition interrupt
+#define ADC_SCAN_CHANNELS	2					//Potentiometers on ADC channels 0 and 1
+#define ADC_SCAN_MUX	(0x0D00 | ((ADC_SCAN_CHANNELS-1) << 4))	//MUXCHAN: scan CHL = 0 to CHH = 1
+#define ADC_BURST		0x0020					//TRIGGER: one start converts CHL..CHH
+#define ADC_INTSEL		0x0003					//INTERRUPT: interrupt source field
+#define ADC_INT_HALF	0x0002					//INTERRUPT: interrupt source is ADC FIFO half full
+#define ADC_INT_EOA		0x0003					//INTERRUPT: interrupt source is end of acquisition
+#define ADC_INTE		0x0004					//INTERRUPT: board interrupt enable
+#define ADC_EOA_CLR		0x0800					//INTERRUPT: clear the end of acquisition interrupt
+#define ADC_HALF_CLR	0x0400					//INTERRUPT: clear the FIFO half full interrupt
+#define ADC_FIFO_OVF	0x1000					//INTERRUPT read: ADC FIFO overflowed (latched)
+#define ADC_HALF_STAT	0x0400					//INTERRUPT read: ADC FIFO half full (ADHFI)
+#define ADC_TRIGSRC		0x0003					//TRIGGER: conversion source field
+#define ADC_TRIG_PACER	0x0002					//TRIGGER: conversions clocked by the ADC pacer
+#define ADC_FIFO_SIZE	1024					//ADC FIFO depth (samples)
+#define ADC_FIFO_HALF	(ADC_FIFO_SIZE/2)		//Samples read per half full interrupt
+#define ADC_MAX_RATE	200000					//Highest ADC conversion rate (S/s)
+
+// ADC capture (data logger)
+#define CAPTURE_RING_BITS	20					//Ring buffer holds 2^20 samples
+#define CAPTURE_RING_SIZE	(1<<CAPTURE_RING_BITS)
+#define CAPTURE_RING_MASK	(CAPTURE_RING_SIZE-1)
+#define CAPTURE_BLOCK	32768					//Samples per file write
+#define CAPTURE_MAGIC	"DASC"
+#define CAPTURE_VERSION	1
+#define ADC_INTCTL		(0x60c0 | ADC_INTE | ADC_INT_EOA)	//INTERRUPT word while scanning the knobs
+#define ADC_KNOB_TRIG	((0x2081 & ~ADC_TRIGSRC) | ADC_TRIG_PACER | ADC_BURST)	//TRIGGER: a burst per pacer tick
+#define ADC_KNOB_HZ		250						//Knob scans (bursts of both channels) per second
+#define ADC_KNOB_MS		(1000/ADC_KNOB_HZ)		//Knob update period (ms)
+#define ADC_TIMEOUT_NS	50000000				//Longest wait for the knob interrupt (ns)
+
+// Fixed-point waveform generation
+#define UNIT_SHIFT		30						//Unit waveform tables are Q30 (1.0 = 2^30)
+#define GAIN_SHIFT		15						//Amplitude gain is Q15 DAC codes per unit
+#define WAVE_SHIFT		(UNIT_SHIFT+GAIN_SHIFT)	//Sample accumulator is Q45 DAC codes
 
 #define THRESHOLD		30
 
+// Samples and settings of one waveform, handed to PushDAC at a period boundary
+typedef struct {
+    unsigned short* data;			//Samples (capacity entries, see waveAlloc)
+    int capacity;
+    int samples_per_period;
+    unsigned short CTLREG_content;	//DA_CTLREG word for this waveform's DAC range
+    uint32_t pacer_div;				//DAC pacer divisor (0 = software timed)
+    double period_ns;				//Software timed sample period (ns)
+    int32_t center;					//DAC code of the mean (AM scales around it)
+}WaveBuffer ;
+
+// Host timing measured at start-up (see calibrate)
+typedef struct {
+    long write_ns;					//Port write cost
+    long res_ns;					//Timer granularity
+    long sleep_p50_ns;				//Median overshoot of an absolute sleep
+    long sleep_p90_ns;				//90th percentile overshoot
+    long sleep_p99_ns;				//99th percentile overshoot
+    long sleep_max_ns;				//Largest overshoot
+    long spin_ns;					//Spin before a deadline: p90 overshoot + granularity
+}Calibration ;
+
+// One traced sample of a software timed loop
+typedef struct {
+    int64_t deadline;				//Deadline of the sample (CLOCK_MONOTONIC ns)
+    int64_t actual;					//Time the sample was released to be written
+}TraceEntry ;
+
+// Timing trace of one output thread, written by that thread only
+typedef struct {
+    TraceEntry ring[TRACE_SIZE];	//Last TRACE_SIZE samples
+    volatile unsigned long long head;	//Samples traced
+    unsigned long long hist[HIST_BUCKETS];	//Lateness histogram (see histBucket)
+    int64_t max_late;				//Largest lateness (ns)
+    unsigned long long slips;		//Sample clock restarts after a stall
+    volatile int clear;				//Set by a reader to clear the histogram
+}TimingTrace ;
+
+// Absolute deadline sample clock of the software timed loops
+typedef struct {
+    int64_t start;					//CLOCK_MONOTONIC time of sample 0 (ns)
+    double period;					//Sample period (ns)
+    unsigned long long n;			//Samples since start
+    TimingTrace* trace;				//Trace of the thread running the clock
+}Ticker ;
+
+// Frequency sweep of DAC0 (--sweep), run by the DDS output loop (see ddsStep)
+typedef struct {
+    volatile unsigned int gen;		//Changed with the settings, restarts the sweep
+    volatile bool on;
+    bool log;						//Logarithmic sweep, linear otherwise
+    float start, stop;				//Frequencies (Hz)
+    float seconds;					//Duration of one sweep
+    float dwell;					//Time at the stop frequency after each sweep (s)
+    int repeat;						//Sweeps, 0 = until stopped
+}SweepConfig ;
+
+// Position in the sweep, written by the output thread of DAC0 only
+typedef struct {
+    unsigned int gen;				//Settings the sweep was started with
+    double incr;					//Phase increment of the next tick (fractional)
+    double step;					//Added to (linear) or multiplying (log) incr each tick
+    double start_incr, stop_incr;
+    unsigned long long ticks;		//Ticks per sweep
+    unsigned long long left;		//Ticks left in the sweep or dwell
+    bool dwelling;					//At the stop frequency
+    unsigned long long sweeps;		//Sweeps completed
+}SweepState ;
+
+/* Modulation of DAC0 by an internal oscillator (--mod), applied in the
+DDS loops (see ddsSample and ddsStep). mode is written last, so the
+output thread sees complete settings when it turns on */
+typedef struct {
+    volatile int mode;				//MOD_NONE, MOD_AM, MOD_FM or MOD_PM
+    volatile int type;				//Modulating waveform (1 sine, 2 triangle, 3 square)
+    float freq;						//Modulating frequency (Hz)
+    float depth;					//AM index, FM deviation (Hz) or PM deviation (degrees)
+    volatile uint32_t incr;			//Modulator phase increment per tick
+    volatile int32_t depth_q;		//AM: Q15 depth/(1+depth), FM/PM: deviation as a phase (2^32 = 1 cycle)
+    volatile int32_t am_base;		//AM: Q15 1/(1+depth)
+}ModConfig ;
+
+// Modulator of the DAC0 output thread
+typedef struct {
+    uint32_t phase;					//Phase accumulator
+    int32_t m;						//Modulating value of this tick (Q30, [-1, 1])
+}ModState ;
+
+// One segment of a playlist, rendered in the playlist's DAC range
+typedef struct {
+    unsigned short data[DDS_TABLE_SIZE];	//DDS table of the segment
+    int32_t center;					//DAC code of the mean
+    uint32_t incr;					//DDS phase increment
+    unsigned long long ticks;		//Duration in DDS ticks
+    int waveform_type;
+    float seconds, freq, mean, amp;
+}SeqSegment ;
+
+// Playlist of DAC0 (--playlist), handed to the output thread like WaveBuffer
+typedef struct {
+    char name[256];
+    SeqSegment* seg;				//Segments (capacity entries)
+    int count, capacity;
+    int repeat;						//Passes, 0 = until stopped
+}Playlist ;
+
+// Position in the playlist, written by the output thread of DAC0 only
+typedef struct {
+    const Playlist* list;			//Playlist taken, NULL if none
+    const SeqSegment* seg;			//Segment being output
+    int index;						//Index of seg
+    unsigned long long left;		//Ticks left in seg
+    unsigned long long passes;		//Passes completed
+    volatile bool done;				//Last pass ended, holding the mean
+}SeqState ;
+
+// Triggered burst settings of DAC0 (--burst, --trigger)
+typedef struct {
+    int cycles;						//Periods per trigger, 0 = continuous output
+    int bit;						//Trigger bit of Port A
+    bool falling;					//Trigger on the falling edge
+}BurstConfig ;
+
+// Position in a burst
+typedef struct {
+    int i;							//Table index
+    uint32_t phase;					//DDS phase
+    int periods;					//Periods output
+}BurstPos ;
+
+// Trigger to first sample latency, written by the output thread only
+typedef struct {
+    volatile unsigned long long triggers;	//Bursts started
+    unsigned long long hist[HIST_BUCKETS];	//Latency histogram (see histBucket)
+    int64_t max;					//Largest latency (ns)
+    double sum;						//Sum of the latencies (ns)
+    volatile int clear;				//Set by a reader to clear the statistics
+}BurstStats ;
+
+// Terminal screen of the dashboard: the rows on it and the output of a frame
+typedef struct {
+    int fd;							//Terminal
+    char row[DASH_ROWS][DASH_COLS+1];	//Rows on the screen
+    int rows;						//Rows of the last frame
+    bool drawn;						//Screen cleared and drawn once
+    char out[DASH_OUT];				//Escape sequences and text of a frame
+}Dash ;
+
+// A DAC register write queued for the output sink
+typedef struct {
+    int64_t t;						//CLOCK_MONOTONIC time of the write (ns)
+    uint16_t kind;					//SINK_DATA, SINK_CTL, ...
+    uint16_t val;					//Value written
+    volatile uint32_t ready;		//Slot number + 1 once the event is written
+}SinkEvent ;
+
+// DAC writes of the output threads to SinkWriter
+typedef struct {
+    SinkEvent* ev;					//SINK_RING_SIZE events
+    volatile unsigned long long head;	//Next free slot, reserved by the writing threads
+    volatile unsigned long long tail;	//Advanced by SinkWriter
+}SinkRing ;
+
+// DAC model and output file of the sink (SinkWriter)
+typedef struct {
+    int fd;
+    bool wav;						//WAV header, else raw floats
+    const char* name;
+    float rate;						//Output sample rate (S/s)
+    double period;					//Output sample period (ns)
+    float* buf;						//SINK_BLOCK samples to write
+    int n;							//Samples in buf
+    unsigned long long samples;		//Samples written to the file
+    unsigned long long gaps;		//Holds cut to SINK_GAP_NS
+    unsigned short ctl;				//Last DA_CTLREG word
+    uint16_t div[2];				//Pacer counter 1 and 2 divisors
+    bool msb[2];					//Next divisor byte is the msb
+    bool running;					//Pacer converting from the FIFO
+    double tick;					//Pacer period (ns)
+    double t_next;					//Next pacer conversion (ns)
+    uint16_t fifo[DAC_FIFO_SIZE];
+    int fifo_head;
+    int fifo_count;
+    int pair;						//1 after DAC0's write of a --dual pair
+    bool started;					//First DAC0 conversion seen
+    double t_out;					//Time of the next output sample (ns)
+    float held;						//Volts of the last DAC0 conversion
+}SinkState ;
+
+// Snapshot of the waveform parameters for lock-free readers (seqlock)
+typedef struct {
+    bool isOn;
+    unsigned short waveform_type;
+    unsigned short DAC_mode;
+    uint32_t pacer_div;
+    int samples_per_period;
+    float output_res;
+    float mean;
+    float freq;
+    float amp;
+    uint32_t phase_incr;
+}WaveParams ;
+
+// A control command (see ctrlApply)
+typedef struct {
+    uint16_t op;					//CTRL_FREQ, ..., CTRL_STATUS
+    uint16_t channel;				//0 = DAC0, 1 = DAC1 (--dual)
+    float value;					//New value of the parameter
+}CtrlCommand ;
+
+// Reply to a control command
+typedef struct {
+    int32_t status;					//CTRL_OK, or why nothing changed
+    WaveParams params;				//Parameters of the channel after the command
+}CtrlReply ;
+
+/* Shared-memory status page (see statusUpdate). Everything from updates
+on is written as one copy between the two increments of seq */
+typedef struct {
+    uint32_t magic;					//STATUS_MAGIC while a generator updates the page
+    uint32_t size;					//sizeof(StatusPage) of the writer
+    volatile uint32_t seq;			//Seqlock count, odd while the page is written
+    int32_t pid;					//Process of the generator
+    uint64_t updates;				//Snapshots written
+    int64_t time;					//CLOCK_MONOTONIC of the snapshot (ns)
+    WaveParams dac[2];				//Parameters of DAC0 and DAC1
+    uint16_t adc_in[2];				//Potentiometers
+    uint32_t digital_in;			//Switches (Port A)
+    uint64_t ticks[2];				//Software timed samples output (timing trace)
+    uint64_t fifo_samples[2];		//Samples written to the DAC FIFO (--pacer)
+    uint64_t slips[2];				//Software timed deadlines skipped
+    int64_t late_p50[2];			//Lateness of the software timed samples (ns)
+    int64_t late_p99[2];
+    int64_t late_max[2];
+    uint64_t changes;				//Parameter changes of both channels
+    uint64_t bursts;				//Burst triggers
+}StatusPage ;
+
+#ifdef __QNX__
+// devctl() data of a control command: the command in, the reply out
+typedef union {
+    CtrlCommand cmd;
+    CtrlReply reply;
+}CtrlMsg ;
+#endif
+
 // Struct for DAC waveform
 typedef struct {
     bool resetWave;
     bool isOn;
     const short	identity;
     unsigned short waveform_type;
-    unsigned short data[1000];
+    unsigned short* data;			//Samples (capacity entries, see waveAlloc)
+    int capacity;
     unsigned short plus;
     unsigned short DAC_mode;
     int samples_per_period;
@@ -125,8 +715,101 @@ typedef struct {
     float mean;
     float freq;
     float amp;
+    uint32_t pacer_div;			//DAC pacer divisor (0 = software timed)
+    volatile uint32_t phase_incr;	//DDS phase increment per output tick
+    WaveBuffer buffer[2];			//Double buffer for the output thread
+    WaveBuffer* volatile pending;	//Published waveform not yet taken by PushDAC
+    WaveBuffer* published;			//Last published buffer
+    volatile int pushAlive;			//PushDAC thread is running
+    volatile unsigned int param_seq;	//Seqlock count, odd while param is written
+    WaveParams param;				//Parameters for readers outside MainMutex
+    volatile unsigned long long fifo_samples;	//Samples written to the DAC FIFO by the output thread
 }DACField ;
 
+/* Capture file header. The samples follow as 16-bit ADC counts in host
+byte order, channels interleaved (first_channel, first_channel+1, ...).
+samples and overruns are written when the capture stops */
+typedef struct {
+    char magic[4];					//"DASC"
+    uint16_t version;
+    uint16_t header_size;			//Offset of the first sample
+    uint16_t first_channel;
+    uint16_t channels;
+    uint16_t gain;					//MUXCHAN range code (bits 8-11)
+    uint16_t reserved;
+    double rate;					//Conversions per second (all channels)
+    uint64_t samples;				//Samples in the file
+    uint64_t overruns;				//Samples lost (ring full or ADC FIFO overflow)
+}CaptureHeader ;
+
+// Arbitrary waveform file, memory-mapped (see awgLoad)
+typedef struct {
+    char name[256];
+    int format;						//AWG_CSV, AWG_FLOAT or AWG_CAPTURE
+    const char* map;				//File contents (read-only mapping)
+    size_t bytes;
+    size_t first;					//Offset of the first sample
+    int stride;						//Samples per frame (capture channels)
+    int samples;					//Samples in one repetition
+    float rate;						//Sample rate of the file (S/s)
+    float min, max;					//Sample range (V)
+}AwgSource ;
+
+// Sequential reader of an AwgSource, wrapping at the end
+typedef struct {
+    const AwgSource* S;
+    size_t pos;						//Byte offset of the next sample
+    int index;						//Index of the next sample
+}AwgCursor ;
+
+// File played by runStream, read sequentially
+typedef struct {
+    int fd;
+    off_t first;					//Offset of the first sample
+    int stride;						//Bytes per sample (a frame of all channels in a capture file)
+    bool capture;					//ADC counts of a --capture file, floats (V) otherwise
+    unsigned long long samples;		//Samples in the file
+    double rate;					//Output rate (S/s), < 0 as fast as possible
+    uint32_t pacer_div;				//DAC pacer divisor (0 = software timed)
+}StreamSource ;
+
+/* Single producer (StreamReader), single consumer (stream output) ring of
+DAC codes. next and seen are the output thread's own, it publishes tail
+to the reader once per STREAM_BLOCK samples */
+typedef struct {
+    uint16_t* data;					//size samples, a whole number of blocks
+    unsigned long size;				//Power of two
+    volatile unsigned long long head;	//Samples converted, written by the reader only
+    volatile unsigned long long tail;	//Samples the reader may overwrite, written by the output only
+    unsigned long long next;		//Next sample to output
+    unsigned long long seen;		//Head last read by the output thread
+    volatile bool eof;				//Reader has converted the whole file
+}StreamRing ;
+
+// Single producer (CaptureADC), single consumer (CaptureWriter) ring
+typedef struct {
+    uint16_t data[CAPTURE_RING_SIZE];
+    volatile unsigned int head;		//Samples pushed, written by the producer only
+    volatile unsigned int tail;		//Samples taken, written by the consumer only
+}CaptureRing ;
+
+// Board backend: register access and the board interrupt (see boardSim)
+typedef struct {
+    const char* name;
+    bool (*attach)(struct pci_dev_info* info);	//Find the board, fill in its BADRs and IRQ
+    uintptr_t (*map)(uint64_t badr);			//Port base of a BADR
+    bool (*ioPriv)();							//I/O privilege for the calling thread
+    void (*detach)();
+    void (*out8)(uintptr_t port, uint8_t val);
+    void (*out16)(uintptr_t port, uint16_t val);
+    uint8_t (*in8)(uintptr_t port);
+    uint16_t (*in16)(uintptr_t port);
+    int (*intrAttach)(int irq);					//Attach the interrupt to the calling thread, -1 if none
+    void (*intrDetach)(int id);
+    int (*intrWait)(uint64_t timeout);			//Wait for the interrupt (ns), -1 on timeout
+    void (*intrUnmask)(int irq, int id);		//Let the interrupt fire again
+}BoardOps ;
+
 // Struct for intermediary field for changing global variables
 typedef struct {
     int waveform_type;
@@ -140,32 +823,138 @@ typedef struct {
 // PCI device global variables
 int badr[5];
 uintptr_t iobase[5];
+extern const BoardOps boardSim;
+#ifdef __QNX__
+extern const BoardOps boardPCI;
+const BoardOps* board = &boardPCI;	//Board backend (--board)
+#else
+const BoardOps* board = &boardSim;	//Board backend (--board)
+#endif
+char* simRecordFile = NULL;		//Record of the simulated DAC writes (--sim-record <file>)
+char* simScriptFile = NULL;		//Script of the simulated inputs (--sim-script <file>)
+char* sinkFile = NULL;			//Output sink file (--sink <file>)
+float sinkRate = SINK_RATE;		//Output sink rate (--sink-rate <S/s>)
+BoardOps boardTap;				//board with the DAC writes copied to the sink
+const BoardOps* sinkBoard;		//Board under boardTap
+SinkRing sinkRing;				//DAC writes to SinkWriter
+SinkState sinkState;			//DAC model and file of SinkWriter
+volatile bool sinking = false;	//Output sink running
+volatile unsigned long long sinkDropped;	//DAC writes not queued, sinkRing full
+pthread_t sinkThread;
 
 // Program global variables
 bool isOperating=true;			//boolean for program operation. False shutsdown the program.
 bool ctrlc_pressed=false;		//boolean for SIGNINT. Used in checkQuit.
 bool toReturn = false;			//boolean for returning to MainUI(thread) after scanf. Used with Signal.
-bool ADC_Refresh = true;		//boolean for refreshing ADC/GPIO display
+float uiHz = UI_HZ;				//Status screen refresh rate (--ui-hz <Hz>)
+bool useCtrl = false;			//Serve the control endpoint (--ctrl)
+char* ctrlPath = CTRL_PATH;		//Control endpoint (--ctrl-path <path>)
+char* sendOp = NULL;			//Command to send instead of running (--send)
+int sendChannel = 0;			//Channel of the --send command
+float sendValue = 0;			//Value of the --send command
+pthread_t ctrlThread;
+volatile bool ctrlRunning = false;	//CtrlServer runs until ctrlStop
+volatile bool ctrlReady = false;	//Endpoint attached by CtrlServer
+bool useStatus = false;			//Publish the status page (--status)
+char* statusShm = STATUS_NAME;	//Status page name (--status-name <name>)
+float monitorSeconds = -1;		//Monitor a running generator instead (--monitor <s>)
+StatusPage* statusPage = NULL;	//Status page while publishing
+const char* statusName;			//Page this process created or took over (statusStart)
+pthread_t statusThread;
+volatile bool statusRunning = false;	//StatusWriter runs until statusStop
+bool usePacer = false;			//boolean for hardware-paced DAC output (--pacer)
+bool useDDS = false;			//boolean for direct digital synthesis output (--dds)
+bool useDual = false;			//boolean for DAC0 and DAC1 output (--dual)
+bool startedUp = false;			//Start-up options are read, CLManager now runs from importConfig
+char* benchName = NULL;			//Benchmark to run instead of the UI (--bench <name>)
+char* captureFile = NULL;		//ADC capture file instead of the UI (--capture <file>)
+float captureRate = 100000;		//ADC capture rate, all channels (--rate <S/s>)
+int captureChans = 2;			//ADC channels 0..n-1 captured (--chans <n>)
+float captureSeconds = 10;		//ADC capture duration, 0 until a key is pressed (--seconds <s>)
+AwgSource awg;					//Arbitrary waveform file (--awg <file>)
+char* streamFile = NULL;		//File played through DAC0 instead of the UI (--stream <file>)
+float streamRate = 0;			//Sample rate of the stream file, 0 = from the file (--stream-rate <S/s>)
+int streamDepth = STREAM_DEPTH;	//Blocks converted ahead of the stream output (--prefetch <blocks>)
+int rtPrio = 0;					//SCHED_FIFO priority of the output threads, 0 = default (--rt <prio>)
+int rtCPU = -1;					//CPU the output threads are pinned to, -1 = any (--cpu <n>)
+volatile bool rtActive = false;	//Last output thread got SCHED_FIFO
+bool forceCalib = false;		//Measure the host timing even if the cache is valid (--calibrate)
+char* calibFile = NULL;			//Calibration cache, NULL = $HOME/CALIB_FILE (--calib-file <file>)
+Calibration calib = {WRITE_NS, 0, 0, 0, 0, 0, SPIN_NS};	//Host timing (calibrate)
+TimingTrace dacTrace[2];		//Timing trace of the output thread of DAC0 (and dual) and DAC1
 
 // DACField struct global variables
-DACField DAC={true, false, 0, 1, {}, 0, 1, 100, 0, 0, 1, 1};
+DACField DAC={true, false, 0, 1, NULL, 0, 0, 1, 100, 0, 0, 1, 1, .pacer_div = 0};
+DACField DAC1={true, false, 1, 1, NULL, 0, 0, 1, 100, 0, 0, 1, 1, .pacer_div = 0};
+DACField* Channel[2]={&DAC, &DAC1};
+volatile uint32_t phaseOffset = 0;	//DAC1 phase lead over DAC0 (2^32 = 360 degrees)
+SweepConfig sweep;					//Frequency sweep of DAC0 (--sweep)
+SweepState sweepRun;				//Sweep position of the DAC0 output thread
+ModConfig mod;						//Modulation of DAC0 (--mod)
+ModState modRun;					//Modulator of the DAC0 output thread
+int32_t modTable[3][DDS_TABLE_SIZE];	//Unit modulating waveforms (Q30)
+Playlist seqLists[2];				//Double buffer of playlists (seqLoad)
+Playlist* volatile seqPending = NULL;	//Loaded playlist not yet taken by the output thread
+Playlist* seqPublished = NULL;		//Last loaded playlist
+SeqState seqRun;					//Playlist position of the DAC0 output thread
+BurstConfig burst = {0, BURST_BIT, false};	//Triggered burst of DAC0 (--burst)
+BurstStats burstStats;				//Trigger latency of the bursts
+float phaseDeg = 0;					//Phase offset in degrees (UI)
 
 // ADC global variables
 uintptr_t digital_in;
 uint16_t adc_in[2] = {};
 uint16_t old_adc_in[2] = {};
+int adc_irq = -1;				//Board IRQ (from board->attach)
+int adc_iid = -1;				//Interrupt id, -1 polls the EOC bit instead
+
+// ADC capture global variables
+CaptureRing capRing;
+volatile bool capturing = false;		//Cleared to stop CaptureADC
+volatile bool captureDone = false;		//Set by CaptureADC when it has stopped
+unsigned long long capOverruns = 0;	//Samples dropped because the ring was full
+unsigned long long capFifoOverflows = 0;	//ADC FIFO overflows (data lost on the board)
+unsigned long long capWritten = 0;		//Samples written to the file
+
+// Streaming playback global variables
+StreamRing strRing;
+volatile bool streaming = false;		//Cleared to stop the stream threads
+volatile bool streamDone = false;		//Set by the output thread when it has stopped
+unsigned long long strUnderruns = 0;	//Output samples (software timed) or refills (paced) short of data
+unsigned long long strRead = 0;			//Bytes read from the stream file
 
 
 // Mutex (only one to change DAC variables)
 pthread_mutex_t MainMutex = PTHREAD_MUTEX_INITIALIZER;
 
+/* WaveGenManager sleeps on WaveCond until change() makes a request, and
+broadcasts AckCond when it has handled it. Both are used with MainMutex.
+AckCond is set up in main to time its waits on CLOCK_MONOTONIC */
+pthread_cond_t WaveCond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t AckCond;
+unsigned int waveRequest = 0;		//Number of changes requested (change())
+unsigned int waveDone = 0;			//Last request handled by WaveGenManager
+
 // Function Declaration for Housekeeping
 
 // UI functionalities
 void CLManager (int argc, char **argv);		//Manages Command line
+void parseWaveArgs(DACField* D,
+	int argc, char** argv);					//Apply waveform arguments to channel D
+bool atStartup(const char* option);		//Whether a start-up only option may be applied now
+void startupArg(char** value, char** argv,
+	int* counter);							//Copy the value of a start-up only option
 void displayHelp();							//Display instructions for MainUI
-void showDACConfig();						//Show current DAC configuration
+void showDACConfig(FILE* out);				//Show current DAC configuration
+void showChannel(FILE* out, DACField* D,
+	const char* name);						//Show the configuration of one DAC channel
 void showADCStatus();						//Show ADC status
+void showStatus(FILE* out, bool showDAC);	//One frame of the ADC status screen
+void dashStart(Dash* S, int fd);			//Start a dashboard on a terminal
+int dashFrame(Dash* S, const char* text,
+	size_t len);							//Draw the changes of a frame in one write
+void dashStop(Dash* S);						//Leave the cursor below the dashboard
+void termClear();							//Clear the terminal without a shell
 void importConfig();						//Import the configuration from .txt file
 void exportConfig();						//Export the configuration to .txt file
 void changeParam();							//Change the parameters of the DAC0
@@ -176,15 +965,83 @@ void checkQuit(char ch);					//Reconfirm with user about quitting after SIGINT (
 void INThandler(int sig);					//Signal handler for SIGINT
 
 //Utilities
-bool hasNegative();
+bool hasNegative(DACField* D);
 short checkAbsMax(float mean, float amp);	// Supporting function: check absolute maximum value
 void change(bool onSignal, int wvty,
 	float f, float m, float a);				// Function to directly change the parameters of the DAC
+void changeChannel(DACField* D, bool onSignal,
+	int wvty, float f, float m, float a);	// Change the parameters of one DAC channel
 void setChangeField(ChangeField* CF);		//Set the change field to be equal to initial DAC parameters
-void WaveformGen ();						//Generate data for waveform
-void chooseBestRes();						/*Change the bipolar/unipolar mode based on mean and amplitude
+void loadChangeField(DACField* D,
+	ChangeField* CF);						//Set the change field to the parameters of channel D
+bool waitWaveAck(unsigned int seq);			//Wait for WaveGenManager to handle change request seq
+void stopProgram();							//Clear isOperating and wake the waiting threads
+void WaveformGen (DACField* D);				//Generate data for waveform
+const int32_t* unitWave(int type, int spp);	//Cached unit amplitude table of a waveform
+void scaleWave(unsigned short* out, const int32_t* unit,
+	int n, int64_t base, int32_t gain);	//out = (base + gain*unit) in DAC codes
+void chooseBestRes(DACField* D);			/*Change the bipolar/unipolar mode based on mean and amplitude
 											to give best resolution*/
-long interval(struct timespec* start, struct timespec* end); // Used for calculating nanosec difference between timespec
+void chooseSampling(DACField* D);			//Choose samples per period and pacer divisor for D->freq
+uint32_t pacerSplit(uint32_t div, unsigned int* div1,
+	unsigned int* div2);					//Nearest divisor of the cascaded DAC pacer counters
+void dacPacer(uint32_t div);				//Load the DAC pacer counters with div
+void waveAlloc(unsigned short** data,
+	int* capacity, int n);					//Grow a sample array to n samples
+bool awgLoad(const char* file, float rate);	//Map an arbitrary waveform file
+void awgSampling(DACField* D);				//Output samples per repetition of the AWG file
+void awgFill(DACField* D, int64_t base,
+	int32_t gain);							//Resample the AWG file into D->data
+void awgRewind(AwgCursor* c);				//Start reading at the first sample
+float awgNext(AwgCursor* c);				//Next sample (V), wrapping at the end
+void awgDefault(ChangeField* CF);			//AWG settings that replay the file as it is
+bool seqLoad(const char* file,
+	ChangeField* CF);						//Render a playlist and hand it to DAC0
+void seqStop();								//End the playlist of DAC0
+void seqTake(SeqState* S);					//Take a loaded playlist at a tick
+void seqRestart(SeqState* S);				//Start the playlist from its first segment
+static inline uint32_t seqNext(SeqState* S);	//Phase increment of the next playlist tick
+void seqTurn(SeqState* S);					//End of a segment
+float maxFreq();							//Highest frequency allowed in the current output mode
+float ddsRate();							//DDS output tick rate (S/s)
+uint32_t ddsIncrement(float f);				//DDS phase increment for frequency f
+void setPhase(float deg);					//Set the phase offset of DAC1 relative to DAC0
+static inline uint32_t ddsStep(DACField* D);	//Phase increment of the next DDS tick of D
+static inline unsigned short ddsSample(DACField* D,
+	const WaveBuffer* w, uint32_t phase);	//DAC code of D at a DDS phase
+bool modSet(int mode, int type,
+	float freq, float depth);				//Set the modulation of DAC0
+void sweepStart(SweepState* S);				//Start the sweep set in sweep
+static inline uint32_t sweepNext(SweepState* S);	//Phase increment of the next sweep tick
+void sweepTurn(SweepState* S);				//End of a sweep or dwell
+float sweepFreq();							//Frequency the sweep is at (Hz)
+int64_t monoNow();							//CLOCK_MONOTONIC time (ns)
+void tickerStart(Ticker* T, double period,
+	TimingTrace* trace);					//Start a sample clock at the current time
+void tickerPeriod(Ticker* T, double period);	//Change the period from the current deadline on
+void tickerWait(Ticker* T);					//Sleep until the next sample deadline
+static inline void traceRecord(TimingTrace* R,
+	int64_t deadline, int64_t actual);		//Add a sample to the trace and histogram
+static inline int histBucket(int64_t late);	//Histogram bucket of a lateness
+int64_t histLow(int b);						//Lowest lateness in histogram bucket b
+int64_t histPercentile(const unsigned long long* hist,
+	double q);								//Lateness below which a fraction q of samples fall
+int traceCopy(TimingTrace* R, TraceEntry* out);	//Copy the valid part of the ring, oldest first
+void showTiming();							//Show the output timing and dump the trace
+bool showTrace(TimingTrace* R, const char* name);	//Show the lateness of one thread
+void dumpTrace(TimingTrace* R, const char* file);	//Write the trace ring to a file
+bool showBurst();							//Show the trigger latency of the bursts
+void calibrate(bool force);					//Load or measure the host timing (Calibration)
+void measureTiming(Calibration* C);			//Time port writes, sleeps and the clock
+bool loadCalibration(Calibration* C,
+	const char* host);						//Read calibFile if it was made on this host
+void saveCalibration(const Calibration* C,
+	const char* host);						//Write calibFile
+int cmpLong(const void* a, const void* b);	//qsort order of longs
+void rtSetup();								//Lock the process memory if the real-time policy is on
+void rtOutput();							//Real-time policy of the calling output thread
+void rtDemote();							//Lower the calling UI or input thread below the default
+void rtPrefault();							//Touch the stack so it is mapped before the loop
 void getInput(char* in);					//Get input from keyboard
 int checkInput(char* in);					//Check the input validity in MainUI
 float checkValidFloat();					//Check validity of floating point number
@@ -196,10 +1053,141 @@ void* MainUI (void *pointer);				//General purpose thread for inputting from key
 
 // Peripherals (GPIO and ADC)
 void* PeripheralInputs(void *pointer);		//Thread for GPIO and ADC
+bool adcAttach();							//Start the paced knob scan and attach its interrupt
+void adcDetach();							//Stop the knob scan and detach the interrupt
+bool adcScan(uint16_t* out);				//Latest scan of ADC channels 0 and 1
+
+// ADC capture
+int runCapture(const char* file, float rate,
+	int chans, float seconds);				//Capture ADC channels to a file
+double adcPacer(float rate);				//Program the ADC pacer, return the actual rate
+void* CaptureADC(void* pointer);			//Thread moving ADC FIFO blocks into the ring
+void* CaptureWriter(void* pointer);			//Thread writing the ring to the file
+
+// Streaming playback
+int runStream(const char* file, float rate,
+	int depth, float seconds);				//Play a file of any length through DAC0
+bool streamOpen(const char* file, float rate,
+	StreamSource* S);						//Open a stream file and find its format
+void* StreamReader(void* pointer);			//Thread converting the file into strRing
+void* StreamOut(void* pointer);				//Thread writing strRing to the DAC
+void streamPaced(StreamSource* S);			//Pacer clocked stream output
+int streamFIFO(int n, uint16_t* v);			//Write up to n ring samples to the DAC FIFO
+static inline int streamNext(uint16_t* v);	//Next ring sample for the output, never blocks
+static inline uint16_t streamCode(float v);	//DAC code of a sample in volts at +/-10V
 
 // DAC
 void* WaveGenManager (void * pointer);		//Thread for managing waveform generating capabilities
 void* PushDAC (void* Curr);					//Thread to push-out data to DAC asynchronously
+void PushDACDual();							//DAC0 and DAC1 DDS output loop (--dual)
+WaveBuffer* PushDACTimed(DACField* Current,
+	WaveBuffer* cur);						//Software timed output loop
+WaveBuffer* PushDACBurst(DACField* Current,
+	WaveBuffer* cur);						//Triggered burst output of DAC0
+static inline int burstNext(DACField* D,
+	const WaveBuffer* w, BurstPos* P);		//Next sample of a burst, -1 at its end
+void burstRecord(int64_t latency);			//Add a trigger latency to burstStats
+WaveBuffer* PushDACPaced(DACField* Current,
+	WaveBuffer* cur);						//Pacer clocked output, refilling the DAC FIFO in blocks
+bool fillFIFO(DACField* Current, WaveBuffer** cur,
+	int n, int* i, uint32_t* phase);		//Write n table or DDS samples to the DAC
+void publishWave(DACField* D);				//Hand the generated waveform to PushDAC
+WaveBuffer* takeWave(DACField* D);			//Take the pending waveform, if any
+WaveBuffer* swapWave(DACField* D,
+	WaveBuffer* cur);						//Switch to the pending waveform at a period boundary
+bool keepPushing(DACField* D);				//False once the output thread has to stop
+bool outputOn(DACField* D);					//True while the output thread of D has a channel to output
+void storeParams(DACField* D);				//Publish D's parameters to the seqlock snapshot
+void loadParams(DACField* D, WaveParams* P);	//Read a consistent snapshot without locking
+
+// Benchmarks
+int runBenchmark(const char* name);			//Run the named benchmark and return exit code
+int benchManager();							//Parameter change latency through WaveGenManager
+int benchSeqlock();							//Snapshot consistency under concurrent change()
+int benchWaveGen();							//Fixed-point WaveformGen against the double version
+int benchTrace();							//Cost of the timing trace and reader consistency
+int benchRT();								//Output lateness under load with and without --rt
+int benchSweep();							//Sweep frequency and phase accuracy, cost per tick
+int benchMod();								//Modulation depth accuracy and cost per sample
+int benchSeq();								//Playlist segment boundaries and switch cost
+int benchDash();							//Dashboard frame cost and screen contents
+int benchCtrl();							//Control command round trip and rate
+int benchStatus();							//Status page snapshot consistency and cost
+int benchAWG();								//AWG file formats, resampling and scaling
+bool dashReplay(const char* file,
+	const char* text, size_t len);			//Check a dashboard output against a frame
+int benchPacer();							//Paced output refills on the simulated board
+int benchIOCount();							//Port writes per period of the output threads
+int benchADCScan();							//ADC scan sequence and knob response
+int benchCapture();							//ADC capture rate, overruns and file contents
+int benchDrift();							//Long-run rate of the software timed output
+int benchStream();							//Sustained rate of a multi-GB stream replay
+int benchBurst();							//Trigger to first sample latency of a burst
+int benchBoard();							//Board access cost, recorded jitter and scripted inputs
+int benchSink();							//Output sink cost and file contents
+bool sinkRead(const char* file, float rate,
+	unsigned long long* samples, double* freq,
+	double* peak, unsigned long* glitches);	//Read back a WAV file of the sink
+
+// Simulated board (board backend "sim")
+bool simAttach(struct pci_dev_info* info);	//Simulated board at fixed BADRs, start record and script
+uintptr_t simMap(uint64_t badr);			//Port base of a simulated BADR
+bool simIOPriv();							//No privilege needed
+void simDetach();							//Write the DAC write record
+void simOut8(uintptr_t port, uint8_t val);	//Simulated port writes and reads
+void simOut16(uintptr_t port, uint16_t val);
+uint8_t simIn8(uintptr_t port);
+uint16_t simIn16(uintptr_t port);
+int simIntrAttach(int irq);					//Attach the simulated interrupt
+void simIntrDetach(int id);
+int simIntrWait(uint64_t timeout);			//Wait for the simulated interrupt
+void simIntrUnmask(int irq, int id);
+void simReset();							//Clear simulated DAC counters
+unsigned long long simWrites(uintptr_t port);	//Writes to a simulated port since simReset
+unsigned long long simReads(uintptr_t port);	//Reads of a simulated port since simReset
+void simSetADC(int ch, uint16_t val);		//Set a simulated analog input
+void simSetDIO(uint8_t val);				//Set the simulated Port A inputs
+bool simRecord(bool on);					//Start or stop recording the DAC data writes
+void simRecordDump(const char* file);		//Write the DAC write record to a file
+bool simScriptStart(const char* file);		//Load an input script and start playing it
+void* SimScript(void* pointer);				//Thread applying the input script
+
+// Output sink (--sink)
+bool sinkStart(const char* file, float rate);	//Tap the DAC writes and start SinkWriter
+void sinkStop();							//Write the rest of the output and close the file
+void tapOut8(uintptr_t port, uint8_t val);	//Port writes of boardTap
+void tapOut16(uintptr_t port, uint16_t val);
+void tapDetach();							//Stop the sink, detach the board under it
+void* SinkWriter(void* pointer);			//Thread converting the DAC writes to samples
+void sinkEvent(SinkState* S, const SinkEvent* E);	//Apply a DAC write to the model
+void sinkAdvance(SinkState* S, double t);	//Pacer conversions up to t
+void sinkEmit(SinkState* S, double t, uint16_t code);	//A DAC conversion at t
+void sinkPut(SinkState* S, float v);		//Append an output sample
+bool sinkHeader(SinkState* S);				//Write the WAV header
+float dacVolts(uint16_t code, int mode);	//Volts of a DAC code in a DAC mode
+
+// Control endpoint (--ctrl)
+void ctrlApply(const CtrlCommand* C,
+	CtrlReply* R);							//Range check and apply a command
+bool ctrlStart(const char* path);			//Serve commands at path
+void ctrlStop();							//Stop serving and remove the endpoint
+void* CtrlServer(void* pointer);			//Thread serving the endpoint
+int ctrlOpen(const char* path);				//Connect to a control endpoint
+int ctrlCall(int fd, const CtrlCommand* C,
+	CtrlReply* R);							//Send a command and wait for the reply
+int ctrlSend(const char* path, int channel,
+	const char* op, float value);			//Client of --send
+
+// Status page (--status, --monitor)
+bool statusStart(const char* name);			//Create the page and start StatusWriter
+void statusStop();							//Stop updating and remove the page
+int statusOwner(const char* name);			//Process of an existing page, 0 if it has none
+void* StatusWriter(void* pointer);			//Thread updating the page STATUS_HZ times a second
+void statusUpdate(StatusPage* S);			//Write one snapshot
+int statusRead(const StatusPage* S,
+	StatusPage* out);						//Copy a consistent snapshot, return the retries or -1
+const StatusPage* statusMap(const char* name);	//Map a page read-only
+int runMonitor(const char* name, float seconds);	//Print the live rates of a running generator
 
 
 //*************************************************************//
@@ -208,7 +1196,6 @@ void* PushDAC (void* Curr);					//Thread to push-out data to DAC asynchronously
 int main(int argc, char** argv) {
     //PCI device variable
     struct pci_dev_info info;
-    void *hdl;
 	int rc;
 
     uintptr_t dio_in;
@@ -218,31 +1205,47 @@ int main(int argc, char** argv) {
     unsigned short chan;
 
     pthread_attr_t attr;
+    pthread_condattr_t cattr;
     pthread_t thread[3];
 
+    // Deadlines of waitWaveAck on the clock of the other timed waits, not the settable one
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&AckCond, &cattr);
+    pthread_condattr_destroy(&cattr);
+
     // Invoke Signal
 	signal(SIGINT, INThandler);
 
+    // Initial DAC parameters for the lock-free snapshot readers
+    storeParams(&DAC);
+    storeParams(&DAC1);
+
     // Call command line manager
     CLManager (argc, argv);
+    startedUp = true;
+
+    // Only send a command to a running generator if requested
+    if(sendOp!=NULL)
+        return ctrlSend(ctrlPath, sendChannel, sendOp, sendValue) == CTRL_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // Only monitor a running generator if requested
+    if(monitorSeconds>=0){
+        signal(SIGINT, SIG_DFL);
+        return runMonitor(statusShm, monitorSeconds);
+    }
 
 	// Set up the PCI
-    printf("\fSet-up Routine for PCI-DAS 1602\n\n");
+    printf("\fSet-up Routine for PCI-DAS 1602 (%s)\n\n", board->name);
     memset(&info,0,sizeof(info));
-    if(pci_attach(0)<0) {
-      perror("pci_attach");
-      exit(EXIT_FAILURE);
-    }
 
     // Vendor and Device ID
     info.VendorId=0x1307;
     info.DeviceId=0x01;
 
 	// Attempt to attach to PCI device and populate info struct
-    if ((hdl=pci_attach_device(0, PCI_SHARE|PCI_INIT_ALL, 0, &info))==0) {
-      perror("pci_attach_device");
+    if (!board->attach(&info))
       exit(EXIT_FAILURE);
-      }
 
     // Determine assigned BADRn IO addresses for PCI-DAS1602
     printf("\nDAS 1602 Base addresses:\n\n");
@@ -250,28 +1253,67 @@ int main(int argc, char** argv) {
       badr[i]=PCI_IO_ADDR(info.CpuBaseAddress[i]);
       printf("Badr[%d] : %x\n", i, badr[i]);
       }
+    adc_irq = info.Irq;
 
     // Map I/O base address to user space
     printf("\nReconfirm Iobase:\n");
     for(i=0;i<5;i++) {
       // Expect CPU Base Address to be the same as IO Base for PC
-      iobase[i]=mmap_device_io(0x0f,badr[i]);
+      iobase[i]=board->map(badr[i]);
       printf("Index %d : Address : %x ", i,badr[i]);
       printf("IOBASE  : %x \n",iobase[i]);
       }
 
     // Modify thread control privity
-    if(ThreadCtl(_NTO_TCTL_IO,0)==-1) {
+    if(!board->ioPriv()) {
       perror("Thread Control");
       exit(1);
       }
 
+    // Copy the DAC output to a file from here on if requested
+    if(sinkFile!=NULL && !sinkStart(sinkFile, sinkRate)){
+        board->detach();
+        exit(EXIT_FAILURE);
+    }
+
+    // Publish the status page from here on if requested
+    if(useStatus && !statusStart(statusShm))
+        printf("Status page %s is not available.\n", statusShm);
+
     // ADC write register
-    out16(INTERRUPT, 0x60c0);
-    out16(TRIGGER, 0x2081);
-    out16(AUTOCAL, 0x007f);
-    out16(AD_FIFOCLR, 0);
-    out16(MUXCHAN, 0x0D00);
+    board->out16(INTERRUPT, 0x60c0);
+    board->out16(TRIGGER, 0x2081);
+    board->out16(AUTOCAL, 0x007f);
+    board->out16(AD_FIFOCLR, 0);
+    board->out16(MUXCHAN, 0x0D00);
+
+    // Capture the ADC to a file instead of the user interface if requested
+    if(captureFile!=NULL){
+        rc = runCapture(captureFile, captureRate, captureChans, captureSeconds);
+        statusStop();
+        board->detach();
+        return rc;
+    }
+
+    // Port write cost and sleep accuracy for the software timed output
+    calibrate(forceCalib);
+    rtSetup();
+
+    // Play a stream file instead of the user interface if requested
+    if(streamFile!=NULL){
+        rc = runStream(streamFile, streamRate, streamDepth, 0);
+        statusStop();
+        board->detach();
+        return rc;
+    }
+
+    // Run a benchmark instead of the user interface if requested
+    if(benchName!=NULL){
+        rc = runBenchmark(benchName);
+        statusStop();
+        board->detach();
+        return rc;
+    }
 
     // Create joinable attribute
     pthread_attr_init(&attr);
@@ -284,7 +1326,7 @@ int main(int argc, char** argv) {
     3. ADC and Switches
     */
     delay(1500);
-    system("clear");
+    termClear();
 
     for(i=0;i<3;i++){
         switch (i){
@@ -302,6 +1344,10 @@ int main(int argc, char** argv) {
     }
     pthread_attr_destroy(&attr);
 
+    // Take commands from other processes if requested
+    if(useCtrl && !ctrlStart(ctrlPath))
+        printf("Control endpoint %s is not available.\n", ctrlPath);
+
     // Joining MainUI input
     for(i=0;i<3;i++){
         rc = pthread_join(thread[i], NULL);
@@ -310,13 +1356,15 @@ int main(int argc, char** argv) {
             exit(-1);
         }
     }
+    ctrlStop();
+    statusStop();
 
 	// Exit message and clean screen
     printf("Process quitting in 1 second...");
     fflush(stdout);
 	sleep(1);
-	system("clear");
-    pci_detach_device(hdl);
+	termClear();
+    board->detach();
     return 0;
 }
 
@@ -336,6 +1384,7 @@ void displayHelp() {
     printf("%*s\t\t%s", 6, "6", "Halt DAC operation "
     	"(must turn off peripheral input).\n");
     printf("%*s\t\t%s", 6, "7", "Exit program\n");
+    printf("%*s\t\t%s", 6, "8", "Show output timing (jitter).\n");
     printf("\nFriendly reminder: please turn off peripheral input\n"
     "before changing any variable through keyboard.\n");
     printf("\nPlease enter your command: ");
@@ -362,7 +1411,7 @@ int checkInput(char* in) {
     temp = strtol(in, &endptr, 10);
     // check if valid integer is inputted
     if(*endptr == '\0'){
-        if(temp>0 && temp <8)
+        if(temp>0 && temp <9)
             return temp;
     }
     else
@@ -370,31 +1419,184 @@ int checkInput(char* in) {
     return 0;
 }
 //Show current DAC configuration
-void showDACConfig(){
-    printf("%*s\n", 38, "DAC0");
-    printf("%*s%*d\n", 25,
-           "Running? (0-OFF, 1-ON)", 15, DAC.isOn);
-    printf("%*s", 25, "Waveform type");
-	switch(DAC.waveform_type){
-        case 1: { printf("%*s", 15, "Sinusoidal"); break;}
-        case 2: { printf("%*s", 15, "Triangular"); break;}
-        case 3: { printf("%*s", 15, "Square"); break;}
+void showDACConfig(FILE* out){
+    showChannel(out, &DAC, "DAC0");
+    if(useDual){
+        fprintf(out, "\n");
+        showChannel(out, &DAC1, "DAC1");
+        fprintf(out, "%*s%*.2f\n", 25, "Phase offset (deg)", 15, phaseDeg);
     }
-    printf("\n");
-    printf("%*s%*d\n", 25,
-           "Samples per period", 15, DAC.samples_per_period);
-    printf("%*s%*.2E\n", 25,
-           "DAC Output resolution (V)", 15, DAC.output_res/1000000);
-    printf("%*s%*.2f\n", 25, "Frequency (Hz)", 15, DAC.freq);
-    printf("%*s%*.2f\n", 25, "Amplitude (V)", 15, DAC.amp);
-    printf("%*s%*.2f\n", 25, "Mean (V)", 15, DAC.mean);
+}
+//Show the configuration of one DAC channel
+void showChannel(FILE* out, DACField* D, const char* name){
+    WaveParams P;
+    loadParams(D, &P);
+    fprintf(out, "%*s\n", 38, name);
+    fprintf(out, "%*s%*d\n", 25,
+           "Running? (0-OFF, 1-ON)", 15, P.isOn);
+    fprintf(out, "%*s", 25, "Waveform type");
+	switch(P.waveform_type){
+        case 1: { fprintf(out, "%*s", 15, "Sinusoidal"); break;}
+        case 2: { fprintf(out, "%*s", 15, "Triangular"); break;}
+        case 3: { fprintf(out, "%*s", 15, "Square"); break;}
+        case 4: { fprintf(out, "%*s", 15, "Arbitrary"); break;}
+    }
+    fprintf(out, "\n");
+    if(P.waveform_type == 4){
+        fprintf(out, "%*s  %s\n", 25, "AWG file", awg.name);
+        fprintf(out, "%*s%*d\n", 25, "AWG file samples", 15, awg.samples);
+        fprintf(out, "%*s%*.1f\n", 25, "AWG file rate (S/s)", 15, awg.rate);
+    }
+    fprintf(out, "%*s%*d\n", 25,
+           "Samples per period", 15, P.samples_per_period);
+    if(useDDS && D->identity == 0 && seqPublished != NULL && seqPublished->count){
+        fprintf(out, "%*s  %s\n", 25, "Playlist", seqPublished->name);
+        fprintf(out, "%*s%*d/%d\n", 25, "Segment", 13, seqRun.index + 1, seqPublished->count);
+        fprintf(out, "%*s%*llu/%d%s\n", 25, "Passes done", 13, seqRun.passes, seqPublished->repeat,
+               seqRun.done ? " (ended)" : "");
+    }
+    if(D->identity == 0 && burst.cycles){
+        fprintf(out, "%*s%*d\n", 25, "Burst periods", 15, burst.cycles);
+        fprintf(out, "%*s%*d %s\n", 25, "Trigger (Port A bit)", 15, burst.bit, burst.falling ? "falling" : "rising");
+        fprintf(out, "%*s%*llu\n", 25, "Bursts triggered", 15, burstStats.triggers);
+    }
+    if(useDDS && D->identity == 0 && mod.mode != MOD_NONE){
+        fprintf(out, "%*s%*s\n", 25, "Modulation", 15, mod.mode == MOD_AM ? "AM" : mod.mode == MOD_FM ? "FM" : "PM");
+        fprintf(out, "%*s%*s\n", 25, "Modulating waveform", 15,
+               mod.type == 1 ? "Sinusoidal" : mod.type == 2 ? "Triangular" : "Square");
+        fprintf(out, "%*s%*.2f\n", 25, "Modulating freq (Hz)", 15, mod.freq);
+        fprintf(out, "%*s%*.3f %s\n", 25, "Depth", 15, mod.depth,
+               mod.mode == MOD_AM ? "" : mod.mode == MOD_FM ? "Hz" : "deg");
+    }
+    if(useDDS && D->identity == 0 && sweep.on){
+        fprintf(out, "%*s%*s\n", 25, "Sweep", 15, sweep.log ? "Logarithmic" : "Linear");
+        fprintf(out, "%*s%*.2f\n", 25, "Sweep start (Hz)", 15, sweep.start);
+        fprintf(out, "%*s%*.2f\n", 25, "Sweep stop (Hz)", 15, sweep.stop);
+        fprintf(out, "%*s%*.3f\n", 25, "Sweep time (s)", 15, sweep.seconds);
+        fprintf(out, "%*s%*.3f\n", 25, "Dwell (s)", 15, sweep.dwell);
+        fprintf(out, "%*s%*llu/%d\n", 25, "Sweeps done", 13, sweepRun.sweeps, sweep.repeat);
+        fprintf(out, "%*s%*.2f\n", 25, "Sweep frequency (Hz)", 15, sweepFreq());
+    }
+    if(useDDS){
+        fprintf(out, "%*s%*.1f\n", 25, "DDS rate (S/s)", 15, ddsRate());
+        fprintf(out, "%*s%*u\n", 25, "DDS phase increment", 15, P.phase_incr);
+        fprintf(out, "%*s%*.6f\n", 25, "DDS frequency (Hz)", 15,
+               P.phase_incr*ddsRate()/4294967296.0);
+    }
+    else if(P.pacer_div)
+        fprintf(out, "%*s%*.1f\n", 25, "Pacer rate (S/s)", 15,
+               (float)PACER_CLOCK/P.pacer_div);
+    else
+        fprintf(out, "%*s%*s\n", 25, "Output timing", 15, "Software");
+    fprintf(out, "%*s%*.2E\n", 25,
+           "DAC Output resolution (V)", 15, P.output_res/1000000);
+    fprintf(out, "%*s%*.2f\n", 25, "Frequency (Hz)", 15, P.freq);
+    fprintf(out, "%*s%*.2f\n", 25, "Amplitude (V)", 15, P.amp);
+    fprintf(out, "%*s%*.2f\n", 25, "Mean (V)", 15, P.mean);
     return;
 }
+/* Show the output timing
+
+Lateness of the samples of the software timed output threads against
+their deadlines (hardware paced output is not traced), then optionally
+dump the trace ring to a file */
+void showTiming(){
+    char input[100];
+    bool shown;
+    shown = showTrace(&dacTrace[0], "DAC0");
+    shown = showTrace(&dacTrace[1], "DAC1") || shown;
+    shown = showBurst() || shown;
+    if(!shown){
+        printf("No software timed output traced yet.\n");
+        return;
+    }
+    printf("\nEnter a file name to dump the DAC0 trace, C to clear the histogram, N to return: ");
+    getInput(&input[0]);
+    if(toReturn)
+        return;
+    if((input[0] == 'n' || input[0] == 'N') && input[1] == '\0')
+        return;
+    if((input[0] == 'c' || input[0] == 'C') && input[1] == '\0'){
+        dacTrace[0].clear = 1;
+        dacTrace[1].clear = 1;
+        burstStats.clear = 1;
+        return;
+    }
+    dumpTrace(&dacTrace[0], input);
+}
+//Show the lateness of one output thread, false if it has not run
+bool showTrace(TimingTrace* R, const char* name){
+    unsigned long long hist[HIST_BUCKETS], n = 0, row;
+    int b, last = -1;
+    if(R->head == 0)
+        return false;
+    memcpy(hist, R->hist, sizeof(hist));
+    for(b=0;b<HIST_BUCKETS;b++)
+        if(hist[b]){
+            n += hist[b];
+            last = b;
+        }
+    printf("%*s\n", 38, name);
+    printf("%*s%*llu\n", 25, "Samples", 15, n);
+    printf("%*s%*llu\n", 25, "Clock restarts", 15, R->slips);
+    if(n == 0)
+        return true;
+    printf("%*s%*.1f\n", 25, "Late p50 (us)", 15, histPercentile(hist, 0.5)/1000.0);
+    printf("%*s%*.1f\n", 25, "Late p99 (us)", 15, histPercentile(hist, 0.99)/1000.0);
+    printf("%*s%*.1f\n", 25, "Late p99.9 (us)", 15, histPercentile(hist, 0.999)/1000.0);
+    printf("%*s%*.1f\n", 25, "Late max (us)", 15, R->max_late/1000.0);
+	// One line per power of two up to the largest lateness
+    printf("%*s%*s%*s\n", 25, "Late from (us)", 15, "Samples", 10, "%");
+    for(b=0;b<=last;b+=HIST_SUB){
+        row = hist[b] + hist[b+1] + hist[b+2] + hist[b+3];
+        printf("%*.3f%*llu%*.2f\n", 25, histLow(b)/1000.0, 15, row, 10, 100.0*row/n);
+    }
+    printf("\n");
+    return true;
+}
+//Show the trigger to first sample latency of --burst, false if not triggered yet
+bool showBurst(){
+    BurstStats* S = &burstStats;
+    unsigned long long n = S->triggers;
+    if(n == 0)
+        return false;
+    printf("\nBurst trigger latency (last Port A read before the edge to first sample)\n");
+    printf("%*s%*llu\n", 25, "Triggers", 15, n);
+    printf("%*s%*.0f\n", 25, "Mean (ns)", 15, S->sum/n);
+    printf("%*s%*lld\n", 25, "Median (ns)", 15, (long long)histPercentile(S->hist, 0.5));
+    printf("%*s%*lld\n", 25, "99% (ns)", 15, (long long)histPercentile(S->hist, 0.99));
+    printf("%*s%*lld\n", 25, "Max (ns)", 15, (long long)S->max);
+    return true;
+}
+/* Write the trace ring, oldest first, one sample per line:
+deadline and actual time (CLOCK_MONOTONIC ns) and lateness (ns) */
+void dumpTrace(TimingTrace* R, const char* file){
+    static TraceEntry copy[TRACE_SIZE];
+    FILE* fd;
+    int i, n;
+    if((fd = fopen(file, "w")) == NULL){
+        perror(file);
+        return;
+    }
+    n = traceCopy(R, copy);
+    fprintf(fd, "# deadline_ns actual_ns late_ns\n");
+    for(i=0;i<n;i++)
+        fprintf(fd, "%lld %lld %lld\n", (long long)copy[i].deadline,
+            (long long)copy[i].actual, (long long)(copy[i].actual - copy[i].deadline));
+    fclose(fd);
+    printf("%d samples written to %s\n", n, file);
+}
 //Show ADC status
 void showADCStatus(){
+	static Dash S;
+	static char frame[DASH_TEXT];
 	bool showDAC = false;
 	char input[5];
 	char in, key;
+	struct timespec ts;
+	int64_t next;
+	size_t len;
+	FILE* f;
 	/* Ask user whether to show DAC configuration to
 	supervise real-time changes on DAC  */
 	printf("\nDo you want to show DAC config? (Y/N): ");
@@ -409,62 +1611,82 @@ void showADCStatus(){
 	else if (!(input[0] == 'n' || input[0] == 'N')) {
 		printf("Invalid choice. DAC config will not show.\n");
 	}
-	// While to show ADC settings (optional: DAC settings)
+	/* Redraw at uiHz until a key is pressed: each frame is rendered in
+	memory and only its changes are written (see dashFrame) */
+	fflush(stdout);
+	dashStart(&S, STDOUT_FILENO);
+	next = monoNow();
 	while (1){
 		/* Break loop if any key is pressed (tcischars detects number
 		of characters waiting to be read from the therminal    */
         if(tcischars(1)>0){
             fflush(stdin);
-            printf("\f");
             break;
         }
-		delay(1000);
 		/* Get user's confirmation character and return to
 		MainUI if CTRL+C is pressed  */
         if(toReturn){
+            dashStop(&S);
             getInput(&input[0]);
             return;
    		}
-   		if(ADC_Refresh){
-			// Switches input and descriptions
-			printf("\f%*s\nDescriptions\n", 50, "Digital input");
-			printf("Bit 3     --> 0 = Keyboard control only ");
-			printf("1 = Keyboard and peripheral inputs\n");
-			printf("Bit 2     --> P0/ADC0 changes:  0 = mean  1 = amplitude\n");
-			printf("%*s", 14, "Bit 1 & 0 --> ");
-			printf("%-*s\n", 26, "0x00 - DAC0 is off");
-			printf("%*s%-*s\n", 14, "", 40, "0x01 - Sine wave");
-			printf("%*s%-*s\n", 14, "", 40, "0x02 - Triangular wave");
-			printf("%*s%-*s\n", 14, "", 40, "0x03 - Square wave");
-			printf("\nPort A Bit\t\t3\t\t2\t\t1\t\t0\n");
-			printf("\t\t\t%1d", (digital_in&0x08) >> 3);
-			printf("\t\t%1d", (digital_in&0x04)>> 2);
-			printf("\t\t%1d", (digital_in&0x02) >> 1);
-			printf("\t\t%1d\n", (digital_in&0x01));
-			// ADC input
-			printf("\n\n%*s\n", 38, "ADC Value (16 bit - Hex)");
-			printf("%*s\t\t%04X\n", 10, "ADC0 ", adc_in[0]);
-			printf("%*s\t\t%04X\n", 10, "ADC1 ", adc_in[1]);
-			// DAC settings
-			if (showDAC){
-				printf("\n\n\n");
-				showDACConfig();
-			}
-			printf("Press any key to quit the function\n");
-			ADC_Refresh = false;
+        if((f = fmemopen(frame, sizeof(frame), "w")) != NULL){
+            showStatus(f, showDAC);
+            len = ftell(f);
+            fclose(f);
+            dashFrame(&S, frame, len);
         }
+		// Next frame time, from now if this one was late
+        next += (int64_t)(1e9/uiHz);
+        if(next < monoNow())
+            next = monoNow();
+        ts.tv_sec = next/1000000000;
+        ts.tv_nsec = next%1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !toReturn);
 	}
+	dashStop(&S);
+	printf("\f");
+}
+//One frame of the ADC status screen (switches, ADC and optionally DAC settings)
+void showStatus(FILE* out, bool showDAC){
+	// Switches input and descriptions
+	fprintf(out, "%*s\nDescriptions\n", 50, "Digital input");
+	fprintf(out, "Bit 3     --> 0 = Keyboard control only ");
+	fprintf(out, "1 = Keyboard and peripheral inputs\n");
+	fprintf(out, "Bit 2     --> P0/ADC0 changes:  0 = mean  1 = amplitude\n");
+	fprintf(out, "%*s", 14, "Bit 1 & 0 --> ");
+	fprintf(out, "%-*s\n", 26, "0x00 - DAC0 is off");
+	fprintf(out, "%*s%-*s\n", 14, "", 40, "0x01 - Sine wave");
+	fprintf(out, "%*s%-*s\n", 14, "", 40, "0x02 - Triangular wave");
+	fprintf(out, "%*s%-*s\n", 14, "", 40, "0x03 - Square wave");
+	// Tab stops of the old screen as spaces, so that columns are bytes
+	fprintf(out, "\n%-24s%-16d%-16d%-16d%d\n", "Port A Bit", 3, 2, 1, 0);
+	fprintf(out, "%24s%-16d", "", (int)(digital_in&0x08) >> 3);
+	fprintf(out, "%-16d", (int)(digital_in&0x04) >> 2);
+	fprintf(out, "%-16d", (int)(digital_in&0x02) >> 1);
+	fprintf(out, "%d\n", (int)(digital_in&0x01));
+	// ADC input
+	fprintf(out, "\n\n%*s\n", 38, "ADC Value (16 bit - Hex)");
+	fprintf(out, "%*s%*s%04X\n", 10, "ADC0 ", 6, "", adc_in[0]);
+	fprintf(out, "%*s%*s%04X\n", 10, "ADC1 ", 6, "", adc_in[1]);
+	// DAC settings
+	if (showDAC){
+		fprintf(out, "\n\n\n");
+		showDACConfig(out);
+	}
+	fprintf(out, "Press any key to quit the function\n");
 }
 //Import the configuration from .txt file
 void importConfig(){
-	int i=0;
-	int j=1;
-	bool isNull=false;
+	size_t i, len=0, size=0;
+	int j=0, count=0;
+	int ch;
+	bool isNull=true;
 	FILE* fd;
 	char filename[30];
-	const char source[10]="imported";
-	char input100[100]={'\0'};
-	char *input[12];
+	char source[]="imported";
+	char *text=NULL, *grown;
+	char **input=NULL, **more;
 	printf("Warning: Please turn off peripheral control before importing!\n");
     printf("Please enter filename (\".txt\" is added at the end): ");
     getInput(&filename[0]);
@@ -472,29 +1694,53 @@ void importConfig(){
         return;
     strcat(filename, ".txt");
 	// Open file to read, return if fails
-    fd = fopen(filename,"r+");
+    fd = fopen(filename,"r");
     if(fd == NULL){
         printf("Failed to open %s.\n", filename);
         return;
     }
-	/* Read the file character by character
-	If " " or "\n" is found, replace it by EOF.
-	Input the address of first character of each word
-	to char pointer array    */
-    input[0]=(char *)&source;
-    input[j]=&input100[0];
-    while(1){
-        if(isNull){
-            input[++j]=&input100[i];
-            isNull=false;
+	/* Read the file character by character into a buffer that grows
+	with it, so that no line is too long (--awg paths, --sweep ...).
+	If " " or "\n" is found, replace it by '\0' */
+    text = malloc(size = 256);
+    input = malloc((count = 32)*sizeof(char*));
+    while(text != NULL && (ch = fgetc(fd)) != EOF){
+        if(len+1 == size){
+            if((grown = realloc(text, size *= 2)) == NULL){
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
         }
-        if(fscanf(fd, "%c", &input100[i])==EOF)
-            break;
-        if(input100[i]=='\n' || input100[i]==' '){
-            input100[i]='\0';
-            isNull=true;
+        text[len++] = (ch==' ' || ch=='\n' || ch=='\t' || ch=='\r') ? '\0' : (char)ch;
+    }
+    fclose(fd);
+	/* Input the address of the first character of each word to a char
+	pointer array, grown as needed: input[0] = "imported" */
+    if(text != NULL)
+        text[len] = '\0';
+    if(input != NULL)
+        input[0] = source;
+    for(i=0;text != NULL && input != NULL && i<len;i++){
+        if(isNull && text[i] != '\0'){
+            if(j+1 == count){
+                if((more = realloc(input, (count *= 2)*sizeof(char*))) == NULL){
+                    free(input);
+                    input = NULL;
+                    break;
+                }
+                input = more;
+            }
+            input[++j] = &text[i];
         }
-        i++;
+        isNull = (text[i] == '\0');
+    }
+    if(text == NULL || input == NULL){
+        printf("Not enough memory to import %s.\n", filename);
+        free(input);
+        free(text);
+        return;
     }
 	/* Use CLManager to read imported settings
 
@@ -504,11 +1750,11 @@ void importConfig(){
 	Use of mutex when changing shared global variables
 	*/
     pthread_mutex_lock(&MainMutex);
-    CLManager(j, (char**) &input);
+    CLManager(j+1, input);
+    waitWaveAck(waveRequest);
     pthread_mutex_unlock(&MainMutex);
-	// Close file and print confirmation message
-    fflush(fd);
-    fclose(fd);
+    free(input);
+    free(text);
     printf("\nConfiguration from %s is loaded.\n", filename);
     sleep(1);
     return;
@@ -519,6 +1765,7 @@ void exportConfig(){
 	bool printConfig =false, printData = false;
 	char filename[30];
 	int i;
+	WaveParams P;
     printf("Please enter filename (\".txt\" is added at the end): ");
     getInput(&filename[0]);
     if(toReturn)  return;
@@ -546,21 +1793,47 @@ void exportConfig(){
     }
     // Printing configuration only
     if(printConfig){
+        loadParams(&DAC, &P);
         // Print setting in command line format
-        switch(DAC.waveform_type){
+        switch(P.waveform_type){
             case 1:{fprintf(fd, "%s ", "-sin"); break;}
             case 2:{fprintf(fd, "%s ", "-tri"); break;}
             case 3:{fprintf(fd, "%s ", "-squ"); break;}
+            case 4:{fprintf(fd, "%s ", "-awg"); break;}
         }
         fprintf(fd, "%.2f %.2f %.2f %d\n",
-                DAC.freq, DAC.mean, DAC.amp, DAC.isOn);
+                P.freq, P.mean, P.amp, P.isOn);
+        // Arbitrary waveform file as options
+        if(P.waveform_type == 4)
+            fprintf(fd, "--awg %s --awg-rate %.2f\n", awg.name, awg.rate);
+        // Burst, playlist, modulation and frequency sweep as options
+        if(burst.cycles)
+            fprintf(fd, "--burst %d --trigger %d %s\n", burst.cycles, burst.bit,
+                    burst.falling ? "falling" : "rising");
+        if(seqPublished != NULL && seqPublished->count)
+            fprintf(fd, "--playlist %s\n", seqPublished->name);
+        if(mod.mode != MOD_NONE)
+            fprintf(fd, "--mod %s %s %.2f %.3f\n", mod.mode == MOD_AM ? "am" : mod.mode == MOD_FM ? "fm" : "pm",
+                    mod.type == 1 ? "-sin" : mod.type == 2 ? "-tri" : "-squ", mod.freq, mod.depth);
+        if(sweep.on)
+            fprintf(fd, "--sweep %.2f %.2f %.3f%s --dwell %.3f --repeat %d\n", sweep.start,
+                    sweep.stop, sweep.seconds, sweep.log ? " --sweep-log" : "", sweep.dwell, sweep.repeat);
+        // Second channel and phase offset as options
+        if(useDual){
+            loadParams(&DAC1, &P);
+            fprintf(fd, "--dual --phase %.2f --dac1 %s %.2f %.2f %.2f %d\n", phaseDeg,
+                    P.waveform_type==1 ? "-sin" : P.waveform_type==2 ? "-tri"
+                    : P.waveform_type==4 ? "-awg" : "-squ", P.freq, P.mean, P.amp, P.isOn);
+        }
     }
-    // Printing waveform data only
+    // Printing waveform data only (data array is written by WaveGenManager)
     if(printData){
         fprintf(fd, "\n Data number\t\tDAC value(Hex)\t\tReal value(V)\n\n");
+        pthread_mutex_lock(&MainMutex);
         for(i=0;i<DAC.samples_per_period;i++)
             fprintf(fd, "\t%d\t\t%04x\t\t\t%.4f\n", i+1, DAC.data[i],
                 (DAC.data[i]-(int)(DAC.DAC_mode < 2 ? 0x7FFF : 0))*(DAC.output_res/1000000));
+        pthread_mutex_unlock(&MainMutex);
     }
 	// Close file and print confirmation message
 	fflush(fd);
@@ -601,42 +1874,62 @@ int checkValidInt(){
         return temp;
     return -1;
 }
-//Change the parameters of the DAC0
+//Change the parameters of the DAC0 (or DAC1 in dual mode)
 void changeParam(){
     ChangeField CField;
+    DACField* D=&DAC;
     bool isRepeat=false;
     bool hasChanged = false;
     char repeatchar;
     char input[5];
+    char filename[256];
     int select1=0;
     int select2=0;
-    float temp;
+    int ch=0;
+    int mtype;
+    float temp, depth;
     do{
+		// Select the channel to edit in dual mode
+        if(useDual){
+            printf("\nSelect DAC channel (0/1): ");
+            if((ch=checkValidInt())!=0 && ch!=1){
+                if(toReturn) return;
+                printf("Invalid channel. Editing DAC[0].\n");
+                ch=0;
+            }
+            D=Channel[ch];
+        }
 		// Load CField with current DAC values
-        setChangeField(&CField);
+        loadChangeField(D, &CField);
 		// Display options
         printf("\nCurrent OFF/ON (0/1) status: %d\n", CField.isOn);
         printf("Select option:\n");
-        printf("1 - Change the waveform type of DAC[0]\n");
-        printf("2 - Change the frequency of DAC[0]\n");
-        printf("3 - Change the mean of DAC[0]\n");
-        printf("4 - Change the amplitude of DAC[0]\n");
-        printf("5 - Change the OFF/ON (0/1) status of DAC[0]\n");
+        printf("1 - Change the waveform type of DAC[%d]\n", ch);
+        printf("2 - Change the frequency of DAC[%d]\n", ch);
+        printf("3 - Change the mean of DAC[%d]\n", ch);
+        printf("4 - Change the amplitude of DAC[%d]\n", ch);
+        printf("5 - Change the OFF/ON (0/1) status of DAC[%d]\n", ch);
         printf("6 - Reset the settings to default\n");
+        if(useDual)
+            printf("7 - Change the phase offset of DAC[1]\n");
+        if(useDDS && ch == 0)
+            printf("8 - Change the modulation of DAC[0]\n");
         printf("Enter option: ");
 		// Integer validity check
         if((select1=checkValidInt())>=0){
             switch (select1){
 				// Option 1: change waveform
                 case 1: {
-                    printf("\nChanging waveform type of DAC[0]\n");
+                    printf("\nChanging waveform type of DAC[%d]\n", ch);
                     printf("Enter 1 for sinusoidal waveform\n");
                     printf("Enter 2 for triangular waveform\n");
                     printf("Enter 3 for square waveform\n");
-                    switch(DAC.waveform_type){
+                    printf("Enter 4 for arbitrary waveform (file)\n");
+                    switch(CField.waveform_type){
 						case 1: printf("Current waveform (V): sinusoidal\n"); break;
 						case 2: printf("Current waveform (V): triangular\n"); break;
 						case 3: printf("Current waveform (V): square\n"); break;
+						case 4: printf("Current waveform (V): arbitrary, %s\n", awg.name); break;
                     }
                     printf("Enter option: ");
 					// Integer validity check
@@ -645,7 +1938,21 @@ void changeParam(){
                         if(select2>0 && select2<4){
                         	hasChanged = true;
                             CField.waveform_type=select2;
-                            printf("\nChanged waveform type of DAC[0]\n");
+                            printf("\nChanged waveform type of DAC[%d]\n", ch);
+                        }
+                        else if(select2==4){
+                            printf("Enter file name (CSV, capture or 32-bit float): ");
+                            getInput(&filename[0]);
+                            if(toReturn) return;
+							// The file is read by WaveGenManager under MainMutex
+                            pthread_mutex_lock(&MainMutex);
+                            if(awgLoad(filename, 0)){
+                                hasChanged = true;
+                                CField.waveform_type=4;
+                                awgDefault(&CField);
+                                printf("\nChanged waveform type of DAC[%d]\n", ch);
+                            }
+                            pthread_mutex_unlock(&MainMutex);
                         }
                         else
                             printf("Invalid waveform selection.\n");
@@ -657,15 +1964,15 @@ void changeParam(){
                     }
 				// Option 2: change frequency
                 case 2: {
-                    printf("\nChanging frequency (float) of DAC[0]\n");
-                    printf("Frequency must be in the range (0,%d) Hz\n", HIGHESTFREQ);
-                    printf("Current frequency (Hz): %.2f\n", DAC.freq);
+                    printf("\nChanging frequency (float) of DAC[%d]\n", ch);
+                    printf("Frequency must be in the range (0,%.0f) Hz\n", maxFreq());
+                    printf("Current frequency (Hz): %.2f\n", CField.freq);
                     printf("Enter frequency (Hz): ");
 					// Range checking
-                    if((temp=checkValidFloat())>0 && temp < HIGHESTFREQ){
+                    if((temp=checkValidFloat())>0 && temp < maxFreq()){
                             hasChanged = true;
                             CField.freq=temp;
-                            printf("\nChanged freq of DAC[0]\n");
+                            printf("\nChanged freq of DAC[%d]\n", ch);
                     }
                     else{
                     	if(toReturn) return;
@@ -675,17 +1982,17 @@ void changeParam(){
                     }
 				// Option 3: change mean
                 case 3: {
-                    printf("\nChanging mean (float) of DAC[0]\n");
+                    printf("\nChanging mean (float) of DAC[%d]\n", ch);
                     printf("Mean value must be in the range (%.2f,%.2f)\n",
                            -(10-CField.amp), 10-CField.amp);
-                    printf("Current mean (V): %.2f\n", DAC.mean);
+                    printf("Current mean (V): %.2f\n", CField.mean);
                     printf("Enter mean (V): ");
                     if((temp=checkValidFloat())>= -10)
 						// Range checking
                         if(checkAbsMax(temp, CField.amp)!=0){
                             hasChanged = true;
                             CField.mean=temp;
-                            printf("\nChanged mean of DAC[0]\n");
+                            printf("\nChanged mean of DAC[%d]\n", ch);
                         }
                         else{
                         	if(toReturn) return;
@@ -695,17 +2002,17 @@ void changeParam(){
                     }
 				// Option 4: change amplitude
                 case 4: {
-                    printf("\nChanging amplitude (float) of DAC[0]\n");
+                    printf("\nChanging amplitude (float) of DAC[%d]\n", ch);
                     printf("Amplitude value must be in the range (0,%.2f)\n"
                            , 10-CField.mean);
-                    printf("Current amplitude (V): %.2f\n", DAC.amp);
+                    printf("Current amplitude (V): %.2f\n", CField.amp);
                     printf("Enter amplitude (V): ");
                     if((temp=checkValidFloat())>= 0)
 						// Range checking
                         if(checkAbsMax(temp, CField.amp)!=0){
                             hasChanged = true;
                             CField.amp=temp;
-                            printf("\nChanged amplitude of DAC[0]\n");
+                            printf("\nChanged amplitude of DAC[%d]\n", ch);
                         }
                         else{
                         	if(toReturn) return;
@@ -715,14 +2022,14 @@ void changeParam(){
                     }
 				// Option 5: change isOn flag
                 case 5: {
-                    printf("\nChanging OFF/ON (0/1) state of the DAC[0]\n");
+                    printf("\nChanging OFF/ON (0/1) state of the DAC[%d]\n", ch);
                     printf("DAC is currently:");
-                    DAC.isOn ? printf("On\n") : printf("Off\n");
+                    CField.isOn ? printf("On\n") : printf("Off\n");
                     printf("Enter option (0/1): ");
                     if((select2=checkValidInt())>=0)
                         if(select2==0)
                             if (CField.isOn==false)
-                                printf("DAC[0] is already off.\n");
+                                printf("DAC[%d] is already off.\n", ch);
                             else
  {
                                 hasChanged = true;
@@ -735,7 +2042,7 @@ void changeParam(){
                                 CField.isOn=true;
                             }
                             else
-                                printf("DAC[0] is already on.\n");
+                                printf("DAC[%d] is already on.\n", ch);
                     else{
                         if(toReturn) return;
                         printf("Invalid options for OFF/ON.\n");
@@ -753,6 +2060,60 @@ void changeParam(){
                     CField.amp=1;
                     CField.isOn=false;
                     break;
+                }
+				// Option 7: change phase offset between channels (dual mode)
+                case 7: {
+                    if(!useDual){
+                        printf("\nInvalid choice.\n");
+                        break;
+                    }
+                    printf("\nChanging phase offset (float) of DAC[1]\n");
+                    printf("Phase offset must be in the range [0,360) degrees\n");
+                    printf("Current phase offset (deg): %.2f\n", phaseDeg);
+                    printf("Enter phase offset (deg): ");
+                    if((temp=checkValidFloat())>=0 && temp<360){
+                        setPhase(temp);
+                        printf("\nChanged phase offset of DAC[1]\n");
+                    }
+                    else{
+                        if(toReturn) return;
+                        printf("Phase offset is not changed.\n");
+                    }
+                    break;
+                }
+				// Option 8: modulation of DAC0 (DDS mode), applied by the output thread
+                case 8: {
+                    if(!useDDS || ch != 0){
+                        printf("\nInvalid choice.\n");
+                        break;
+                    }
+                    printf("\nChanging modulation of DAC[0]\n");
+                    printf("Enter 0 for none, 1 for AM, 2 for FM, 3 for PM: ");
+                    if((select2=checkValidInt())<0 || select2>3){
+                        if(toReturn) return;
+                        printf("Invalid modulation.\n");
+                        break;
+                    }
+                    if(select2==MOD_NONE){
+                        modSet(MOD_NONE, 0, 0, 0);
+                        printf("\nModulation of DAC[0] is off\n");
+                        break;
+                    }
+                    printf("Modulating waveform (1 sinusoidal, 2 triangular, 3 square): ");
+                    mtype = checkValidInt();
+                    if(toReturn) return;
+                    printf("Modulating frequency (Hz), in (0,%.0f): ", maxFreq());
+                    temp = checkValidFloat();
+                    if(toReturn) return;
+                    printf("%s: ", select2==MOD_AM ? "AM depth, in [0,1]" : select2==MOD_FM
+                           ? "FM deviation (Hz)" : "PM deviation (deg), in (0,180]");
+                    depth = checkValidFloat();
+                    if(toReturn) return;
+                    pthread_mutex_lock(&MainMutex);
+                    if(modSet(select2, mtype, temp, depth))
+                        printf("\nChanged modulation of DAC[0]\n");
+                    pthread_mutex_unlock(&MainMutex);
+                    break;
                 }
                 default: {
                 	if(toReturn) return;
@@ -763,14 +2124,15 @@ void changeParam(){
         	if(hasChanged){
             	if(select1<7 && select1>0){
                 	pthread_mutex_lock(&MainMutex);
-                	change(CField.isOn, CField.waveform_type,
+                	changeChannel(D, CField.isOn, CField.waveform_type,
                 	CField.freq, CField.mean, CField.amp);
+             		// Wait for WaveGenManger to finish
+                	if(!waitWaveAck(waveRequest))
+                		printf("Waveform manager did not respond.\n");
                 	pthread_mutex_unlock(&MainMutex);
 					// Reset hasChanged flag
                 	hasChanged = false;
             	}
-             	// Wait for WaveGenManger to finish
-       			delay(50);
         	}
         }
         if(toReturn) return;
@@ -795,12 +2157,16 @@ void stopOps(){
 	// Use of mutex when changing shared global variables
     pthread_mutex_lock(&MainMutex);
     DAC.isOn=false;
+    DAC1.isOn=false;
+    storeParams(&DAC);
+    storeParams(&DAC1);
   	pthread_mutex_unlock(&MainMutex);
     return;
 }
 //The general purpose thread for inputting from keyboard
 void* MainUI (void *pointer){
     char input[10];
+    rtDemote();
     sleep(1);  // Wait for WaveGenManager to finish its configuration
     while (1) {
 		// Exit thread if isOperating is false
@@ -818,7 +2184,7 @@ void* MainUI (void *pointer){
        	printf("\f");
 		switch (checkInput(&input[0])) {
 		    // case 1 - print current devices' configurations.
-			case 1: {   showDACConfig(); break; }
+			case 1: {   showDACConfig(stdout); break; }
             // case 2 - print current devices' statuses.
 			case 2: {   showADCStatus();       break; }
 			// case 3 - change the configurations.
@@ -830,7 +2196,9 @@ void* MainUI (void *pointer){
 			// case 6 - halt all operations.
 			case 6: {   stopOps(); break; }
             // case 7 -  quit the program
-			case 7: {  isOperating = false; break; }
+			case 7: {  stopProgram(); break; }
+			// case 8 - show the output timing histogram
+			case 8: {   showTiming(); break; }
 			//show error in input
 			default:{   printf("Invalid character. Please reenter. \n");}
 		}
@@ -842,7 +2210,7 @@ void* MainUI (void *pointer){
 void checkQuit(char ch){
     ctrlc_pressed=false;
     if (ch == 'y' || ch== 'Y'){
-        isOperating=false;
+        stopProgram();
     }
     else printf("\f");
     return;
@@ -873,430 +2241,6551 @@ void  INThandler(int sig){
 
 // Manages arguments
 void CLManager (int argc, char **argv){
-    int counter, temp2;
-    float temp;
-    ChangeField CField;
+    int counter, npos=1, ndac1=0;
     char* endptr;
-	// Load CField with default DAC values
-    setChangeField(&CField);
-	// Argument checking (from argv[1])
+    const BoardOps* newBoard;
+    char* awg_file = NULL;
+    float awg_rate = 0;
+    ChangeField CField;
+    SweepConfig sw = sweep;
+    bool sweep_set = false;
+    int mod_mode = -1, mod_type = 0;
+    char* seq_file = NULL;
+    float mod_freq = 0, mod_depth = 0;
+    char* positional[argc+1];
+    char* dac1_args[6];
+	/* Named options (starting with "--") are taken out first so that
+	the range checking below uses the selected output mode. The rest
+	are kept in order as positional arguments */
+    positional[0]=argv[0];
     for(counter=1;counter<argc;counter++){
-		// Check argv[1] - waveform type
-        if((counter%5) ==1){
-            if(strcmp(argv[counter],"-sin") == 0)
-                CField.waveform_type=1;
-            else if(strcmp(argv[counter],"-tri") == 0)
-                CField.waveform_type=2;
-            else if(strcmp(argv[counter],"-squ") == 0)
-                CField.waveform_type=3;
-            else
-                printf("Invalid waveform.\n");
+        if(strcmp(argv[counter],"--pacer") == 0){
+            if(!usePacer && atStartup(argv[counter]))
+                usePacer = true;
         }
-		// Check argv[2] to argc[4]
-        else  if ((counter%5) !=0){
-			// Convert string to double
-            temp = strtod(argv[counter], &endptr);
-			// Continue if valid
-            if(*endptr == '\0'){
-				/* Check argv[2] - freq, argv[3] - mean
-				and argv[4] - amplitude */
-                switch(counter%5){
-                    case 2: {
-						// Range checking for all parameters
-                        if(temp>0 && temp <HIGHESTFREQ)
-                            CField.freq = temp;
-                        else
-                            printf("Frequency must be in the range (0, %d) Hz\n", HIGHESTFREQ);
-                        break;
-                    }
-                    case 3: {
-                        if(checkAbsMax(temp, CField.amp)!=0)
-                            CField.mean = temp;
-                        else
-                            printf("Error: Out of range mean value: %.2f V\n", temp);
-                        break;
-                    }
-                    case 4: {
-                        if(checkAbsMax(CField.amp, temp)!=0)
-                            CField.amp = temp;
-                        else
-                            printf("Error: Out of range amplitude value: %.2f V\n", temp);
-                        break;
-                    }
-                }
+        else if(strcmp(argv[counter],"--dds") == 0){
+            if(!useDDS && atStartup(argv[counter]))
+                useDDS = true;
+        }
+        else if(strcmp(argv[counter],"--dual") == 0){
+            if(!useDual && atStartup(argv[counter]))
+                useDual = true;
+        }
+        else if(strcmp(argv[counter],"--phase") == 0 && counter+1<argc){
+            setPhase(strtod(argv[++counter], &endptr));
+            if(*endptr != '\0' || phaseDeg < 0 || phaseDeg >= 360){
+                printf("Phase offset must be in the range [0, 360) degrees\n");
+                setPhase(0);
             }
-            else
-				// Show invalid input (not double), if any
-                printf("Invalid input #%d: %s\n", counter, argv[counter]);
         }
-		// Check argv[5] - isOn status
-        else {
-            temp2 = strtol(argv[counter], &endptr, 2);
-            if(temp2==1)
-                change(true, CField.waveform_type, CField.freq, CField.mean, CField.amp);
-            else
-                change(false, CField.waveform_type, CField.freq, CField.mean, CField.amp);
+        else if(strcmp(argv[counter],"--dac1") == 0 && counter+5<argc){
+            // DAC1 takes the same 5 arguments as DAC0
+            dac1_args[0]=argv[0];
+            for(ndac1=1;ndac1<6;ndac1++)
+                dac1_args[ndac1]=argv[++counter];
         }
-    }
-	// CLManager ending message
+        else if(strcmp(argv[counter],"--sweep") == 0 && counter+1<argc && strcmp(argv[counter+1],"off") == 0){
+            sw.on = false;
+            sweep_set = true;
+            counter++;
+        }
+        else if(strcmp(argv[counter],"--sweep") == 0 && counter+3<argc){
+            sw.start = strtod(argv[++counter], &endptr);
+            sw.stop = strtod(argv[++counter], &endptr);
+            sw.seconds = strtod(argv[++counter], &endptr);
+            sw.on = sweep_set = true;
+        }
+        else if(strcmp(argv[counter],"--mod") == 0 && counter+1<argc && strcmp(argv[counter+1],"off") == 0){
+            mod_mode = MOD_NONE;
+            counter++;
+        }
+        else if(strcmp(argv[counter],"--mod") == 0 && counter+4<argc){
+            counter++;
+            mod_mode = strcmp(argv[counter],"am") == 0 ? MOD_AM : strcmp(argv[counter],"fm") == 0 ? MOD_FM
+                : strcmp(argv[counter],"pm") == 0 ? MOD_PM : -1;
+            if(mod_mode < 0)
+                printf("Modulation must be am, fm, pm or off\n");
+            counter++;
+            mod_type = strcmp(argv[counter],"-sin") == 0 ? 1 : strcmp(argv[counter],"-tri") == 0 ? 2
+                : strcmp(argv[counter],"-squ") == 0 ? 3 : 0;
+            mod_freq = strtod(argv[++counter], &endptr);
+            mod_depth = strtod(argv[++counter], &endptr);
+        }
+        else if(strcmp(argv[counter],"--playlist") == 0 && counter+1<argc)
+            seq_file = argv[++counter];
+        else if(strcmp(argv[counter],"--board") == 0 && counter+1<argc){
+            counter++;
+            newBoard = NULL;
+            if(strcmp(argv[counter],"sim") == 0)
+                newBoard = &boardSim;
+#ifdef __QNX__
+            else if(strcmp(argv[counter],"pci") == 0)
+                newBoard = &boardPCI;
+#endif
+            if(newBoard == NULL)
+                printf("Board must be %s\n", BOARD_NAMES);
+            else if(newBoard != (sinking ? sinkBoard : board) && atStartup("--board"))
+                board = newBoard;
+        }
+        else if(strcmp(argv[counter],"--sim-record") == 0 && counter+1<argc)
+            startupArg(&simRecordFile, argv, &counter);
+        else if(strcmp(argv[counter],"--sim-script") == 0 && counter+1<argc)
+            startupArg(&simScriptFile, argv, &counter);
+        else if(strcmp(argv[counter],"--sink") == 0 && counter+1<argc)
+            startupArg(&sinkFile, argv, &counter);
+        else if(strcmp(argv[counter],"--sink-rate") == 0 && counter+1<argc){
+            sinkRate = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || sinkRate < 1 || sinkRate > PACER_CLOCK){
+                printf("--sink-rate must be between 1 and %d S/s\n", PACER_CLOCK);
+                sinkRate = SINK_RATE;
+            }
+        }
+        else if(strcmp(argv[counter],"--burst") == 0 && counter+1<argc){
+            burst.cycles = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || burst.cycles < 0){
+                printf("--burst must be a number of periods (0 = continuous output)\n");
+                burst.cycles = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--trigger") == 0 && counter+2<argc){
+            burst.bit = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || burst.bit < 0 || burst.bit > 7){
+                printf("Trigger bit must be in the range [0, 7]\n");
+                burst.bit = BURST_BIT;
+            }
+            counter++;
+            if(strcmp(argv[counter],"rising") == 0 || strcmp(argv[counter],"falling") == 0)
+                burst.falling = strcmp(argv[counter],"falling") == 0;
+            else
+                printf("Trigger edge must be rising or falling\n");
+        }
+        else if(strcmp(argv[counter],"--sweep-log") == 0)
+            sw.log = true;
+        else if(strcmp(argv[counter],"--dwell") == 0 && counter+1<argc){
+            sw.dwell = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || sw.dwell < 0){
+                printf("--dwell must be a time in seconds\n");
+                sw.dwell = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--repeat") == 0 && counter+1<argc){
+            sw.repeat = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || sw.repeat < 0){
+                printf("--repeat must be a number of sweeps (0 = until stopped)\n");
+                sw.repeat = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--bench") == 0 && counter+1<argc)
+            startupArg(&benchName, argv, &counter);
+        else if(strcmp(argv[counter],"--capture") == 0 && counter+1<argc)
+            startupArg(&captureFile, argv, &counter);
+        else if(strcmp(argv[counter],"--rate") == 0 && counter+1<argc)
+            captureRate = strtod(argv[++counter], &endptr);
+        else if(strcmp(argv[counter],"--chans") == 0 && counter+1<argc)
+            captureChans = strtol(argv[++counter], &endptr, 10);
+        else if(strcmp(argv[counter],"--seconds") == 0 && counter+1<argc)
+            captureSeconds = strtod(argv[++counter], &endptr);
+        else if(strcmp(argv[counter],"--calibrate") == 0)
+            forceCalib = true;
+        else if(strcmp(argv[counter],"--calib-file") == 0 && counter+1<argc)
+            startupArg(&calibFile, argv, &counter);
+        else if(strcmp(argv[counter],"--awg") == 0 && counter+1<argc)
+            awg_file = argv[++counter];
+        else if(strcmp(argv[counter],"--awg-rate") == 0 && counter+1<argc){
+            awg_rate = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || awg_rate <= 0){
+                printf("--awg-rate must be a positive sample rate\n");
+                awg_rate = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--stream") == 0 && counter+1<argc)
+            startupArg(&streamFile, argv, &counter);
+        else if(strcmp(argv[counter],"--stream-rate") == 0 && counter+1<argc){
+            streamRate = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || streamRate <= 0){
+                printf("--stream-rate must be a positive sample rate\n");
+                streamRate = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--prefetch") == 0 && counter+1<argc){
+            streamDepth = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || streamDepth < 2 || streamDepth > STREAM_MAX_DEPTH){
+                printf("--prefetch must be in the range [2, %d] blocks\n", STREAM_MAX_DEPTH);
+                streamDepth = STREAM_DEPTH;
+            }
+        }
+        else if(strcmp(argv[counter],"--rt") == 0 && counter+1<argc){
+            rtPrio = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || rtPrio < sched_get_priority_min(SCHED_FIFO)
+                    || rtPrio > sched_get_priority_max(SCHED_FIFO)){
+                printf("--rt priority must be in the range [%d, %d]\n",
+                    sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+                rtPrio = 0;
+            }
+        }
+        else if(strcmp(argv[counter],"--ctrl") == 0)
+            useCtrl = true;
+        else if(strcmp(argv[counter],"--ctrl-path") == 0 && counter+1<argc)
+            startupArg(&ctrlPath, argv, &counter);
+        else if(strcmp(argv[counter],"--send") == 0 && counter+2<argc){
+            sendChannel = strtol(argv[++counter], &endptr, 10);
+            sendOp = strdup(argv[++counter]);
+			// A status query needs no value
+            if(counter+1<argc && strncmp(argv[counter+1],"--",2) != 0)
+                sendValue = strtod(argv[++counter], &endptr);
+        }
+        else if(strcmp(argv[counter],"--status") == 0)
+            useStatus = true;
+        else if(strcmp(argv[counter],"--status-name") == 0 && counter+1<argc)
+            startupArg(&statusShm, argv, &counter);
+        else if(strcmp(argv[counter],"--monitor") == 0 && counter+1<argc){
+            monitorSeconds = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || monitorSeconds < 0){
+                printf("--monitor takes a number of seconds (0 until CTRL+C)\n");
+                monitorSeconds = -1;
+            }
+        }
+        else if(strcmp(argv[counter],"--ui-hz") == 0 && counter+1<argc){
+            uiHz = strtod(argv[++counter], &endptr);
+            if(*endptr != '\0' || uiHz < 1 || uiHz > 1000){
+                printf("--ui-hz must be in the range [1, 1000]\n");
+                uiHz = UI_HZ;
+            }
+        }
+        else if(strcmp(argv[counter],"--cpu") == 0 && counter+1<argc){
+            rtCPU = strtol(argv[++counter], &endptr, 10);
+            if(*endptr != '\0' || rtCPU < 0 || rtCPU > 31){
+                printf("--cpu must be in the range [0, 31]\n");
+                rtCPU = -1;
+            }
+        }
+        else if(strncmp(argv[counter],"--",2) == 0)
+            printf("Unknown option: %s\n", argv[counter]);
+        else
+            positional[npos++]=argv[counter];
+    }
+	// Both channels share one software-timed DDS loop
+    if(useDual){
+        useDDS = true;
+        if(usePacer){
+            printf("--pacer is ignored with --dual.\n");
+            usePacer = false;
+        }
+    }
+    else if(ndac1)
+        printf("--dac1 needs --dual. DAC1 settings are ignored.\n");
+	/* The sweep, modulation and playlist run in the DDS loop of DAC0.
+	A running output thread keeps the loop it started with, so an
+	imported file can only use them if that is the DDS loop */
+    if(sweep_set && sw.on && useDual)
+        printf("--sweep is ignored with --dual.\n");
+    else if(sweep_set && sw.on && startedUp && !useDDS)
+        printf("--sweep needs --dds at start-up. It is ignored.\n");
+    else if(sweep_set && sw.on){
+        useDDS = true;
+        if(sw.start <= 0 || sw.start >= maxFreq() || sw.stop <= 0 || sw.stop >= maxFreq())
+            printf("Sweep frequencies must be in the range (0, %.0f) Hz\n", maxFreq());
+        else if(sw.seconds <= 0)
+            printf("Sweep time must be positive\n");
+        else{
+			// Settings before the new generation the output thread checks
+            sweep = sw;
+            __sync_synchronize();
+            sweep.gen = sw.gen + 1;
+        }
+    }
+    else if(sweep_set)
+        sweep.on = false;
+    if(mod_mode > MOD_NONE && useDual)
+        printf("--mod is ignored with --dual.\n");
+    else if(mod_mode > MOD_NONE && startedUp && !useDDS)
+        printf("--mod needs --dds at start-up. It is ignored.\n");
+    else if(mod_mode > MOD_NONE){
+        useDDS = true;
+        modSet(mod_mode, mod_type, mod_freq, mod_depth);
+    }
+    else if(mod_mode == MOD_NONE)
+        modSet(MOD_NONE, 0, 0, 0);
+	// Playlist segments are DDS tables of DAC0, DAC0 is turned on to play them
+    if(seq_file != NULL && strcmp(seq_file, "off") == 0)
+        seqStop();
+    else if(seq_file != NULL && useDual)
+        printf("--playlist is ignored with --dual.\n");
+    else if(seq_file != NULL && startedUp && !useDDS)
+        printf("--playlist needs --dds at start-up. It is ignored.\n");
+    else if(seq_file != NULL){
+        useDDS = true;
+        if(seqLoad(seq_file, &CField))
+            changeChannel(&DAC, true, CField.waveform_type, CField.freq, CField.mean, CField.amp);
+    }
+	// Record and script belong to the simulated board
+    if(!startedUp && (simRecordFile != NULL || simScriptFile != NULL) && board != &boardSim){
+        printf("--sim-record and --sim-script need --board sim.\n");
+        free(simRecordFile);
+        free(simScriptFile);
+        simRecordFile = simScriptFile = NULL;
+    }
+	// A burst is output by the DAC0 thread alone
+    if(burst.cycles && useDual){
+        printf("--burst is ignored with --dual.\n");
+        burst.cycles = 0;
+    }
+    else if(burst.cycles && burst.bit < 4)
+        printf("Trigger bit %d is also a switch input of Port A.\n", burst.bit);
+	// Replay the AWG file as it is, unless the arguments below say otherwise
+    if(awg_file != NULL && awgLoad(awg_file, awg_rate)){
+        loadChangeField(&DAC, &CField);
+        awgDefault(&CField);
+        changeChannel(&DAC, true, 4, CField.freq, CField.mean, CField.amp);
+    }
+    parseWaveArgs(&DAC, npos, positional);
+    if(useDual && ndac1)
+        parseWaveArgs(&DAC1, ndac1, dac1_args);
+	// CLManager ending message
     printf("Ending command line manager function...\n");
     sleep(1);
     return;
 }
+/* The output threads choose their loop (--pacer, --dds, --dual) and the
+board once, when they start. An imported file may repeat these options
+but not change them */
+bool atStartup(const char* option){
+    if(!startedUp)
+        return true;
+    printf("%s can only be set at start-up. It is ignored.\n", option);
+    return false;
+}
+/* Keep a copy of the value of the start-up only option argv[*counter]
+in *value. The text of an imported file is freed after CLManager */
+void startupArg(char** value, char** argv, int* counter){
+    if(atStartup(argv[*counter]))
+        *value = strdup(argv[*counter + 1]);
+    (*counter)++;
+}
+/* Apply waveform arguments (type freq mean amp isOn) to channel D
+
+argv[0] is skipped, as in main's argument list. Every complete
+group of 5 arguments results in one change of D */
+void parseWaveArgs(DACField* D, int argc, char** argv){
+    int counter, temp2;
+    float temp;
+    ChangeField CField;
+    char* endptr;
+	// Load CField with current values of the channel
+    loadChangeField(D, &CField);
+	// Argument checking (from argv[1])
+    for(counter=1;counter<argc;counter++){
+		// Check argv[1] - waveform type
+        if((counter%5) ==1){
+            if(strcmp(argv[counter],"-sin") == 0)
+                CField.waveform_type=1;
+            else if(strcmp(argv[counter],"-tri") == 0)
+                CField.waveform_type=2;
+            else if(strcmp(argv[counter],"-squ") == 0)
+                CField.waveform_type=3;
+            else if(strcmp(argv[counter],"-awg") == 0 && awg.samples)
+                CField.waveform_type=4;
+            else if(strcmp(argv[counter],"-awg") == 0)
+                printf("No arbitrary waveform loaded (--awg <file>).\n");
+            else
+                printf("Invalid waveform.\n");
+        }
+		// Check argv[2] to argc[4]
+        else  if ((counter%5) !=0){
+			// Convert string to double
+            temp = strtod(argv[counter], &endptr);
+			// Continue if valid
+            if(*endptr == '\0'){
+				/* Check argv[2] - freq, argv[3] - mean
+				and argv[4] - amplitude */
+                switch(counter%5){
+                    case 2: {
+						// Range checking for all parameters
+                        if(temp>0 && temp <maxFreq())
+                            CField.freq = temp;
+                        else
+                            printf("Frequency must be in the range (0, %.0f) Hz\n", maxFreq());
+                        break;
+                    }
+                    case 3: {
+                        if(checkAbsMax(temp, CField.amp)!=0)
+                            CField.mean = temp;
+                        else
+                            printf("Error: Out of range mean value: %.2f V\n", temp);
+                        break;
+                    }
+                    case 4: {
+                        if(checkAbsMax(CField.amp, temp)!=0)
+                            CField.amp = temp;
+                        else
+                            printf("Error: Out of range amplitude value: %.2f V\n", temp);
+                        break;
+                    }
+                }
+            }
+            else
+				// Show invalid input (not double), if any
+                printf("Invalid input #%d: %s\n", counter, argv[counter]);
+        }
+		// Check argv[5] - isOn status
+        else {
+            temp2 = strtol(argv[counter], &endptr, 2);
+            if(temp2==1)
+                changeChannel(D, true, CField.waveform_type, CField.freq, CField.mean, CField.amp);
+            else
+                changeChannel(D, false, CField.waveform_type, CField.freq, CField.mean, CField.amp);
+        }
+    }
+    return;
+}
 
 
 //*************************************************************//
-//                           DAC parts
+//                      Timing calibration
 //*************************************************************//
-// Change the bipolar/unipolar mode based on mean and amplitude
-// to give best resolution
-void chooseBestRes(){
-	// Data has negative value(s)
-    if(hasNegative()){
-		// Absolute maximum <5V
-        if(checkAbsMax(DAC.mean, DAC.amp)==1){
-            DAC.plus=(0x0000<<DAC.identity);
-            DAC.DAC_mode = 0;
-            DAC.output_res=152.59;
-        }
-		// Absolute maximum <10V
-        else if (checkAbsMax(DAC.mean, DAC.amp)==2){
-            DAC.plus=(0x0100<<DAC.identity);
-            DAC.DAC_mode = 1;
-            DAC.output_res=305.14;
-        }
+/* Host timing for the software timed output
+
+The port write cost, how late an absolute sleep wakes up and the timer
+granularity depend on the CPU, the board and the load. They are measured
+once and cached in calibFile (CALIB_FILE in $HOME unless --calib-file
+names another) with the host name, so later launches on the same host
+skip the measurement (--calibrate measures again). The spin before a
+deadline covers 90% of the wakeups: tickerWait catches up after the
+rare long ones, and spinning for them would cost CPU on every sample.
+Must be called with I/O privileges, before the output threads start.
+*/
+void calibrate(bool force){
+    static char path[1024];
+    struct utsname u;
+    char host[sizeof(u.nodename) + sizeof(u.machine) + 1];
+    if(calibFile == NULL){
+        snprintf(path, sizeof(path), "%s/%s", getenv("HOME") != NULL ? getenv("HOME") : ".", CALIB_FILE);
+        calibFile = path;
     }
-	// Data has no negative value
+    if(uname(&u) == 0)
+        snprintf(host, sizeof(host), "%s/%s", u.nodename, u.machine);
+    else
+        strcpy(host, "unknown");
+    if(!force && loadCalibration(&calib, host))
+        printf("\nTiming calibration read from %s\n", calibFile);
     else{
-        if(checkAbsMax(DAC.mean, DAC.amp)==1){
-            DAC.plus=(0x0200<<DAC.identity);
-            DAC.DAC_mode = 2;
-            DAC.output_res=76.29;
+        printf("\nCalibrating timing...\n");
+        measureTiming(&calib);
+        saveCalibration(&calib, host);
+    }
+    printf("Port write %ld ns, timer granularity %ld ns\n", calib.write_ns, calib.res_ns);
+    printf("Sleep overshoot %ld/%ld/%ld/%ld ns (median/90%%/99%%/max), spin %ld ns\n",
+        calib.sleep_p50_ns, calib.sleep_p90_ns, calib.sleep_p99_ns, calib.sleep_max_ns,
+        calib.spin_ns);
+}
+void measureTiming(Calibration* C){
+    long over[CALIB_SLEEPS];
+    struct timespec ts;
+    int64_t t0, t1, step = -1;
+    int i;
+	// Port write: the DAC FIFO clear is harmless before the output starts
+    t0 = monoNow();
+    for(i=0;i<CALIB_WRITES;i++)
+        board->out16(DA_FIFOCLR, 0);
+    C->write_ns = (long)((monoNow() - t0)/CALIB_WRITES);
+	// Granularity: the coarser of the clock resolution and its smallest step
+    clock_getres(CLOCK_MONOTONIC, &ts);
+    C->res_ns = ts.tv_sec*1000000000 + ts.tv_nsec;
+    for(i=0;i<1000;i++){
+        t0 = monoNow();
+        while((t1 = monoNow()) == t0);
+        if(step < 0 || t1 - t0 < step)
+            step = t1 - t0;
+    }
+    if(step > C->res_ns)
+        C->res_ns = (long)step;
+	// Overshoot of absolute sleeps, as tickerWait does them
+    for(i=0;i<CALIB_SLEEPS;i++){
+        t0 = monoNow() + CALIB_SLEEP_NS;
+        ts.tv_sec = t0/1000000000;
+        ts.tv_nsec = t0%1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        over[i] = (long)(monoNow() - t0);
+    }
+    qsort(over, CALIB_SLEEPS, sizeof(long), cmpLong);
+    C->sleep_p50_ns = over[CALIB_SLEEPS/2];
+    C->sleep_p90_ns = over[CALIB_SLEEPS*9/10];
+    C->sleep_p99_ns = over[CALIB_SLEEPS*99/100];
+    C->sleep_max_ns = over[CALIB_SLEEPS-1];
+    C->spin_ns = C->sleep_p90_ns + C->res_ns;
+    if(C->spin_ns < SPIN_MIN_NS)
+        C->spin_ns = SPIN_MIN_NS;
+    if(C->spin_ns > SPIN_MAX_NS)
+        C->spin_ns = SPIN_MAX_NS;
+}
+/* The calibration file is one line:
+<version> <host> <write> <granularity> <median> <90%> <99%> <max> <spin> (ns) */
+bool loadCalibration(Calibration* C, const char* host){
+    FILE* fd;
+    Calibration c;
+    char h[256];
+    int version, n;
+    if((fd = fopen(calibFile, "r")) == NULL)
+        return false;
+    n = fscanf(fd, "%d %255s %ld %ld %ld %ld %ld %ld %ld", &version, h, &c.write_ns, &c.res_ns,
+        &c.sleep_p50_ns, &c.sleep_p90_ns, &c.sleep_p99_ns, &c.sleep_max_ns, &c.spin_ns);
+    fclose(fd);
+    if(n != 9 || version != CALIB_VERSION || strcmp(h, host) != 0
+            || c.write_ns <= 0 || c.spin_ns < SPIN_MIN_NS || c.spin_ns > SPIN_MAX_NS)
+        return false;
+    *C = c;
+    return true;
+}
+void saveCalibration(const Calibration* C, const char* host){
+    FILE* fd;
+    if((fd = fopen(calibFile, "w")) == NULL){
+        perror(calibFile);
+        return;
+    }
+    fprintf(fd, "%d %s %ld %ld %ld %ld %ld %ld %ld\n", CALIB_VERSION, host, C->write_ns, C->res_ns,
+        C->sleep_p50_ns, C->sleep_p90_ns, C->sleep_p99_ns, C->sleep_max_ns, C->spin_ns);
+    fclose(fd);
+}
+// qsort order of longs
+int cmpLong(const void* a, const void* b){
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+//*************************************************************//
+//                     Terminal dashboard
+//*************************************************************//
+/*
+The status screen (showADCStatus) is drawn as frames: the text of a
+frame is rendered in memory with the usual printf formatting, compared
+row by row with the screen, and only the changed span of each row is
+sent, after a cursor position sequence. A frame is one write() to the
+terminal, and no process is started (no system("clear")). Rows are
+plain ASCII without tabs, so columns are bytes.
+*/
+void dashStart(Dash* S, int fd){
+    S->fd = fd;
+    S->rows = 0;
+    S->drawn = false;
+}
+// Draw a frame, return the bytes written
+int dashFrame(Dash* S, const char* text, size_t len){
+    const char* end = text + len;
+    const char* nl;
+    char* row;
+    int n = 0, r = 0, w, old, a, b;
+	// First frame: clear the screen and hide the cursor
+    if(!S->drawn){
+        n = snprintf(S->out, DASH_OUT, "\033[?25l\033[H\033[2J");
+        for(r=0;r<DASH_ROWS;r++)
+            S->row[r][0] = '\0';
+        S->rows = 0;
+        r = 0;
+    }
+    while(text < end && r < DASH_ROWS){
+        if((nl = memchr(text, '\n', end - text)) == NULL)
+            nl = end;
+        w = nl - text < DASH_COLS ? (int)(nl - text) : DASH_COLS;
+        row = S->row[r];
+        old = strlen(row);
+		// First and last column that differ
+        for(a=0;a<w && a<old && text[a] == row[a];a++);
+        b = w;
+        if(w == old)
+            while(b > a && text[b-1] == row[b-1])
+                b--;
+        if(a < b || w < old){
+            n += snprintf(S->out + n, DASH_OUT - n, "\033[%d;%dH", r + 1, a + 1);
+            memcpy(S->out + n, text + a, b - a);
+            n += b - a;
+            if(w < old)
+                n += snprintf(S->out + n, DASH_OUT - n, "\033[K");
+            memcpy(row, text, w);
+            row[w] = '\0';
         }
-         else if (checkAbsMax(DAC.mean, DAC.amp)==2){
-            DAC.plus=(0x0300<<DAC.identity);
-            DAC.DAC_mode = 3;
-            DAC.output_res=152.59;
+        text = nl + 1;
+        r++;
+    }
+	// Rows of the last frame not in this one
+    for(a=r;a<S->rows;a++)
+        if(S->row[a][0] != '\0'){
+            n += snprintf(S->out + n, DASH_OUT - n, "\033[%d;1H\033[K", a + 1);
+            S->row[a][0] = '\0';
         }
-	}
-    return;
+    S->rows = r;
+    S->drawn = true;
+    if(n == 0)
+        return 0;
+    return write(S->fd, S->out, n);
 }
-// Generate data for waveform
-void WaveformGen (){
-    int i=0;
-    int z=0;
-    double delta_incr, dummy, res;
-    unsigned short offset=0;
-    /*
-    value = mean + x
-        sine wave       : x= amp*sin(2*PI*freq*t)
-        triangular wave : x= (4*amp/T)*t        (0<t<T/4)
-                          x= 2*amp-(4*amp/T)*t  (T/4<t<3*T/4)
-                          x= -4*amp+(4*amp/T)*t (3*T/4<t<T)
-        square wave     : x= amp                (0<t<T/2)
-                          x= -amp               (T/2<t<T)
-    */
-	// Choose unipolar/bipolar DAC mode
-    chooseBestRes();
-	// Convert resolution to unit of V
-    res = DAC.output_res/1000000;
-	// Add offset for bipolar mode
-    if(DAC.DAC_mode<2)
-        offset+=0x7FFF;
-    switch (DAC.waveform_type){
-        case 1: {// Sine wave waveform creation
-                 delta_incr=2.0*PI/DAC.samples_per_period;	// increment
-                 for(i=0;i<DAC.samples_per_period;i++) {
-                     dummy= (sinf((float)(i*delta_incr)))* DAC.amp + DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                 break;
-                }
-        case 2: {// Triangular wave waveform creation
-                 delta_incr=4*DAC.amp/DAC.samples_per_period;	// increment
-                 for(i=0;i<DAC.samples_per_period/4;i++) {
-                     dummy= delta_incr*i +DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                 for(;i<(3*DAC.samples_per_period/4);i++) {
-                     dummy= 2*DAC.amp-delta_incr*i +DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                 for(;i<DAC.samples_per_period;i++) {
-                     dummy= -4*DAC.amp+delta_incr*i +DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                 break;
-                }
-        case 3: {// Square wave waveform creation
-                 for(i=0;i<DAC.samples_per_period/2;i++) {
-                     dummy= DAC.amp + DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                 for(;i<DAC.samples_per_period;i++) {
-                     dummy= -DAC.amp + DAC.mean;
-                     dummy= offset + dummy/res;
-                     DAC.data[i]= (unsigned short) dummy;
-                 }
-                break;
-                }
-        }
-	// Reset resetWave flag after finishing configuration
-    DAC.resetWave=false;
-    return;
+// Leave the cursor shown below the last frame
+void dashStop(Dash* S){
+    int n;
+    if(!S->drawn)
+        return;
+    n = snprintf(S->out, DASH_OUT, "\033[%d;1H\033[?25h", S->rows + 1);
+    if(write(S->fd, S->out, n) != n)
+        perror("dashboard");
 }
-// Used for calculating nanosec difference between timespec
-long interval(struct timespec* start, struct timespec* end){
-	long temp = end->tv_nsec - start->tv_nsec;
-	if(temp > 0) return temp;
-	else return (temp + 1000000000);
+// Clear the terminal with one write (in place of system("clear"))
+void termClear(){
+    fflush(stdout);
+    if(write(STDOUT_FILENO, "\033[H\033[2J", 7) != 7)
+        perror("clear");
 }
 
-// Function to push-out data to DAC(thread function)
-void* PushDAC (void* Curr){
-	// Obtained struct pointer from pthread_create
-    DACField* Current = (DACField*) Curr;
-    struct timespec time_start, time_end;
-    int i, delay_time;
-    unsigned short CTLREG_content;
-	long nanospin_time;
-	// Configure the DAC CTRL register data values
-    CTLREG_content=(unsigned short)((*Current).plus+((*Current).identity+0x1)*0x20+0x3);
-	nanospin_time = (long)(1000000000.0/(Current->freq*Current->samples_per_period));
-	// While loop to push out data
-    while (1){
-        for(i=0;i<(*Current).samples_per_period;i++) {
-			// Exit thread if isOperating or isOn ==false, or when resetWave==true              */
-            if(!((*Current).resetWave==false && (*Current).isOn==true) || !isOperating)
-                pthread_exit(NULL);
-            out16(DA_CTLREG, CTLREG_content);       // Write setting to DAC CTLREG
-            out16(DA_FIFOCLR, 0);					// Clear DA FIFO buffer
-            out16(DA_Data, (*Current).data[i]);     // Output data
-            // Use nanospin if sleep time is below 5ms, else use clock and delay.
-            if(nanospin_time < 5 * 1000000)  nanospin_ns(nanospin_time - FIFO_DELAY);// Busy wait
-            else{
-            	clock_gettime(CLOCK_REALTIME, &time_start);
-           		delay_time =  (nanospin_time/1000000) - 2;
-           		delay(delay_time);
-           		clock_gettime(CLOCK_REALTIME, &time_end);
-            	nanospin_ns(nanospin_time - FIFO_DELAY - interval(&time_start, &time_end));
-            }
+//*************************************************************//
+//                      Control endpoint
+//*************************************************************//
+/*
+Other processes change the parameters with fixed-size binary commands
+(CtrlCommand), each answered with a CtrlReply holding the parameters
+after it. A command goes through changeChannel and waitWaveAck under
+MainMutex like a keyboard change, so the reply is sent once the new
+waveform is published. With --ctrl the endpoint is a resource manager
+at /dev/wavegen on QNX (one devctl() per command) and a UNIX-domain
+SOCK_SEQPACKET socket at /tmp/wavegen.sock elsewhere (one message each
+way), served by CtrlServer. --send is the client.
+*/
+// Range check and apply a command, fill the reply
+void ctrlApply(const CtrlCommand* C, CtrlReply* R){
+    ChangeField CF;
+    DACField* D;
+    memset(R, 0, sizeof(*R));
+    if(C->channel > 1 || (C->channel == 1 && !useDual)){
+        R->status = CTRL_ECHAN;
+        return;
+    }
+    D = Channel[C->channel];
+    if(C->op == CTRL_STATUS){
+        loadParams(D, &R->params);
+        return;
+    }
+    pthread_mutex_lock(&MainMutex);
+    loadChangeField(D, &CF);
+    switch(C->op){
+        case CTRL_FREQ: {
+            if(!(C->value > 0 && C->value < maxFreq()))
+                R->status = CTRL_ERANGE;
+            CF.freq = C->value;
+            break;
+        }
+        case CTRL_AMP: {
+            CF.amp = C->value;
+            if(!(C->value >= 0) || checkAbsMax(CF.mean, CF.amp) == 0)
+                R->status = CTRL_ERANGE;
+            break;
+        }
+        case CTRL_MEAN: {
+            CF.mean = C->value;
+            if(checkAbsMax(CF.mean, CF.amp) == 0)
+                R->status = CTRL_ERANGE;
+            break;
+        }
+        case CTRL_TYPE: {
+            if(C->value != 1 && C->value != 2 && C->value != 3 && !(C->value == 4 && awg.samples > 0))
+                R->status = CTRL_ERANGE;
+            CF.waveform_type = (unsigned short)C->value;
+            break;
+        }
+        case CTRL_ON: {
+            if(C->value != 0 && C->value != 1)
+                R->status = CTRL_ERANGE;
+            CF.isOn = C->value == 1;
+            break;
         }
+        default: { R->status = CTRL_EOP; break;}
     }
-    return (0);
+    if(R->status == CTRL_OK){
+        changeChannel(D, CF.isOn, CF.waveform_type, CF.freq, CF.mean, CF.amp);
+        if(!waitWaveAck(waveRequest))
+            R->status = CTRL_ETIMEOUT;
+    }
+    pthread_mutex_unlock(&MainMutex);
+    loadParams(D, &R->params);
 }
-//Thread for managing waveform generating capabilities
-void* WaveGenManager (void * pointer){
-    pthread_t tid;
-    while(1){
-        delay(100);
-        if(!isOperating){
-            pthread_exit(NULL);
-            DAC.isOn = false;
-        }
-		// Continue checking if PushDAC needs no change
-        if(DAC.isOn==false)
+// Start serving commands at path
+bool ctrlStart(const char* path){
+    ctrlRunning = true;
+    if(pthread_create(&ctrlThread, NULL, &CtrlServer, (void*)path) != 0){
+        ctrlRunning = false;
+        return false;
+    }
+	// The endpoint exists once CtrlServer has attached it
+    while(ctrlRunning && !ctrlReady)
+        delay(1);
+    if(!ctrlReady)
+        pthread_join(ctrlThread, NULL);
+    return ctrlReady;
+}
+// Stop serving commands and remove the endpoint
+void ctrlStop(){
+    if(!ctrlRunning)
+        return;
+    ctrlRunning = false;
+    pthread_join(ctrlThread, NULL);
+    ctrlReady = false;
+}
+#ifdef __QNX__
+static resmgr_connect_funcs_t ctrlConnectFuncs;
+static resmgr_io_funcs_t ctrlIOFuncs;
+static iofunc_attr_t ctrlAttr;
+
+// devctl() of a client: the command in, the reply out
+int ctrlDevctl(resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* ocb){
+    CtrlMsg* m;
+    CtrlCommand C;
+    int status;
+    if((status = iofunc_devctl_default(ctp, msg, ocb)) != _RESMGR_DEFAULT)
+        return status;
+    if(msg->i.dcmd != DCMD_WAVEGEN || msg->i.nbytes < sizeof(CtrlMsg))
+        return ENOSYS;
+    m = _DEVCTL_DATA(msg->i);
+    C = m->cmd;
+    ctrlApply(&C, &m->reply);
+    memset(&msg->o, 0, sizeof(msg->o));
+    msg->o.nbytes = sizeof(CtrlMsg);
+    return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + sizeof(CtrlMsg));
+}
+// Resource manager thread of the control endpoint
+void* CtrlServer(void* pointer){
+    const char* path = pointer;
+    dispatch_t* dpp;
+    dispatch_context_t* ctp;
+    resmgr_attr_t rattr;
+    struct timespec timeout = {0, 100000000};
+    int id;
+    rtDemote();
+    if((dpp = dispatch_create()) == NULL){
+        perror("dispatch_create");
+        ctrlRunning = false;
+        return NULL;
+    }
+    memset(&rattr, 0, sizeof(rattr));
+    rattr.nparts_max = 1;
+    rattr.msg_max_size = sizeof(io_devctl_t) + sizeof(CtrlMsg);
+    iofunc_func_init(_RESMGR_CONNECT_NFUNCS, &ctrlConnectFuncs, _RESMGR_IO_NFUNCS, &ctrlIOFuncs);
+    ctrlIOFuncs.devctl = ctrlDevctl;
+    iofunc_attr_init(&ctrlAttr, S_IFCHR | 0666, NULL, NULL);
+    if((id = resmgr_attach(dpp, &rattr, path, _FTYPE_ANY, 0, &ctrlConnectFuncs,
+            &ctrlIOFuncs, &ctrlAttr)) == -1){
+        perror(path);
+        dispatch_destroy(dpp);
+        ctrlRunning = false;
+        return NULL;
+    }
+	// Wake up every 100 ms to see ctrlStop
+    dispatch_timeout(dpp, &timeout);
+    ctp = dispatch_context_alloc(dpp);
+    ctrlReady = true;
+    while(ctrlRunning)
+        if(dispatch_block(ctp) != NULL)
+            dispatch_handler(ctp);
+    resmgr_detach(dpp, id, 0);
+    dispatch_context_free(ctp);
+    dispatch_destroy(dpp);
+    return NULL;
+}
+int ctrlOpen(const char* path){
+    return open(path, O_RDWR);
+}
+int ctrlCall(int fd, const CtrlCommand* C, CtrlReply* R){
+    CtrlMsg m;
+    memset(&m, 0, sizeof(m));
+    m.cmd = *C;
+    if(devctl(fd, DCMD_WAVEGEN, &m, sizeof(m), NULL) != EOK)
+        return -1;
+    *R = m.reply;
+    return 0;
+}
+#else
+// Socket thread of the control endpoint: up to CTRL_CLIENTS connections
+void* CtrlServer(void* pointer){
+    const char* path = pointer;
+    struct sockaddr_un addr;
+    struct pollfd fds[CTRL_CLIENTS + 1];
+    CtrlCommand C;
+    CtrlReply R;
+    int n = 1, i, fd;
+    rtDemote();
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if((fds[0].fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1
+            || bind(fds[0].fd, (struct sockaddr*)&addr, sizeof(addr)) == -1
+            || listen(fds[0].fd, CTRL_CLIENTS) == -1){
+        perror(path);
+        if(fds[0].fd != -1)
+            close(fds[0].fd);
+        ctrlRunning = false;
+        return NULL;
+    }
+    fds[0].events = POLLIN;
+    ctrlReady = true;
+	// Wake up every 100 ms to see ctrlStop
+    while(ctrlRunning){
+        if(poll(fds, n, 100) <= 0)
             continue;
-        else {
-            if(DAC.resetWave==false)
+        for(i=n-1;i>0;i--){
+            if(!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
                 continue;
-			/* Create a thread if DAC setting is changed, PushDAC
-			automatically dies (see above descriptions)*/
+            if(recv(fds[i].fd, &C, sizeof(C), 0) == sizeof(C)){
+                ctrlApply(&C, &R);
+                if(send(fds[i].fd, &R, sizeof(R), MSG_NOSIGNAL) == sizeof(R))
+                    continue;
+            }
+			// Closed, or not a command: drop the client
+            close(fds[i].fd);
+            fds[i] = fds[--n];
+        }
+        if((fds[0].revents & POLLIN) && (fd = accept(fds[0].fd, NULL, NULL)) != -1){
+            if(n > CTRL_CLIENTS)
+                close(fd);
             else{
-				// Use to Mutex when changing shared global variables
-                pthread_mutex_lock(&MainMutex);
-				// Set up data field for DAC
-                WaveformGen();
-                pthread_mutex_unlock(&MainMutex);
-				// Create thread
-                pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+                fds[n].fd = fd;
+                fds[n++].events = POLLIN;
             }
         }
     }
+    for(i=0;i<n;i++)
+        close(fds[i].fd);
+    unlink(path);
+    return NULL;
+}
+int ctrlOpen(const char* path){
+    struct sockaddr_un addr;
+    int fd;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1)
+        return -1;
+    if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+int ctrlCall(int fd, const CtrlCommand* C, CtrlReply* R){
+    if(send(fd, C, sizeof(*C), MSG_NOSIGNAL) != sizeof(*C) || recv(fd, R, sizeof(*R), 0) != sizeof(*R))
+        return -1;
+    return 0;
+}
+#endif
+/* Send one command to a running generator (--send) and print the reply.
+Returns the reply status, or -1 if the endpoint cannot be reached */
+int ctrlSend(const char* path, int channel, const char* op, float value){
+    const char* ops[] = {"", "freq", "amp", "mean", "type", "on", "status"};
+    const char* errors[] = {"ok", "unknown command", "out of range", "no such channel",
+        "waveform manager did not respond"};
+    CtrlCommand C;
+    CtrlReply R;
+    int fd;
+    memset(&C, 0, sizeof(C));
+    for(C.op=CTRL_FREQ;C.op<=CTRL_STATUS && strcmp(op, ops[C.op]) != 0;C.op++);
+    C.channel = channel;
+    C.value = value;
+    if((fd = ctrlOpen(path)) == -1){
+        perror(path);
+        return -1;
+    }
+    if(ctrlCall(fd, &C, &R) != 0){
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    printf("DAC%d %s: %s\n", channel, op, R.status >= 0 && R.status <= CTRL_ETIMEOUT ? errors[R.status] : "?");
+    printf("on %d, type %d, freq %.3f Hz, mean %.3f V, amp %.3f V\n", R.params.isOn,
+        R.params.waveform_type, R.params.freq, R.params.mean, R.params.amp);
+    return R.status;
 }
 
 //*************************************************************//
-//        Input manager for switches and analogue inputs
+//                    Shared-memory status page
 //*************************************************************//
-void * PeripheralInputs(void *pointer){
-	bool isOn = false;
-	bool hasChanged = false;
-	unsigned short mean_amp=0;
-	unsigned short count = 0x00;
-	unsigned short chan = 0x00;
-	unsigned short wavef = 1;
-	bool digital_in_old;
-	float temp;
-	ChangeField CField;
-	ADC_Refresh = true;
-	while(1){
-		// Exit thread if isOperating is false
-        if(!isOperating)
-            pthread_exit(NULL);
-		// Load the CField with default DAC values
-		setChangeField(&CField);
-		temp=0;
-		count = 0x00;
-		// Delay to allow DAC to work better
-		delay(100);
-		// Port A : Input,  Port B : Output,  Port C (upper | lower) : Output | Output
-		out8(DIO_CTLREG,0x90);
-
-		// Read Port A
-		digital_in =in8(DIO_PORTA);
-		// Output Port A value -> write to Port B (LEDs)
-		out8(DIO_PORTB, digital_in);
-
-		// Read potentiometers
-		while (count < 0x02) {
-			chan = ((count & 0x0f) << 4) | (0x0f & count);
-			out16(MUXCHAN, 0x0D00 | chan);			// Set channel	 - burst mode off
-			delay(1);								// Allow mux to settle
-			out16(AD_DATA, 0); 						// Start ADC
-			while (!(in16(MUXCHAN) & 0x4000));		// Wait until the data is filled
-			adc_in[count] = in16(AD_DATA);
-			count++;
+/*
+With --status, StatusWriter copies the parameters of both channels, the
+switches and potentiometers, the output counters and the lateness of
+the software timed samples into a POSIX shared-memory page (StatusPage)
+STATUS_HZ times a second. Monitors map the page read-only and take
+snapshots with the seqlock in seq: no system call, no lock and no
+write, so any number of them can read without the output threads
+noticing. --monitor is such a reader.
+*/
+/*
+A page is only created (O_EXCL), never truncated under another
+generator. One left by a process that no longer exists is removed and
+created again; one of a live process (or one still being created, pid
+0) makes statusStart fail.
+*/
+bool statusStart(const char* name){
+    int fd, pid;
+    while((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1 && errno == EEXIST){
+        if((pid = statusOwner(name)) == -1)
+            continue;			//Removed meanwhile
+        if(pid > 0 && kill(pid, 0) == -1 && errno == ESRCH){
+            printf("Taking over status page %s of process %d\n", name, pid);
+            shm_unlink(name);
+            continue;
+        }
+        printf("Status page %s is in use by process %d\n", name, pid);
+        return false;
+    }
+    if(fd == -1 || ftruncate(fd, sizeof(StatusPage)) == -1){
+        perror(name);
+        if(fd != -1){
+            close(fd);
+            shm_unlink(name);
+        }
+        return false;
+    }
+    statusPage = mmap(NULL, sizeof(StatusPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(statusPage == MAP_FAILED){
+        perror(name);
+        statusPage = NULL;
+        shm_unlink(name);
+        return false;
+    }
+    statusPage->size = sizeof(StatusPage);
+    statusPage->pid = getpid();
+	// Readers check the magic last
+    __sync_synchronize();
+    statusPage->magic = STATUS_MAGIC;
+    statusName = name;
+    statusRunning = true;
+    pthread_create(&statusThread, NULL, &StatusWriter, NULL);
+    return true;
+}
+// Stop updating the page and remove it
+void statusStop(){
+    if(!statusRunning)
+        return;
+    statusRunning = false;
+    pthread_join(statusThread, NULL);
+    statusPage->magic = 0;
+    munmap(statusPage, sizeof(StatusPage));
+    statusPage = NULL;
+	// Taken over meanwhile (this process was stopped long enough to look dead)
+    if(statusOwner(statusName) == getpid())
+        shm_unlink(statusName);
+}
+/* Process that created the page name, 0 if the page is too short to
+have one yet, -1 if there is no page */
+int statusOwner(const char* name){
+    const StatusPage* S;
+    struct stat st;
+    int fd, pid = 0;
+    if((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        return -1;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(StatusPage)
+            && (S = mmap(NULL, sizeof(StatusPage), PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED){
+        pid = S->pid;
+        munmap((void*)S, sizeof(StatusPage));
+    }
+    close(fd);
+    return pid;
+}
+// Thread updating the status page
+void* StatusWriter(void* pointer){
+    struct timespec ts;
+    int64_t next = monoNow();
+    (void)pointer;
+    rtDemote();
+    while(statusRunning){
+        statusUpdate(statusPage);
+        next += 1000000000/STATUS_HZ;
+        if(next < monoNow())
+            next = monoNow();
+        ts.tv_sec = next/1000000000;
+        ts.tv_nsec = next%1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    }
+    return NULL;
+}
+/* Write one snapshot. The fields are gathered first, so the page is odd
+(being written) only for the copy */
+void statusUpdate(StatusPage* S){
+    StatusPage N;
+    unsigned long long hist[HIST_BUCKETS];
+    int k;
+    memset(&N, 0, sizeof(N));
+    for(k=0;k<2;k++){
+        loadParams(Channel[k], &N.dac[k]);
+        N.ticks[k] = dacTrace[k].head;
+        N.fifo_samples[k] = Channel[k]->fifo_samples;
+        N.slips[k] = dacTrace[k].slips;
+        memcpy(hist, dacTrace[k].hist, sizeof(hist));
+        N.late_p50[k] = histPercentile(hist, 0.5);
+        N.late_p99[k] = histPercentile(hist, 0.99);
+        N.late_max[k] = dacTrace[k].max_late;
+    }
+    N.adc_in[0] = adc_in[0];
+    N.adc_in[1] = adc_in[1];
+    N.digital_in = (uint32_t)digital_in;
+	// Every change publishes a snapshot, DDS frequency changes included
+    N.changes = (DAC.param_seq + DAC1.param_seq)/2;
+    N.bursts = burstStats.triggers;
+    N.time = monoNow();
+    N.updates = S->updates + 1;
+    S->seq++;
+    __sync_synchronize();
+    memcpy((char*)S + offsetof(StatusPage, updates), (char*)&N + offsetof(StatusPage, updates),
+        sizeof(StatusPage) - offsetof(StatusPage, updates));
+    __sync_synchronize();
+    S->seq++;
+}
+/* Copy a consistent snapshot of the page (retrying while it is being
+written), return the retries, or -1 if no snapshot was complete within
+STATUS_READ_MS (the writer died or stopped in the middle of one) */
+int statusRead(const StatusPage* S, StatusPage* out){
+    uint32_t seq;
+    int retries = -1, spins = 0;
+    int64_t deadline = monoNow() + STATUS_READ_MS*1000000LL;
+    do{
+        retries++;
+        while((seq = S->seq) & 1){
+			// A snapshot takes microseconds, look at the clock only now and then
+            if(++spins % 1024 == 0){
+                if(monoNow() > deadline)
+                    return -1;
+                sched_yield();
+            }
+        }
+        __sync_synchronize();
+        memcpy(out, (const void*)S, sizeof(*out));
+        __sync_synchronize();
+    }while(S->seq != seq);
+    return retries;
+}
+// Map a status page read-only, NULL if there is none
+const StatusPage* statusMap(const char* name){
+    const StatusPage* S;
+    int fd;
+    if((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        return NULL;
+    S = mmap(NULL, sizeof(StatusPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(S == MAP_FAILED)
+        return NULL;
+    if(S->magic != STATUS_MAGIC || S->size != sizeof(StatusPage)){
+        munmap((void*)S, sizeof(StatusPage));
+        return NULL;
+    }
+    return S;
+}
+/* Print the live rates of a running generator once a second (--monitor),
+for seconds (0 = until CTRL+C) */
+int runMonitor(const char* name, float seconds){
+    const StatusPage* S;
+    StatusPage a, b;
+    double dt;
+    int n;
+    if((S = statusMap(name)) == NULL){
+        printf("No status page %s (start the generator with --status).\n", name);
+        return 1;
+    }
+    if(statusRead(S, &a) < 0){
+        printf("The generator stopped in the middle of an update.\n");
+        munmap((void*)S, sizeof(StatusPage));
+        return 1;
+    }
+    printf("Status of process %d\n", a.pid);
+    printf("%8s%4s%12s%8s%8s%12s%12s%12s%9s%9s%5s\n", "Time (s)", "On", "Freq (Hz)", "Amp", "Mean",
+        "Samples/s", "Changes/s", "p99 (us)", "ADC0", "ADC1", "DIO");
+    for(n=0;seconds <= 0 || n < seconds;n++){
+        sleep(1);
+        if(statusRead(S, &b) < 0){
+            printf("The generator stopped in the middle of an update.\n");
+            break;
+        }
+        if(S->magic != STATUS_MAGIC){
+            printf("The generator has stopped.\n");
+            break;
+        }
+        dt = (b.time - a.time)/1e9;
+        if(dt <= 0)
+            continue;
+		// DAC0 with the inputs, DAC1 below it while it is on
+        printf("%8.1f%4d%12.2f%8.2f%8.2f%12.0f%12.1f%12.1f%9.4X%9.4X%5lX\n", n + 1.0, b.dac[0].isOn,
+            b.dac[0].freq, b.dac[0].amp, b.dac[0].mean,
+            (b.ticks[0] + b.fifo_samples[0] - a.ticks[0] - a.fifo_samples[0])/dt,
+            (b.changes - a.changes)/dt, b.late_p99[0]/1e3,
+            b.adc_in[0], b.adc_in[1], (unsigned long)b.digital_in);
+        if(b.dac[1].isOn)
+            printf("%8s%4d%12.2f%8.2f%8.2f%12.0f%12s%12.1f\n", "", b.dac[1].isOn,
+                b.dac[1].freq, b.dac[1].amp, b.dac[1].mean,
+                (b.ticks[1] + b.fifo_samples[1] - a.ticks[1] - a.fifo_samples[1])/dt,
+                "", b.late_p99[1]/1e3);
+        a = b;
+    }
+    munmap((void*)S, sizeof(StatusPage));
+    return 0;
+}
+
+//*************************************************************//
+//                   Real-time thread policy
+//*************************************************************//
+/* With --rt the output threads (PushDAC, CaptureADC) run SCHED_FIFO at
+rtPrio, above every thread with the default policy, so the UI, the input
+scan and other programs cannot preempt a sample. The process memory is
+locked so the loops never page fault, and MainUI and PeripheralInputs
+are lowered below the default priority. --cpu pins the output threads
+to one CPU (runmask), and MainUI and PeripheralInputs to the others.
+Without the privileges for this the output runs with the default policy
+and a warning is shown once.
+*/
+void rtSetup(){
+    if(rtPrio && mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+        perror("mlockall");
+}
+void rtOutput(){
+    static bool warned = false;
+    struct sched_param param;
+    rtActive = false;
+    if(rtPrio){
+        param.sched_priority = rtPrio;
+        if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+            rtActive = true;
+        else if(!warned){
+            printf("Output thread could not get SCHED_FIFO priority %d.\n", rtPrio);
+            warned = true;
+        }
+    }
+    if(rtCPU >= 0 && ThreadCtl(_NTO_TCTL_RUNMASK, (void*)(uintptr_t)(1u << rtCPU)) == -1 && !warned){
+        printf("Output thread could not be pinned to CPU %d.\n", rtCPU);
+        warned = true;
+    }
+    rtPrefault();
+}
+void rtDemote(){
+#ifdef __QNX__
+    struct sched_param param;
+    int policy;
+#endif
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t mask = 0;
+    int cpu;
+	// Off the output CPU (--cpu) if there is another one
+    if(rtCPU >= 0 && cpus > 1){
+        for(cpu=0;cpu<cpus && cpu<32;cpu++)
+            if(cpu != rtCPU)
+                mask |= 1u << cpu;
+        ThreadCtl(_NTO_TCTL_RUNMASK, (void*)(uintptr_t)mask);
+    }
+    if(!rtPrio)
+        return;
+#ifdef __QNX__
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    param.sched_priority = RT_DEMOTE_PRIO;
+    pthread_setschedparam(pthread_self(), policy, &param);
+#else
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), RT_DEMOTE_NICE);
+#endif
+}
+// Touch the stack the loops will use, one page at a time
+void rtPrefault(){
+    volatile char stack[RT_STACK_PREFAULT];
+    int i;
+    for(i=0;i<RT_STACK_PREFAULT;i+=4096)
+        stack[i] = 0;
+    (void)stack[0];
+}
+
+//*************************************************************//
+//                           DAC parts
+//*************************************************************//
+// Change the bipolar/unipolar mode based on mean and amplitude
+// to give best resolution
+void chooseBestRes(DACField* D){
+	// Data has negative value(s)
+    if(hasNegative(D)){
+		// Absolute maximum <5V
+        if(checkAbsMax(D->mean, D->amp)==1){
+            D->plus=(0x0000<<(2*D->identity));
+            D->DAC_mode = 0;
+            D->output_res=152.59;
+        }
+		// Absolute maximum <10V
+        else if (checkAbsMax(D->mean, D->amp)==2){
+            D->plus=(0x0100<<(2*D->identity));
+            D->DAC_mode = 1;
+            D->output_res=305.14;
+        }
+    }
+	// Data has no negative value
+    else{
+        if(checkAbsMax(D->mean, D->amp)==1){
+            D->plus=(0x0200<<(2*D->identity));
+            D->DAC_mode = 2;
+            D->output_res=76.29;
+        }
+         else if (checkAbsMax(D->mean, D->amp)==2){
+            D->plus=(0x0300<<(2*D->identity));
+            D->DAC_mode = 3;
+            D->output_res=152.59;
+        }
+	}
+    return;
+}
+/* Choose samples per period and DAC pacer divisor for D->freq
+
+Software timing always uses 100 samples per period (arbitrary waveforms:
+see awgSampling). In paced mode the
+pacer divides PACER_CLOCK, so one period lasts samples*divisor clocks
+(the divisor is a product of the two pacer counters, see pacerSplit).
+The pair closest to the requested frequency is chosen, preferring more
+samples per period (multiples of 4 to keep the triangle symmetric).
+pacer_div stays 0 (software timing) if D->freq is outside the pacer range.
+*/
+void chooseSampling(DACField* D){
+    int spp;
+    uint32_t div;
+    unsigned int div1, div2;
+    double ticks, err, best_err=-1;
+    D->samples_per_period=100;
+    D->pacer_div=0;
+	// DDS: one table period at a fixed tick, the pacer runs at its top rate
+    if(useDDS){
+        D->samples_per_period=DDS_TABLE_SIZE;
+        D->phase_incr=ddsIncrement(D->freq);
+        if(usePacer)
+            D->pacer_div=PACER_MINDIV;
+        return;
+    }
+    if(D->waveform_type == 4){
+        awgSampling(D);
+        return;
+    }
+    if(!usePacer)
+        return;
+	// Pacer clocks in one period
+    ticks = PACER_CLOCK/D->freq;
+    for(spp=MAX_SAMPLES;spp>=MIN_SAMPLES;spp-=4){
+        if(ticks/spp + 0.5 < PACER_MINDIV || ticks/spp + 0.5 > PACER_MAXTOTAL)
+            continue;
+        div = pacerSplit((uint32_t)(ticks/spp + 0.5), &div1, &div2);
+        err = fabs((double)div*spp - ticks)/ticks;
+        if(best_err<0 || err<best_err){
+            best_err = err;
+            D->samples_per_period = spp;
+            D->pacer_div = div;
+        }
+		// Good enough: stop at the highest resolution
+        if(err<1e-4)
+            break;
+    }
+    return;
+}
+/* Split a DAC pacer divisor over counters 1 and 2 of the 8254 at
+BADR3 + 8..B, which pace the DAC in cascade (counter 0 is the user
+counter). In mode 2 each counter divides by 2 to PACER_MAXDIV, so not
+every divisor is a product: the closest one among PACER_SPLITS counter 2
+divisors is returned, with its two factors */
+uint32_t pacerSplit(uint32_t div, unsigned int* div1, unsigned int* div2){
+    unsigned int d1, d2, first;
+    uint32_t best = 0;
+    first = (unsigned int)((div + PACER_MAXDIV - 1)/PACER_MAXDIV);
+    if(first < 2)
+        first = 2;
+    for(d2=first;d2<first+PACER_SPLITS && d2<=PACER_MAXDIV;d2++){
+        d1 = (div + d2/2)/d2;
+        if(d1 < 2)
+            d1 = 2;
+        if(d1 > PACER_MAXDIV)
+            d1 = PACER_MAXDIV;
+        if(best == 0 || llabs((long long)d1*d2 - div) < llabs((long long)best - div)){
+            best = d1*d2;
+            *div1 = d1;
+            *div2 = d2;
+        }
+        if(best == div)
+            break;
+    }
+    return best;
+}
+/* Load the DAC pacer with div (a pacerSplit product). The counters run
+once loaded, conversions start with DAC_START in DA_CTLREG */
+void dacPacer(uint32_t div){
+    unsigned int div1, div2;
+    pacerSplit(div, &div1, &div2);
+    board->out8(PACERCTL, PACER_C1_MODE2);
+    board->out8(PACER2, div1 & 0xff);
+    board->out8(PACER2, (div1 >> 8) & 0xff);
+    board->out8(PACERCTL, PACER_C2_MODE2);
+    board->out8(PACER3, div2 & 0xff);
+    board->out8(PACER3, (div2 >> 8) & 0xff);
+}
+//Highest frequency allowed in the current output mode
+float maxFreq(){
+    if(useDDS)
+        return ddsRate()/DDS_MIN_SAMPLES;
+    return usePacer ? PACED_HIGHESTFREQ : HIGHESTFREQ;
+}
+//DDS output tick rate (S/s)
+float ddsRate(){
+    return usePacer ? (float)PACER_CLOCK/PACER_MINDIV : DDS_RATE;
+}
+/* DDS phase increment for frequency f
+
+The accumulator wraps once per period, so f = incr*rate/2^32. At the
+software tick this gives a frequency step of about 4.7 micro-Hz.
+*/
+uint32_t ddsIncrement(float f){
+    return (uint32_t)(f*4294967296.0/ddsRate() + 0.5);
+}
+// Set the phase offset of DAC1 relative to DAC0 (dual mode)
+void setPhase(float deg){
+    phaseDeg = deg;
+    phaseOffset = (uint32_t)(deg/360.0*4294967296.0);
+}
+/* Phase increment of the next DDS tick of channel D
+
+While a sweep is set, DAC0 takes it from the sweep instead of
+phase_incr. Only the increment changes from tick to tick, so the phase
+accumulator (and the output) stays continuous through the sweep, the
+dwell and the jump back to the start frequency. New sweep settings
+restart it at the next tick */
+static inline uint32_t ddsStep(DACField* D){
+    uint32_t incr;
+    if(D->identity != 0)
+        return D->phase_incr;
+    if(seqPending != NULL)
+        seqTake(&seqRun);
+    if(seqRun.seg != NULL)
+        incr = seqNext(&seqRun);
+    else if(!sweep.on)
+        incr = D->phase_incr;
+    else{
+        if(sweepRun.gen != sweep.gen)
+            sweepStart(&sweepRun);
+        incr = sweepNext(&sweepRun);
+    }
+    if(mod.mode == MOD_NONE)
+        return incr;
+	// FM: deviation times this tick's modulating value, then step the modulator
+    if(mod.mode == MOD_FM)
+        incr += (int32_t)(((int64_t)mod.depth_q*modRun.m) >> UNIT_SHIFT);
+    modRun.phase += mod.incr;
+    modRun.m = modTable[mod.type-1][modRun.phase >> DDS_SHIFT];
+    return incr;
+}
+/* DAC code of DDS channel D at phase: the table sample of w (of the
+playlist segment on DAC0 while a playlist runs), taken at a shifted
+phase (PM) or scaled around the mean (AM) on modulated DAC0. AM gain is
+(1 + depth*m)/(1 + depth), so the peak stays at the amplitude the table
+was made for and the code stays in range */
+static inline unsigned short ddsSample(DACField* D, const WaveBuffer* w, uint32_t phase){
+    const unsigned short* data = w->data;
+    int32_t center = w->center, gain;
+    int mode = MOD_NONE;
+    if(D->identity == 0){
+        mode = mod.mode;
+        if(seqRun.seg != NULL){
+            if(seqRun.done)
+                return (unsigned short)seqRun.seg->center;
+            data = seqRun.seg->data;
+            center = seqRun.seg->center;
+        }
+    }
+    if(mode == MOD_PM)
+        phase += (uint32_t)(int32_t)(((int64_t)mod.depth_q*modRun.m) >> UNIT_SHIFT);
+    if(mode != MOD_AM)
+        return data[phase >> DDS_SHIFT];
+    gain = mod.am_base + (int32_t)(((int64_t)mod.depth_q*modRun.m) >> UNIT_SHIFT);
+    return (unsigned short)(center + ((((int32_t)data[phase >> DDS_SHIFT] - center)*gain) >> AM_SHIFT));
+}
+/* Set the modulation of DAC0: mode (MOD_NONE turns it off), modulating
+waveform type, frequency and depth (see ModConfig). The settings are
+checked against the DDS rate and only take effect if they are valid */
+bool modSet(int mode, int type, float freq, float depth){
+    static bool tables = false;
+    const int32_t* u;
+    long long q;
+    int t;
+    if(mode == MOD_NONE){
+        mod.mode = MOD_NONE;
+        return true;
+    }
+    if(type < 1 || type > 3 || freq <= 0 || freq >= maxFreq()){
+        printf("Modulating waveform must be -sin, -tri or -squ at (0, %.0f) Hz\n", maxFreq());
+        return false;
+    }
+    if((mode == MOD_AM && (depth < 0 || depth > 1)) || (mode == MOD_FM && (depth <= 0 || depth >= maxFreq()))
+            || (mode == MOD_PM && (depth <= 0 || depth > 180))){
+        printf("Modulation depth must be in [0, 1] (AM), (0, %.0f) Hz (FM) or (0, 180] degrees (PM)\n",
+            maxFreq());
+        return false;
+    }
+	// Unit tables of the three waveforms, copied once from the DDS tables
+    if(!tables){
+        for(t=1;t<=3;t++){
+            u = unitWave(t, DDS_TABLE_SIZE);
+            memcpy(modTable[t-1], u, sizeof(modTable[0]));
+        }
+        tables = true;
+    }
+    mod.type = type;
+    mod.freq = freq;
+    mod.depth = depth;
+    mod.incr = ddsIncrement(freq);
+    switch(mode){
+        case MOD_AM: {
+            mod.am_base = (int32_t)lrint((1 << AM_SHIFT)/(1 + depth));
+            mod.depth_q = (int32_t)lrint((1 << AM_SHIFT)*depth/(1 + depth));
+            break;
+        }
+        case MOD_FM: { mod.depth_q = (int32_t)lrint(depth*4294967296.0/ddsRate()); break;}
+        default: {
+			// 180 degrees is 2^31, one past INT32_MAX: keep it a positive deviation
+            q = llrint(depth/360.0*4294967296.0);
+            mod.depth_q = (int32_t)(q > INT32_MAX ? INT32_MAX : q);
+            break;
+        }
+    }
+	// Settings before the mode the output thread checks
+    __sync_synchronize();
+    mod.mode = mode;
+    return true;
+}
+/* Start the sweep in sweep at the start frequency. A linear sweep adds
+step to the increment every tick, a logarithmic one multiplies it by
+step (a constant ratio per tick), so no table is regenerated */
+void sweepStart(SweepState* S){
+    double rate = ddsRate();
+    S->gen = sweep.gen;
+    S->sweeps = 0;
+    S->start_incr = sweep.start*4294967296.0/rate;
+    S->stop_incr = sweep.stop*4294967296.0/rate;
+    S->ticks = (unsigned long long)(sweep.seconds*rate + 0.5);
+    if(S->ticks < 1)
+        S->ticks = 1;
+    if(sweep.log)
+        S->step = pow(S->stop_incr/S->start_incr, 1.0/S->ticks);
+    else
+        S->step = (S->stop_incr - S->start_incr)/S->ticks;
+    S->dwelling = false;
+    S->incr = S->start_incr;
+    S->left = S->ticks;
+}
+// Phase increment of the next tick: one add or multiply, and a count
+static inline uint32_t sweepNext(SweepState* S){
+    double incr = S->incr;
+    if(--S->left == 0)
+        sweepTurn(S);
+    else if(!S->dwelling)
+        S->incr = sweep.log ? S->incr*S->step : S->incr + S->step;
+    return (uint32_t)(incr + 0.5);
+}
+/* End of a sweep: dwell at the stop frequency, then start the next one
+from the exact start increment (no rounding carried over). After the
+last sweep the stop frequency is held */
+void sweepTurn(SweepState* S){
+    unsigned long long dwell = (unsigned long long)(sweep.dwell*ddsRate() + 0.5);
+    if(!S->dwelling){
+        S->sweeps++;
+        S->dwelling = true;
+        S->incr = S->stop_incr;
+        if(sweep.repeat && S->sweeps >= (unsigned long long)sweep.repeat){
+            S->left = ~0ULL;
+            return;
+        }
+        if(dwell){
+            S->left = dwell;
+            return;
+        }
+    }
+    S->dwelling = false;
+    S->incr = S->start_incr;
+    S->left = S->ticks;
+}
+// Frequency the sweep is at (read outside the output thread, approximate)
+float sweepFreq(){
+    return sweepRun.incr*ddsRate()/4294967296.0;
+}
+/* Cached unit amplitude waveform (Q30) for type and samples per period
+
+The tables only depend on the waveform shape and length, so they are
+built once per (type, spp) and reused for every mean and amplitude. The
+values are the ones the double precision code used (sinf of a float
+phase for the sine), so scaling them gives the same DAC codes.
+        sine wave       : u= sin(2*PI*i/spp)
+        triangular wave : u= 4*i/spp        (0<i<spp/4)
+                          u= 2-4*i/spp      (spp/4<i<3*spp/4)
+                          u= -4+4*i/spp     (3*spp/4<i<spp)
+        square wave     : u= 1              (0<i<spp/2)
+                          u= -1             (spp/2<i<spp)
+        ramp (SEQ_RAMP) : u= -1+2*i/spp     (playlist segments only)
+*/
+const int32_t* unitWave(int type, int spp){
+    static int32_t unit[4][MAX_SAMPLES];
+    static int unit_spp[4] = {0, 0, 0, 0};
+    int k = (type == SEQ_RAMP) ? 3 : type-1;
+    int32_t* u = unit[k];
+    double delta_incr, x;
+    int i;
+    if(unit_spp[k] == spp)
+        return u;
+    delta_incr = (type == 1) ? 2.0*PI/spp : 4.0/spp;
+    for(i=0;i<spp;i++){
+        switch(type){
+            case 1: x = sinf((float)(i*delta_incr)); break;
+            case 2: x = (i < spp/4) ? delta_incr*i
+                      : (i < 3*spp/4) ? 2-delta_incr*i : -4+delta_incr*i; break;
+            case SEQ_RAMP: x = -1 + 2.0*i/spp; break;
+            default: x = (i < spp/2) ? 1 : -1; break;
+        }
+        u[i] = (int32_t)lrint(x*(1 << UNIT_SHIFT));
+    }
+    unit_spp[k] = spp;
+    return u;
+}
+/* out[i] = (base + gain*unit[i]) >> WAVE_SHIFT
+
+One widening multiply-add and a shift per sample with no branches, so the
+loop vectorises. The result is in [0, 65535] for parameters that pass
+checkAbsMax */
+void scaleWave(unsigned short* restrict out, const int32_t* restrict unit,
+	int n, int64_t base, int32_t gain){
+    int i;
+    for(i=0;i<n;i++)
+        out[i] = (unsigned short)((base + (int64_t)gain*unit[i]) >> WAVE_SHIFT);
+}
+/* Generate data for waveform
+
+value = mean + amp*u, with u from the unit table of the waveform. In DAC
+codes this is offset + mean/res + (amp/res)*u: the constant part is Q45
+(base) and the amplitude Q15 (gain), so each sample is one multiply-add.
+*/
+void WaveformGen (DACField* D){
+    double res;
+    int64_t base;
+    int32_t gain;
+	// Choose unipolar/bipolar DAC mode
+    chooseBestRes(D);
+	// Choose samples per period (and pacer divisor in paced mode)
+    chooseSampling(D);
+    waveAlloc(&D->data, &D->capacity, D->samples_per_period);
+	// Convert resolution to unit of V
+    res = D->output_res/1000000;
+    if(D->waveform_type>=1 && D->waveform_type<=4){
+		// Add offset for bipolar mode
+        base = (int64_t)(((D->DAC_mode<2 ? 0x7FFF : 0) + D->mean/res)*((int64_t)1 << WAVE_SHIFT));
+        gain = (int32_t)lrint(D->amp/res*(1 << GAIN_SHIFT));
+        if(D->waveform_type == 4)
+            awgFill(D, base, gain);
+        else
+            scaleWave(D->data, unitWave(D->waveform_type, D->samples_per_period),
+                D->samples_per_period, base, gain);
+    }
+	// Reset resetWave flag after finishing configuration
+    D->resetWave=false;
+    return;
+}
+// CLOCK_MONOTONIC time in ns
+int64_t monoNow(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
+/* Sample clock for the software timed loops
+
+Deadline n is start + n*period on CLOCK_MONOTONIC, so the time spent
+writing a sample is not added to the period and rounding does not build
+up: the long-run rate is that of the clock. */
+void tickerStart(Ticker* T, double period, TimingTrace* trace){
+	T->start = monoNow();
+	T->period = period;
+	T->n = 0;
+	T->trace = trace;
+}
+// Change the period, keeping the deadline just reached as sample 0
+void tickerPeriod(Ticker* T, double period){
+	T->start += (int64_t)(T->n*T->period);
+	T->period = period;
+	T->n = 0;
+}
+/* Sleep until the next deadline: clock_nanosleep (TIMER_ABSTIME) to
+calib.spin_ns before it, then spin. A late sample is sent at once so the
+clock catches up, but after a stall of more than SLIP_NS the clock
+restarts from now instead of sending the missed samples in a burst */
+void tickerWait(Ticker* T){
+	struct timespec ts;
+	int64_t deadline, now;
+	T->n++;
+	deadline = T->start + (int64_t)(T->n*T->period);
+	now = monoNow();
+	if(now - deadline > SLIP_NS){
+		T->start = now;
+		T->n = 0;
+		T->trace->slips++;
+		return;
+	}
+	if(deadline - now > calib.spin_ns){
+		ts.tv_sec = (deadline - calib.spin_ns)/1000000000;
+		ts.tv_nsec = (deadline - calib.spin_ns)%1000000000;
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+	}
+	while((now = monoNow()) < deadline);
+	traceRecord(T->trace, deadline, now);
+}
+/* Output timing trace
+
+Each output thread keeps its own trace, so recording is a few plain
+stores: the sample pair in the ring, one histogram count and the head.
+Readers take copies and never write, except the clear flag which the
+thread acts on at its next sample. The histogram has HIST_SUB buckets
+per power of two of the lateness in ns (1/HIST_SUB relative resolution).
+*/
+static inline void traceRecord(TimingTrace* R, int64_t deadline, int64_t actual){
+	unsigned long long h = R->head;
+	int64_t late = actual - deadline;
+	if(R->clear){
+		memset(R->hist, 0, sizeof(R->hist));
+		R->max_late = 0;
+		R->slips = 0;
+		R->clear = 0;
+	}
+	R->ring[h & TRACE_MASK].deadline = deadline;
+	R->ring[h & TRACE_MASK].actual = actual;
+	R->hist[histBucket(late)]++;
+	if(late > R->max_late)
+		R->max_late = late;
+	// Entry before head, for traceCopy (release pairs with its acquire)
+	__atomic_store_n(&R->head, h + 1, __ATOMIC_RELEASE);
+}
+static inline int histBucket(int64_t late){
+	int e;
+	if(late < HIST_SUB)
+		return late < 0 ? 0 : (int)late;
+	e = 63 - __builtin_clzll((unsigned long long)late);
+	if(e >= HIST_BUCKETS/HIST_SUB)
+		return HIST_BUCKETS - 1;
+	return (e - 1)*HIST_SUB + (int)((late >> (e - 2)) & (HIST_SUB - 1));
+}
+int64_t histLow(int b){
+	if(b < HIST_SUB)
+		return b;
+	return (int64_t)(HIST_SUB + b % HIST_SUB) << (b/HIST_SUB - 1);
+}
+// Upper edge of the bucket holding the q quantile
+int64_t histPercentile(const unsigned long long* hist, double q){
+	unsigned long long n = 0, sum = 0;
+	int b;
+	for(b=0;b<HIST_BUCKETS;b++)
+		n += hist[b];
+	for(b=0;b<HIST_BUCKETS-1;b++){
+		sum += hist[b];
+		if(sum >= q*n)
+			break;
+	}
+	return histLow(b + 1);
+}
+/* Copy the ring to out, oldest first, and return the number of entries.
+Entries the thread may have overwritten during the copy are dropped */
+int traceCopy(TimingTrace* R, TraceEntry* out){
+	unsigned long long h1, h2, first, drop, i;
+	h1 = __atomic_load_n(&R->head, __ATOMIC_ACQUIRE);
+	first = h1 > TRACE_SIZE ? h1 - TRACE_SIZE : 0;
+	for(i=first;i<h1;i++)
+		out[i - first] = R->ring[i & TRACE_MASK];
+	// The copy before the second look at head
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	h2 = __atomic_load_n(&R->head, __ATOMIC_RELAXED);
+	// Slots up to h2 - TRACE_SIZE may have been rewritten (or be in progress)
+	drop = h2 >= TRACE_SIZE ? h2 - TRACE_SIZE + 1 : 0;
+	if(drop <= first)
+		return (int)(h1 - first);
+	if(drop >= h1)
+		return 0;
+	memmove(out, out + (drop - first), (h1 - drop)*sizeof(TraceEntry));
+	return (int)(h1 - drop);
+}
+
+// Function to push-out data to DAC(thread function)
+void* PushDAC (void* Curr){
+	// Obtained struct pointer from pthread_create
+    DACField* Current = (DACField*) Curr;
+    WaveBuffer* cur;
+    rtOutput();
+	// A sweep and the modulator start again whenever DAC0 output starts
+    if(Current->identity == 0 && sweep.on)
+        sweepStart(&sweepRun);
+    modRun.phase = 0;
+    modRun.m = 0;
+    if(Current->identity == 0)
+        seqRestart(&seqRun);
+	// Dual mode: one loop outputs both channels
+    if(useDual){
+        PushDACDual();
+        pthread_exit(NULL);
+    }
+	// Start with the waveform published before the thread was created
+    cur = takeWave(Current);
+    if(cur == NULL)
+        cur = Current->published;
+	/* Run the waveform with the timing it needs. Both loops return the
+	next waveform if it needs the other one, or NULL when output stops */
+    while(cur != NULL){
+        if(burst.cycles && Current->identity == 0)
+            cur = PushDACBurst(Current, cur);
+        else if(cur->pacer_div)
+            cur = PushDACPaced(Current, cur);
+        else
+            cur = PushDACTimed(Current, cur);
+    }
+    pthread_exit(NULL);
+    return (0);
+}
+/* Dual channel output (called by PushDAC in --dual mode)
+
+Both channels are DDS oscillators on one software tick. Each tick writes
+DAC0 then DAC1 with both channels selected in DA_CTLREG, so the pair is
+converted on the same tick. DAC1's accumulator is set phaseOffset ahead
+of DAC0's when the offset changes, or when both channels get the same
+frequency. A channel that is off holds its last sample.
+*/
+void PushDACDual(){
+    WaveBuffer* cur[2];
+    WaveBuffer* next;
+    uint32_t phase[2], incr[2]={0, 0}, old_phase, offset;
+    unsigned short last[2], ctl;
+    Ticker T;
+    int k;
+    for(k=0;k<2;k++){
+        cur[k] = takeWave(Channel[k]);
+        if(cur[k] == NULL)
+            cur[k] = Channel[k]->published;
+        last[k] = cur[k]->data[0];
+    }
+	// Control word of both channels, written again only if a range changes
+    ctl = cur[0]->CTLREG_content | cur[1]->CTLREG_content;
+    board->out16(DA_CTLREG, ctl);
+    board->out16(DA_FIFOCLR, 0);
+    offset = phaseOffset;
+    phase[0] = 0;
+    phase[1] = offset;
+    tickerStart(&T, 1e9/DDS_RATE, &dacTrace[0]);
+    while(keepPushing(&DAC)){
+		// Re-align DAC1 to DAC0 on new offset or equal new frequencies
+        if(offset != phaseOffset || ((incr[0] != DAC.phase_incr || incr[1] != DAC1.phase_incr)
+                && DAC.phase_incr == DAC1.phase_incr)){
+            offset = phaseOffset;
+            phase[1] = phase[0] + offset;
+        }
+        incr[0] = DAC.phase_incr;
+        incr[1] = DAC1.phase_incr;
+        for(k=0;k<2;k++){
+            if(Channel[k]->isOn)
+                last[k] = cur[k]->data[phase[k] >> DDS_SHIFT];
+            board->out16(DA_Data, last[k]);
+            old_phase = phase[k];
+            phase[k] += incr[k];
+			// Period boundary of channel k: pick up its pending waveform
+            if(phase[k] < old_phase && (next = takeWave(Channel[k])) != NULL){
+                cur[k] = next;
+                if((cur[0]->CTLREG_content | cur[1]->CTLREG_content) != ctl){
+                    ctl = cur[0]->CTLREG_content | cur[1]->CTLREG_content;
+                    board->out16(DA_CTLREG, ctl);
+                }
+            }
+        }
+        tickerWait(&T);
+    }
+}
+/* Software timed output (called by PushDAC)
+
+A new waveform is picked up at the period boundary (table wrap, or phase
+accumulator wrap in DDS mode), so the output continues without a gap.
+Samples are sent on absolute deadlines (see tickerWait).
+*/
+WaveBuffer* PushDACTimed(DACField* Current, WaveBuffer* cur){
+    WaveBuffer* next;
+    Ticker T;
+    int i;
+	uint32_t phase=0, old_phase;
+	/* The control word is fixed for each waveform: write it and clear the
+	FIFO once, then only the data register is written per sample */
+	board->out16(DA_CTLREG, cur->CTLREG_content);	// Write setting to DAC CTLREG
+	board->out16(DA_FIFOCLR, 0);					// Clear DA FIFO buffer
+	/* DDS: output at a fixed tick, the top bits of the phase accumulator
+	index the table. phase_incr is re-read every tick, so frequency
+	changes take effect without restarting the thread */
+	if(useDDS){
+		tickerStart(&T, 1e9/DDS_RATE, &dacTrace[Current->identity]);
+		while(1){
+			if(!keepPushing(Current))
+				return NULL;
+			board->out16(DA_Data, ddsSample(Current, cur, phase));
+			old_phase = phase;
+			phase += ddsStep(Current);
+			// Period boundary when the accumulator wraps
+			if(phase < old_phase && (cur = swapWave(Current, cur))->pacer_div)
+				return cur;
+			tickerWait(&T);
 		}
+	}
+	// While loop to push out data
+    tickerStart(&T, cur->period_ns, &dacTrace[Current->identity]);
+    while (1){
+        for(i=0;i<cur->samples_per_period;i++) {
+			// Stop if isOperating or isOn ==false
+            if(!keepPushing(Current))
+                return NULL;
+            board->out16(DA_Data, cur->data[i]);     // Output data
+            tickerWait(&T);
+        }
+		// Period boundary: pick up a pending waveform
+        if((next = swapWave(Current, cur))->pacer_div)
+            return next;
+        if(next != cur)
+            tickerPeriod(&T, next->period_ns);
+        cur = next;
+    }
+}
+/* Pacer clocked output (called by PushDAC)
+
+The DAC pacer converts one FIFO sample per tick, so sample timing comes
+from the board. The FIFO is preloaded before the pacer is started and the
+thread then sleeps, only waking to top the FIFO up in half-FIFO blocks.
+A new waveform with the same control word and divisor is queued behind
+the old one at its period boundary. Otherwise the pacer is restarted
+with the new settings.
+*/
+WaveBuffer* PushDACPaced(DACField* Current, WaveBuffer* cur){
+    int i;
+    uint32_t phase;
+    bool restart;
+    unsigned short paced_ctl;
+    unsigned int sleep_ms;
+    while(1){
+        i=0;
+        phase=0;
+		// Sleep for the time the pacer takes to drain an eighth FIFO, so the
+		// thread wakes at least once more before a half-empty FIFO runs dry
+        sleep_ms = (unsigned int)(1000.0*DAC_FIFO_SIZE/8*cur->pacer_div/PACER_CLOCK);
+        if(sleep_ms<1) sleep_ms=1;
+		// Stay responsive to isOn at low rates
+        if(sleep_ms>50) sleep_ms=50;
+		// Stop conversions, select the pacer and clear the FIFO
+        paced_ctl = (cur->CTLREG_content & ~DAC_START) | DAC_PACER_SRC;
+        board->out16(DA_CTLREG, paced_ctl);
+        board->out16(DA_FIFOCLR, 0);
+		// Preload the whole FIFO
+        restart = fillFIFO(Current, &cur, DAC_FIFO_SIZE, &i, &phase);
+        if(!restart){
+			// Program the pacer counters as rate generators and start conversions
+            dacPacer(cur->pacer_div);
+            board->out16(DA_CTLREG, paced_ctl | DAC_START);
+        }
+		// Refill loop
+        while(!restart){
+			// Stop if isOperating or isOn ==false
+            if(!keepPushing(Current)){
+				// Stop the pacer, output holds the last converted sample
+                board->out16(DA_CTLREG, paced_ctl);
+                return NULL;
+            }
+            delay(sleep_ms);
+			// Top up one half-FIFO block at a time while there is room
+            while(!restart && (board->in16(DA_CTLREG) & DAC_HALF_EMPTY))
+                restart = fillFIFO(Current, &cur, DAC_FIFO_HALF, &i, &phase);
+        }
+		// Stop the pacer before it is set up for the new waveform
+        board->out16(DA_CTLREG, paced_ctl);
+        if(cur->pacer_div == 0)
+            return cur;
+    }
+}
+/* Write n samples to the DAC FIFO, stepping the table index or the DDS
+phase. A pending waveform is taken at the period boundary; returns true
+(with *cur set to it) if it needs a different control word or divisor,
+in which case the pacer has to be restarted */
+bool fillFIFO(DACField* Current, WaveBuffer** cur, int n, int* i, uint32_t* phase){
+    WaveBuffer *w = *cur, *next;
+    uint32_t old_phase;
+    while(n--){
+        Current->fifo_samples++;
+        if(useDDS){
+            board->out16(DA_Data, ddsSample(Current, w, *phase));
+            old_phase = *phase;
+            *phase += ddsStep(Current);
+            if(*phase >= old_phase)
+                continue;
+        }
+        else{
+            board->out16(DA_Data, w->data[*i]);
+            if(++*i < w->samples_per_period)
+                continue;
+            *i=0;
+        }
+		// Period boundary
+        if((next = takeWave(Current)) == NULL)
+            continue;
+        *cur = next;
+        if(next->CTLREG_content != w->CTLREG_content || next->pacer_div != w->pacer_div)
+            return true;
+        w = next;
+    }
+    return false;
+}
+/* Triggered burst output of DAC0 (called by PushDAC while --burst is set)
+
+The output thread is the trigger poller. It holds the mean, reads Port A
+in a tight loop (yielding the CPU between reads, which costs nothing
+when it has a CPU of its own) and on the trigger edge outputs
+burst.cycles periods from the start of the waveform, then holds the
+mean again. The first sample is worked out while armed, so the edge is
+followed by a single data write (software timing) or by the write that
+starts the pacer on a preloaded FIFO. A new waveform is only taken while
+armed, never in the middle of a burst. The time from the last Port A
+read before the edge to the first sample is kept in burstStats.
+*/
+WaveBuffer* PushDACBurst(DACField* Current, WaveBuffer* cur){
+    WaveBuffer* next;
+    BurstPos P;
+    Ticker T;
+    unsigned short paced_ctl = 0, first = 0;
+    unsigned int sleep_ms = 1;
+    uint8_t mask = 1 << burst.bit, last, in;
+    int64_t before, now;
+    int v = 0, n;
+    while(1){
+		// Hold the mean, converted at once
+        board->out16(DA_CTLREG, cur->CTLREG_content);
+        board->out16(DA_FIFOCLR, 0);
+        board->out16(DA_Data, (unsigned short)cur->center);
+        P.i = 0;
+        P.phase = 0;
+        P.periods = 0;
+        if(cur->pacer_div){
+			// Preload the FIFO with the start of the burst, pacer stopped
+            paced_ctl = (cur->CTLREG_content & ~DAC_START) | DAC_PACER_SRC;
+            board->out16(DA_CTLREG, paced_ctl);
+            board->out16(DA_FIFOCLR, 0);
+            for(n=0;n<DAC_FIFO_SIZE && (v = burstNext(Current, cur, &P)) >= 0;n++)
+                board->out16(DA_Data, (unsigned short)v);
+            if(v < 0)
+                board->out16(DA_Data, (unsigned short)cur->center);
+            dacPacer(cur->pacer_div);
+            sleep_ms = (unsigned int)(1000.0*DAC_FIFO_SIZE/8*cur->pacer_div/PACER_CLOCK);
+            if(sleep_ms<1) sleep_ms=1;
+            if(sleep_ms>50) sleep_ms=50;
+        }
+        else
+            first = (unsigned short)burstNext(Current, cur, &P);
+		// Armed: wait for the edge on the trigger bit
+        next = NULL;
+        last = board->in8(DIO_PORTA) & mask;
+        before = monoNow();
+        while(1){
+            if(!keepPushing(Current)){
+                if(cur->pacer_div)
+                    board->out16(DA_CTLREG, paced_ctl);
+                return NULL;
+            }
+            if((next = takeWave(Current)) != NULL)
+                break;
+            now = monoNow();
+            in = board->in8(DIO_PORTA) & mask;
+            if(in != last && !in == burst.falling)
+                break;
+            last = in;
+            before = now;
+            sched_yield();
+        }
+        if(next != NULL){
+            cur = next;
+            continue;
+        }
+		// Fire
+        if(cur->pacer_div){
+            board->out16(DA_CTLREG, paced_ctl | DAC_START);
+            burstRecord(monoNow() - before);
+			// Top up until the burst and the mean after it are queued
+            while(v >= 0){
+                if(!keepPushing(Current)){
+                    board->out16(DA_CTLREG, paced_ctl);
+                    return NULL;
+                }
+                delay(sleep_ms);
+                while(v >= 0 && (board->in16(DA_CTLREG) & DAC_HALF_EMPTY))
+                    for(n=0;n<DAC_FIFO_HALF;n++){
+                        if((v = burstNext(Current, cur, &P)) < 0){
+                            board->out16(DA_Data, (unsigned short)cur->center);
+                            break;
+                        }
+                        board->out16(DA_Data, (unsigned short)v);
+                    }
+            }
+			// Let the FIFO drain to the mean before the pacer is stopped
+            while(!(board->in16(DA_CTLREG) & DAC_HALF_EMPTY) && keepPushing(Current))
+                delay(sleep_ms);
+            delay((unsigned int)(1000.0*DAC_FIFO_HALF*cur->pacer_div/PACER_CLOCK) + 1);
+            board->out16(DA_CTLREG, paced_ctl);
+            continue;
+        }
+        board->out16(DA_Data, first);
+        burstRecord(monoNow() - before);
+        tickerStart(&T, useDDS ? 1e9/DDS_RATE : cur->period_ns, &dacTrace[0]);
+        tickerWait(&T);
+        while((v = burstNext(Current, cur, &P)) >= 0){
+            if(!keepPushing(Current))
+                return NULL;
+            board->out16(DA_Data, (unsigned short)v);
+            tickerWait(&T);
+        }
+    }
+}
+/* Next sample of the burst, -1 after burst.cycles periods. Periods are
+table wraps, or phase accumulator wraps in DDS mode */
+static inline int burstNext(DACField* D, const WaveBuffer* w, BurstPos* P){
+    uint32_t old;
+    int v;
+    if(P->periods >= burst.cycles)
+        return -1;
+    if(useDDS){
+        v = ddsSample(D, w, P->phase);
+        old = P->phase;
+        P->phase += ddsStep(D);
+        if(P->phase < old)
+            P->periods++;
+        return v;
+    }
+    v = w->data[P->i];
+    if(++P->i == w->samples_per_period){
+        P->i = 0;
+        P->periods++;
+    }
+    return v;
+}
+// Add a trigger to first sample latency to burstStats (output thread)
+void burstRecord(int64_t latency){
+    BurstStats* S = &burstStats;
+    if(S->clear){
+        memset(S->hist, 0, sizeof(S->hist));
+        S->max = 0;
+        S->sum = 0;
+        S->triggers = 0;
+        S->clear = 0;
+    }
+    S->hist[histBucket(latency)]++;
+    if(latency > S->max)
+        S->max = latency;
+    S->sum += latency;
+    S->triggers++;
+}
+/* Hand the waveform in D->data to the output thread
+
+The generated samples and their settings are copied into the buffer the
+output thread is not using and published through D->pending. A buffer
+still pending (not taken yet) is taken back and reused, so the buffer
+being output is never written to. Called with MainMutex held.
+*/
+void publishWave(DACField* D){
+    WaveBuffer* back;
+    back = __sync_lock_test_and_set(&D->pending, NULL);
+    if(back == NULL)
+        back = (D->published == &D->buffer[0]) ? &D->buffer[1] : &D->buffer[0];
+    waveAlloc(&back->data, &back->capacity, D->samples_per_period);
+    memcpy(back->data, D->data, D->samples_per_period*sizeof(D->data[0]));
+    back->samples_per_period = D->samples_per_period;
+	// Configure the DAC CTRL register data values
+    back->CTLREG_content = (unsigned short)(D->plus+(D->identity+0x1)*0x20+0x3);
+    back->pacer_div = D->pacer_div;
+    back->period_ns = 1000000000.0/(D->freq*D->samples_per_period);
+    back->center = (int32_t)lrint((D->DAC_mode<2 ? 0x7FFF : 0) + D->mean/(D->output_res/1000000));
+    D->published = back;
+	// Samples must be visible before the pointer
+    __sync_synchronize();
+    D->pending = back;
+    storeParams(D);
+}
+// Take the pending waveform (NULL if there is none)
+WaveBuffer* takeWave(DACField* D){
+    if(D->pending == NULL)
+        return NULL;
+    return __sync_lock_test_and_set(&D->pending, NULL);
+}
+/* Switch to the pending waveform at a period boundary (software timing),
+writing the control register only if the DAC range has changed */
+WaveBuffer* swapWave(DACField* D, WaveBuffer* cur){
+    WaveBuffer* next = takeWave(D);
+    if(next == NULL)
+        return cur;
+    if(next->CTLREG_content != cur->CTLREG_content && !next->pacer_div)
+        board->out16(DA_CTLREG, next->CTLREG_content);
+    return next;
+}
+/* Called by the output loops: false once output has to stop (DAC off or
+program quitting). The output thread never takes a lock: it clears
+pushAlive, then checks isOn again and reclaims pushAlive if the DAC was
+switched back on meanwhile. If WaveGenManager claimed it first, it has
+started a new PushDAC and this one leaves */
+bool keepPushing(DACField* D){
+    if(outputOn(D))
+        return true;
+    D->pushAlive = false;
+    __sync_synchronize();
+    return outputOn(D)
+        && __sync_bool_compare_and_swap(&D->pushAlive, 0, 1);
+}
+// True while the output thread of D has a channel to output
+bool outputOn(DACField* D){
+    return isOperating && (D->isOn || (useDual && D == &DAC && DAC1.isOn));
+}
+/* Thread for managing waveform generating capabilities
+
+Sleeps on WaveCond until change() requests a new waveform, so a change
+is handled as soon as it is made. The request number is acknowledged
+on AckCond for callers waiting in waitWaveAck.
+*/
+void* WaveGenManager (void * pointer){
+    pthread_t tid;
+    bool started = false;
+    unsigned int seq;
+    DACField* D;
+    int k;
+    pthread_mutex_lock(&MainMutex);
+    while(1){
+		// Wait for a change request (MainMutex is released while waiting)
+        while(isOperating && waveDone == waveRequest)
+            pthread_cond_wait(&WaveCond, &MainMutex);
+        if(!isOperating)
+            break;
+        seq = waveRequest;
+		/* Publish the new waveform to the running PushDAC, which
+		swaps to it at its next period boundary. Create the thread
+		only if none is running (see above descriptions)*/
+        for(k=0;k<(useDual ? 2 : 1);k++){
+            D = Channel[k];
+			// In dual mode a channel that is off still needs a waveform
+            if(D->resetWave && (D->isOn || useDual)){
+				// Set up data field for DAC
+                WaveformGen(D);
+                publishWave(D);
+            }
+        }
+		// The thread on DAC0 outputs DAC1 as well in dual mode
+        if(outputOn(&DAC) && DAC.published && (!useDual || DAC1.published)
+                && __sync_bool_compare_and_swap(&DAC.pushAlive, 0, 1)){
+            if(started)
+                pthread_join(tid, NULL);
+            pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+            started = true;
+        }
+		// Acknowledge every request, including those with nothing to do
+        waveDone = seq;
+        pthread_cond_broadcast(&AckCond);
+    }
+    DAC.isOn = false;
+    DAC1.isOn = false;
+    storeParams(&DAC);
+    storeParams(&DAC1);
+    pthread_mutex_unlock(&MainMutex);
+    if(started)
+        pthread_join(tid, NULL);
+    pthread_exit(NULL);
+}
+/* Grow a sample array to hold n samples. Waveform buffers are only
+grown by WaveGenManager, on buffers the output thread is not using */
+void waveAlloc(unsigned short** data, int* capacity, int n){
+    unsigned short* p;
+    if(n <= *capacity)
+        return;
+    if((p = realloc(*data, n*sizeof(unsigned short))) == NULL){
+        perror("waveAlloc");
+        exit(EXIT_FAILURE);
+    }
+    *data = p;
+    *capacity = n;
+}
+
+//*************************************************************//
+//                Arbitrary waveform (AWG) files
+//*************************************************************//
+/* Map an arbitrary waveform file (MainMutex held once threads run)
+
+The file is memory-mapped read-only and scanned once for the number of
+samples and their range, so loading it allocates nothing. What is
+played is the table awgFill resamples from the mapping into D->data,
+one DAC code per output sample, handed to the output thread in the wave
+buffers like the other waveforms. Software timed at the file's own rate
+that table is the whole file (2 bytes a sample), so a file only has to
+fit in memory as samples when it is longer than AWG_MAX_RATE/freq.
+rate is the sample rate of the file, 0 for the default (the capture rate
+of a --capture file, AWG_RATE otherwise). The previous file stays loaded
+if this one cannot be used. */
+bool awgLoad(const char* file, float rate){
+    AwgSource S;
+    AwgCursor c;
+    CaptureHeader hdr;
+    struct stat st;
+    const char* ext;
+    float v;
+    int fd, i;
+    memset(&S, 0, sizeof(S));
+    strncpy(S.name, file, sizeof(S.name) - 1);
+    if((fd = open(file, O_RDONLY)) == -1){
+        perror(file);
+        return false;
+    }
+    if(fstat(fd, &st) == -1 || st.st_size == 0){
+        printf("%s is empty.\n", file);
+        close(fd);
+        return false;
+    }
+    S.bytes = st.st_size;
+    S.map = mmap(NULL, S.bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(S.map == MAP_FAILED){
+        perror("mmap");
+        return false;
+    }
+	// Format from the capture header or the file name
+    ext = strrchr(file, '.');
+    S.stride = 1;
+    S.rate = rate > 0 ? rate : AWG_RATE;
+    if(S.bytes >= sizeof(hdr) && memcmp(S.map, CAPTURE_MAGIC, 4) == 0){
+        memcpy(&hdr, S.map, sizeof(hdr));
+        S.format = AWG_CAPTURE;
+        S.first = hdr.header_size;
+        S.stride = hdr.channels ? hdr.channels : 1;
+        S.samples = (int)((S.bytes - S.first)/sizeof(uint16_t)/S.stride);
+        if(rate <= 0)
+            S.rate = hdr.rate/S.stride;
+    }
+    else if(ext != NULL && (strcmp(ext, ".csv") == 0 || strcmp(ext, ".txt") == 0)){
+        S.format = AWG_CSV;
+        S.samples = -1;
+    }
+    else{
+        S.format = AWG_FLOAT;
+        S.samples = (int)(S.bytes/sizeof(float));
+    }
+	// Count the CSV samples and find the range of all formats
+    c.S = &S;
+    awgRewind(&c);
+    for(i=0;S.samples < 0 || i < S.samples;i++){
+        if(S.format == AWG_CSV && c.pos >= S.bytes)
+            break;
+        v = awgNext(&c);
+        if(S.format == AWG_CSV && c.index == 0)
+            break;
+        if(i == 0 || v < S.min)
+            S.min = v;
+        if(i == 0 || v > S.max)
+            S.max = v;
+    }
+    S.samples = i;
+    if(S.samples == 0){
+        printf("No samples in %s.\n", file);
+        munmap((void*)S.map, S.bytes);
+        return false;
+    }
+    if(awg.map != NULL)
+        munmap((void*)awg.map, awg.bytes);
+    awg = S;
+    printf("%s: %d samples at %.1f S/s, %.3f to %.3f V\n", awg.name, awg.samples,
+        awg.rate, awg.min, awg.max);
+    return true;
+}
+/* Output samples per repetition of the AWG file at D->freq
+
+Software timed: the file's own samples if the rate stays below
+AWG_MAX_RATE, fewer otherwise. Paced: as many samples as the pacer range
+allows, choosing among the closest counts the pair with the smallest
+frequency error (as chooseSampling does). */
+void awgSampling(DACField* D){
+    double m, ticks, err, best_err=-1;
+    long spp, low;
+    uint32_t div;
+    unsigned int div1, div2;
+    m = awg.samples;
+    if(m*D->freq > (usePacer ? (double)PACER_CLOCK/PACER_MINDIV : AWG_MAX_RATE))
+        m = (usePacer ? (double)PACER_CLOCK/PACER_MINDIV : AWG_MAX_RATE)/D->freq;
+    if(usePacer && m*D->freq < (double)PACER_CLOCK/PACER_MAXTOTAL)
+        m = ceil((double)PACER_CLOCK/PACER_MAXTOTAL/D->freq);
+    if(m < AWG_MIN_SAMPLES)
+        m = AWG_MIN_SAMPLES;
+    D->samples_per_period = (int)m;
+    if(!usePacer)
+        return;
+    ticks = PACER_CLOCK/D->freq;
+    low = (long)m - (long)m/64;
+    for(spp=(long)m;spp>=low && spp>=AWG_MIN_SAMPLES;spp--){
+        if(ticks/spp + 0.5 < PACER_MINDIV || ticks/spp + 0.5 > PACER_MAXTOTAL)
+            continue;
+        div = pacerSplit((uint32_t)(ticks/spp + 0.5), &div1, &div2);
+        err = fabs((double)div*spp - ticks)/ticks;
+        if(best_err<0 || err<best_err){
+            best_err = err;
+            D->samples_per_period = (int)spp;
+            D->pacer_div = div;
+        }
+        if(err<1e-4)
+            break;
+    }
+}
+/* Resample the AWG file into D->data
+
+The file's range maps to u in [-1, 1], so the samples are mean + amp*u
+as for the other waveforms (awgDefault gives back the file's volts).
+Upsampling interpolates linearly between neighbouring samples, wrapping
+from the last one to the first. Downsampling averages the samples that
+fall in each output sample so higher frequencies do not alias back.
+The file is read once from start to end in both cases. */
+void awgFill(DACField* D, int64_t base, int32_t gain){
+    AwgCursor c;
+    int n = awg.samples, m = D->samples_per_period, j, s = 0, k;
+    double mid, scale, x, v, prev, next, sum;
+    long long end;
+    mid = (awg.max + awg.min)/2;
+    scale = awg.max > awg.min ? 2.0/(awg.max - awg.min) : 0;
+    if(n == 0){
+        for(j=0;j<m;j++)
+            D->data[j] = (unsigned short)(base >> WAVE_SHIFT);
+        return;
+    }
+    c.S = &awg;
+    awgRewind(&c);
+    if(m >= n){
+        prev = awgNext(&c);
+        next = awgNext(&c);
+        for(j=0;j<m;j++){
+            x = (double)j*n/m;
+            while(s + 1 <= x){
+                prev = next;
+                next = awgNext(&c);
+                s++;
+            }
+            v = prev + (x - s)*(next - prev);
+            k = (int)lrint((v - mid)*scale*(1 << UNIT_SHIFT));
+            D->data[j] = (unsigned short)((base + (int64_t)gain*k) >> WAVE_SHIFT);
+        }
+        return;
+    }
+    for(j=0;j<m;j++){
+        end = (long long)(j + 1)*n/m;
+        for(sum=0,k=0;s<end;s++,k++)
+            sum += awgNext(&c);
+        k = (int)lrint((sum/k - mid)*scale*(1 << UNIT_SHIFT));
+        D->data[j] = (unsigned short)((base + (int64_t)gain*k) >> WAVE_SHIFT);
+    }
+}
+void awgRewind(AwgCursor* c){
+    c->pos = c->S->first;
+    c->index = 0;
+}
+/* Next sample in volts. CSV lines without a number (headers, blank lines)
+are skipped, and in a line with several columns (time,value) the last
+number is the sample */
+float awgNext(AwgCursor* c){
+    const AwgSource* S = c->S;
+    const char *p, *end, *tok;
+    char number[AWG_NUMBER];
+    float v = 0;
+    uint16_t count;
+    int len;
+    bool found = false;
+    if(c->index >= S->samples && S->samples > 0)
+        awgRewind(c);
+    switch(S->format){
+        case AWG_FLOAT: {
+            memcpy(&v, S->map + c->pos, sizeof(float));
+            c->pos += sizeof(float);
+            break;
+        }
+        case AWG_CAPTURE: {
+            memcpy(&count, S->map + c->pos, sizeof(count));
+            v = (count - 32768)*10.0f/32768;
+            c->pos += S->stride*sizeof(uint16_t);
+            break;
+        }
+        default: {
+            while(!found){
+                if(c->pos >= S->bytes){
+					// End of file: wrap (while counting, report it)
+                    awgRewind(c);
+                    if(S->samples <= 0)
+                        return 0;
+                }
+                p = S->map + c->pos;
+                end = memchr(p, '\n', S->bytes - c->pos);
+                if(end == NULL)
+                    end = S->map + S->bytes;
+                c->pos = end - S->map + 1;
+				// Last field of the line that is a number
+                while(p < end){
+                    while(p < end && strchr(" \t\r,;", *p))
+                        p++;
+                    for(tok=p;p < end && !strchr(" \t\r,;", *p);p++);
+                    len = p - tok;
+                    if(len > 0 && len < AWG_NUMBER){
+                        memcpy(number, tok, len);
+                        number[len] = '\0';
+                        v = strtod(number, (char**)&tok);
+                        if(*tok == '\0')
+                            found = true;
+                    }
+                }
+            }
+        }
+    }
+    c->index++;
+    return v;
+}
+/* Repetition rate and scaling that replay the AWG file at its own rate
+and volts. A file that goes beyond +/-10V (or is not in volts) is scaled
+down to fit; chooseBestRes then picks the DAC range for it */
+void awgDefault(ChangeField* CF){
+    float peak;
+    CF->freq = awg.rate/awg.samples;
+    CF->mean = (awg.max + awg.min)/2;
+    CF->amp = (awg.max - awg.min)/2;
+    peak = fabs(CF->mean) + CF->amp;
+    if(peak > 9.99){
+        CF->mean *= 9.99/peak;
+        CF->amp *= 9.99/peak;
+    }
+}
+
+//*************************************************************//
+//                   Playlists (sequencer)
+//*************************************************************//
+/* Load a playlist for DAC0
+
+Every segment is rendered into its own DDS table up front, all in the
+one DAC range that holds the whole list (chooseBestRes on its overall
+span), so the output thread switches segments at a tick without writing
+the control register, regenerating or asking WaveGenManager. Segments
+are -sin, -tri, -squ or -saw (a ramp from mean-amp to mean+amp). CF gets
+the overall settings, which DAC0 has to be changed to for that range
+(a ramp first segment sets DAC0 to a triangle, DAC0 has no ramp). The
+list goes to the output thread through seqPending as WaveBuffer does
+through pending, and replaces the one it plays at the next tick. A list
+taken back from seqPending is only written once a segment is valid, and
+is handed over again if the file has none.
+Called with MainMutex held (unitWave) or before the threads start.
+*/
+bool seqLoad(const char* file, ChangeField* CF){
+    FILE* fd;
+    Playlist* L;
+    SeqSegment* seg;
+    DACField T;
+    char line[SEQ_LINE], type[16];
+    float seconds, freq, mean, amp, lo = 1e9, hi = -1e9;
+    double res;
+    int64_t base;
+    int32_t gain;
+    int n = 0, repeat = 1, number = 0, i, wtype;
+    Playlist* taken;
+    if((fd = fopen(file, "r")) == NULL){
+        perror(file);
+        return false;
+    }
+	// Take back a list not taken yet, or use the one not being played
+    L = taken = __sync_lock_test_and_set(&seqPending, NULL);
+    if(L == NULL)
+        L = (seqPublished == &seqLists[0]) ? &seqLists[1] : &seqLists[0];
+    while(fgets(line, sizeof(line), fd) != NULL){
+        number++;
+        if(sscanf(line, " %15s", type) != 1 || type[0] == '#')
+            continue;
+        if(sscanf(line, " repeat %d", &repeat) == 1 && repeat >= 0)
+            continue;
+        if(sscanf(line, "%f %15s %f %f %f", &seconds, type, &freq, &mean, &amp) != 5){
+            printf("%s:%d: expected <seconds> <-sin|-tri|-squ|-saw> <frequency> <mean> <amplitude>\n",
+                file, number);
+            continue;
+        }
+        if(n == L->capacity){
+            seg = realloc(L->seg, (L->capacity + 16)*sizeof(SeqSegment));
+            if(seg == NULL){
+                printf("Out of memory for the playlist.\n");
+                break;
+            }
+            L->seg = seg;
+            L->capacity += 16;
+        }
+        seg = &L->seg[n];
+        wtype = strcmp(type, "-sin") == 0 ? 1 : strcmp(type, "-tri") == 0 ? 2
+            : strcmp(type, "-squ") == 0 ? 3 : strcmp(type, "-saw") == 0 ? SEQ_RAMP : 0;
+        if(wtype == 0)
+            printf("%s:%d: invalid waveform %s\n", file, number, type);
+        else if(freq <= 0 || freq >= maxFreq())
+            printf("%s:%d: frequency must be in the range (0, %.0f) Hz\n", file, number, maxFreq());
+        else if(checkAbsMax(mean, amp) == 0)
+            printf("%s:%d: out of range mean and amplitude %.2f V, %.2f V\n", file, number, mean, amp);
+        else if(seconds*ddsRate() < 1)
+            printf("%s:%d: segment shorter than a DDS tick\n", file, number);
+        else{
+            seg->waveform_type = wtype;
+            seg->seconds = seconds;
+            seg->freq = freq;
+            seg->mean = mean;
+            seg->amp = amp;
+            lo = fmin(lo, mean - amp);
+            hi = fmax(hi, mean + amp);
+            n++;
+        }
+    }
+    fclose(fd);
+    if(n == 0){
+        printf("%s has no valid segment.\n", file);
+		// The list taken back is unchanged: hand it over again
+        if(taken != NULL)
+            seqPending = taken;
+        return false;
+    }
+	// DAC range of the whole list
+    memcpy(&T, &DAC, sizeof(T));
+    T.mean = (hi + lo)/2;
+    T.amp = (hi - lo)/2;
+    chooseBestRes(&T);
+    res = T.output_res/1000000;
+    for(i=0;i<n;i++){
+        seg = &L->seg[i];
+        base = (int64_t)(((T.DAC_mode<2 ? 0x7FFF : 0) + seg->mean/res)*((int64_t)1 << WAVE_SHIFT));
+        gain = (int32_t)lrint(seg->amp/res*(1 << GAIN_SHIFT));
+        scaleWave(seg->data, unitWave(seg->waveform_type, DDS_TABLE_SIZE), DDS_TABLE_SIZE, base, gain);
+        seg->center = (int32_t)(base >> WAVE_SHIFT);
+        seg->incr = ddsIncrement(seg->freq);
+        seg->ticks = (unsigned long long)llround(seg->seconds*ddsRate());
+    }
+    strncpy(L->name, file, sizeof(L->name) - 1);
+    L->name[sizeof(L->name) - 1] = '\0';
+    L->count = n;
+    L->repeat = repeat;
+    CF->waveform_type = L->seg[0].waveform_type == SEQ_RAMP ? 2 : L->seg[0].waveform_type;
+    CF->freq = L->seg[0].freq;
+    CF->mean = T.mean;
+    CF->amp = T.amp;
+    seqPublished = L;
+	// Segments must be visible before the pointer
+    __sync_synchronize();
+    seqPending = L;
+    if(repeat)
+        printf("Playlist %s: %d segments, %d passes\n", file, n, repeat);
+    else
+        printf("Playlist %s: %d segments, repeated until stopped\n", file, n);
+    return true;
+}
+// End the playlist of DAC0: an empty list is handed over
+void seqStop(){
+    Playlist* L = __sync_lock_test_and_set(&seqPending, NULL);
+    if(L == NULL)
+        L = (seqPublished == &seqLists[0]) ? &seqLists[1] : &seqLists[0];
+    L->count = 0;
+    seqPublished = L;
+    __sync_synchronize();
+    seqPending = L;
+}
+// Take the loaded playlist (output thread of DAC0, at a tick)
+void seqTake(SeqState* S){
+    Playlist* L = __sync_lock_test_and_set(&seqPending, NULL);
+    if(L == NULL)
+        return;
+    S->list = L->count ? L : NULL;
+    seqRestart(S);
+}
+// Start the playlist from its first segment (output thread of DAC0)
+void seqRestart(SeqState* S){
+    S->index = 0;
+    S->passes = 0;
+    S->done = false;
+    S->seg = S->list != NULL ? &S->list->seg[0] : NULL;
+    S->left = S->seg != NULL ? S->seg->ticks : 0;
+}
+/* Phase increment of the next playlist tick
+
+A segment lasts its number of ticks exactly, and the next one starts on
+the following tick with the phase where the last one left it. After the
+last pass the increment is 0 and ddsSample holds the mean of the last
+segment */
+static inline uint32_t seqNext(SeqState* S){
+    uint32_t incr;
+    if(S->done)
+        return 0;
+    incr = S->seg->incr;
+    if(--S->left == 0)
+        seqTurn(S);
+    return incr;
+}
+// End of a segment: next segment, next pass or end of the list
+void seqTurn(SeqState* S){
+    const Playlist* L = S->list;
+    if(++S->index == L->count){
+        S->passes++;
+        if(L->repeat && S->passes >= (unsigned long long)L->repeat){
+            S->index = L->count - 1;
+            S->done = true;
+            return;
+        }
+        S->index = 0;
+    }
+    S->seg = &L->seg[S->index];
+    S->left = S->seg->ticks;
+}
+
+
+//*************************************************************//
+//        Input manager for switches and analogue inputs
+//*************************************************************//
+void * PeripheralInputs(void *pointer){
+	bool isOn = false;
+	bool hasChanged = false;
+	unsigned short mean_amp=0;
+	unsigned short wavef = 1;
+	float temp;
+	ChangeField CField;
+	rtDemote();
+	// Paced scan of both potentiometers, taken on the end of acquisition interrupt
+	if(!adcAttach())
+		printf("ADC interrupt not attached. Reading the ADC FIFO every %d ms instead.\n", ADC_KNOB_MS);
+	// Port A : Input,  Port B : Output,  Port C (upper | lower) : Output | Output
+	board->out8(DIO_CTLREG,0x90);
+	while(1){
+		// Exit thread if isOperating is false
+        if(!isOperating){
+            adcDetach();
+            pthread_exit(NULL);
+        }
+		// Load the CField with default DAC values
+		setChangeField(&CField);
+		temp=0;
+		// Read potentiometers, blocking until the scan interrupt (skip if it timed out)
+		if(!adcScan(adc_in))
+			continue;
+
+		// Read Port A
+		digital_in =board->in8(DIO_PORTA);
+		// Output Port A value -> write to Port B (LEDs)
+		board->out8(DIO_PORTB, digital_in);
+
+		// Remove unneeded bits
+		digital_in = digital_in & 0x0f;
+
+		// Continue if the peripheral input is turned off
+		if (!(digital_in & 0x08))  continue;
+
+		else {
+			// Assume the DAC to be on
+			isOn = true;
+			switch ((digital_in & 0x03)) {
+				case 1: { wavef = 1; break; }
+				case 2: { wavef = 2; break; }
+				case 3: { wavef = 3; break; }
+				// Set isOn to be off is bit 0 and 1 are off
+				default:   { isOn = false; break; }
+			}
+			/* Only set the hasChanged flag if the current
+			configuration is different from the previous one */
+			if (CField.waveform_type != wavef) {
+				CField.waveform_type = wavef;
+				hasChanged = true;
+			}
+			if (CField.isOn != isOn) {
+				CField.isOn = isOn;
+				hasChanged = true;
+			}
+			// Get the bit value of bit 2
+			mean_amp = ((digital_in & 0x04) >> 2);
+			/*
+			ADC[0] - for mean and amplitude
+			- check whether the difference in new & old values is
+			more than threshold before trying to change
+			*/
+			if (abs((int)adc_in[0] - (int)old_adc_in[0]) > THRESHOLD) {
+				// Change amplitude if bit 2 is set
+				if (mean_amp == 1) {
+					temp = (float)(adc_in[0]) * 10 / 65535;
+					// Range checking
+					if (fabs(CField.mean + temp) < 9.8 && fabs(CField.mean - temp) < 9.8) {
+						CField.amp = temp;
+						hasChanged = true;
+					}
+				}
+				// Change mean if bit 2 is not set
+				else {
+					temp = (float)(adc_in[0]) * 10 / 32767 - 10;
+					// Range checking
+					if (fabs(CField.amp + temp) < 9.8 && fabs(CField.amp - temp) < 9.8) {
+						CField.mean = temp;
+						hasChanged = true;
+					}
+				}
+			}
+			/*
+			ADC[1] - dedicated for frequency
+			- check whether the difference in new & old values is
+			more than threshold before trying to change
+			*/
+			if (abs((int)adc_in[1] - (int)old_adc_in[1])>THRESHOLD) {
+				// Minimum input required (> 0x01)
+				if (adc_in[1] > 0x0001) {
+					CField.freq = (float)(adc_in[1]) * HIGHESTFREQ / 65535;
+					hasChanged = true;
+				}
+				else{
+					CField.freq = (float)(0x0001) * HIGHESTFREQ / 65535;
+					hasChanged = true;
+				}
+			}
+
+			// Change the value(s) if hasChanged flag is set
+			if (hasChanged) {
+				// Use of mutex when changing shared global variables
+				pthread_mutex_lock(&MainMutex);
+				change(CField.isOn, wavef, CField.freq, CField.mean, CField.amp);
+				pthread_mutex_unlock(&MainMutex);
+                hasChanged = false;
+				// Load new values to old values array
+                old_adc_in[0] = adc_in[0];
+                old_adc_in[1] = adc_in[1];
+			}
+		}
+	}
+	return(0);
+}
+/* Start the knob scan: each tick of the ADC pacer, ADC_KNOB_HZ times a
+second, converts channels 0 and 1 in one burst, with no software start
+and no timer. Attaches the board interrupt (end of acquisition, once per
+burst) to this thread. Returns false if there is no interrupt, adcScan
+then reads the FIFO a little over ADC_KNOB_MS after each restart */
+bool adcAttach(){
+	bool irq = adc_irq >= 0 && board->ioPriv();
+	board->out16(TRIGGER, 0x2081);						// Pacer stopped while set up
+	board->out16(MUXCHAN, ADC_SCAN_MUX);				// Scan CHL..CHH
+	adcPacer(ADC_KNOB_HZ);
+	board->out16(AD_FIFOCLR, 0);
+	// The interrupt is masked when it fires until intrUnmask
+	if(irq)
+		adc_iid = board->intrAttach(adc_irq);
+	if(adc_iid != -1)
+		board->out16(INTERRUPT, ADC_INTCTL);			// Interrupt at the end of each burst
+	board->out16(TRIGGER, ADC_KNOB_TRIG);
+	return adc_iid != -1;
+}
+// Stop the knob scan and detach the ADC interrupt
+void adcDetach(){
+	board->out16(TRIGGER, 0x2081);
+	board->out16(INTERRUPT, 0x60c0);
+	board->out16(AD_FIFOCLR, 0);
+	if(adc_iid == -1)
+		return;
+	board->intrDetach(adc_iid);
+	adc_iid = -1;
+}
+/* Latest scan of ADC channels 0 and 1 from the paced knob scan
+
+The thread blocks in intrWait until a burst has converted both
+channels, reads the two words of that burst, then clears and unmasks
+the interrupt. Conversions are stopped and the FIFO cleared before the
+pacer is enabled again, so that a late wakeup (bursts coalesced in one
+interrupt) never leaves an older scan in the FIFO for the next call:
+the FIFO only ever holds the one burst being read. Returns false if the
+interrupt does not come within ADC_TIMEOUT_NS.
+*/
+bool adcScan(uint16_t* out){
+	int i;
+	if(adc_iid != -1){
+		if(board->intrWait(ADC_TIMEOUT_NS) == -1)
+			return false;
+	}
+	else
+		delay(ADC_KNOB_MS + 1);
+	for(i=0;i<ADC_SCAN_CHANNELS;i++)
+		out[i] = board->in16(AD_DATA);
+	board->out16(TRIGGER, 0x2081);
+	board->out16(AD_FIFOCLR, 0);
+	board->out16(TRIGGER, ADC_KNOB_TRIG);
+	if(adc_iid != -1){
+		board->out16(INTERRUPT, ADC_INTCTL | ADC_EOA_CLR);
+		board->intrUnmask(adc_irq, adc_iid);
+	}
+	return true;
+}
+
+//*************************************************************//
+//                 ADC capture (data logger)
+//*************************************************************//
+/* Capture ADC channels 0..chans-1 to file at rate conversions/s
+
+The ADC pacer clocks a continuous scan into the ADC FIFO. CaptureADC
+takes each half FIFO on its interrupt and pushes it into capRing, and
+CaptureWriter drains the ring to the file in CAPTURE_BLOCK writes. The
+header is rewritten at the end with the sample and overrun counts.
+*/
+int runCapture(const char* file, float rate, int chans, float seconds){
+    CaptureHeader hdr;
+    pthread_t producer, writer;
+    struct timespec t0, t1;
+    double wall;
+    int fd;
+    if(chans < 1 || chans > 16 || rate <= 0 || rate > ADC_MAX_RATE){
+        printf("Capture needs 1 to 16 channels and a rate in (0, %d] S/s\n", ADC_MAX_RATE);
+        return 1;
+    }
+    fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        perror(file);
+        return 1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CAPTURE_MAGIC, 4);
+    hdr.version = CAPTURE_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.first_channel = 0;
+    hdr.channels = chans;
+    hdr.gain = (ADC_SCAN_MUX >> 8) & 0x0f;
+    hdr.rate = adcPacer(rate);
+    if(write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)){
+        perror(file);
+        close(fd);
+        return 1;
+    }
+	// Scan channels 0..chans-1 continuously
+    board->out16(MUXCHAN, 0x0D00 | ((chans-1) << 4));
+    board->out16(AD_FIFOCLR, 0);
+    capRing.head = capRing.tail = 0;
+    capOverruns = capFifoOverflows = capWritten = 0;
+    capturing = true;
+    captureDone = false;
+    printf("\nCapturing %d channel(s) at %.1f S/s to %s\n", chans, hdr.rate, file);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&writer, NULL, &CaptureWriter, (void*)(intptr_t)fd);
+    pthread_create(&producer, NULL, &CaptureADC, NULL);
+	// Run for the given time, or until a key is pressed
+    if(seconds > 0)
+        delay((unsigned int)(seconds*1000));
+    else{
+        printf("Press Enter to stop\n");
+        while(capturing && tcischars(0) == 0)
+            delay(100);
+    }
+    capturing = false;
+    pthread_join(producer, NULL);
+    pthread_join(writer, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+	// Final counts in the header
+    hdr.samples = capWritten;
+    hdr.overruns = capOverruns + capFifoOverflows*ADC_FIFO_SIZE;
+    if(pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        perror(file);
+    close(fd);
+    printf("%llu samples in %.2f s (%.1f S/s), %llu overrun samples, "
+        "%llu ADC FIFO overflows\n", capWritten, wall, capWritten/wall,
+        capOverruns, capFifoOverflows);
+    return capOverruns || capFifoOverflows;
+}
+/* Program the ADC pacer (counters 1 and 2 in cascade of the 8254 at
+BADR3 + 0..3, the other 8254 paces the DAC) for rate conversions/s and
+return the rate actually set */
+double adcPacer(float rate){
+    unsigned long total = (unsigned long)(PACER_CLOCK/rate + 0.5);
+    unsigned long div1, div2 = 2;
+	// Smallest second divisor that leaves the first one in 16 bits
+    while(total/div2 > PACER_MAXDIV)
+        div2++;
+    div1 = total/div2;
+    if(div1 < 2)
+        div1 = 2;
+    board->out8(COUNTCTL, PACER_C1_MODE2);
+    board->out8(TIMER1, div1 & 0xff);
+    board->out8(TIMER1, (div1 >> 8) & 0xff);
+    board->out8(COUNTCTL, PACER_C2_MODE2);
+    board->out8(TIMER2, div2 & 0xff);
+    board->out8(TIMER2, (div2 >> 8) & 0xff);
+    return (double)PACER_CLOCK/(div1*div2);
+}
+/* Producer thread: half a FIFO per interrupt into capRing
+
+Blocks are whole scans (at most ADC_FIFO_HALF samples), so the channels
+stay interleaved in order whatever is dropped. Blocks are read for as
+long as the FIFO stays half full, so a late wakeup empties the backlog
+instead of leaving it to overflow. Nothing is blocked on: a
+block that does not fit in the ring is dropped and counted in
+capOverruns. After a board FIFO overflow (latched status bit) the rest
+of the FIFO is no longer contiguous, so the scan is restarted from the
+first channel.
+*/
+void* CaptureADC(void* pointer){
+    uint16_t block[ADC_FIFO_HALF];
+    unsigned int head, n, first, len, i;
+    unsigned short mux = board->in16(MUXCHAN);
+    int iid;
+    (void)pointer;
+	// Samples in the whole scans that fit in half the FIFO
+    len = ((mux >> 4) & 0x0f) - (mux & 0x0f) + 1;
+    len = ADC_FIFO_HALF - ADC_FIFO_HALF % len;
+    rtOutput();
+    if(!board->ioPriv()){
+        capturing = false;
+        captureDone = true;
+        return NULL;
+    }
+    iid = board->intrAttach(adc_irq);
+    if(iid == -1){
+        printf("ADC interrupt not attached. Capture stopped.\n");
+        capturing = false;
+        captureDone = true;
+        return NULL;
+    }
+	// Interrupt at half full, then start the pacer
+    board->out16(INTERRUPT, 0x60c0 | ADC_INTE | ADC_INT_HALF);
+    board->out16(TRIGGER, (0x2081 & ~ADC_TRIGSRC) | ADC_TRIG_PACER);
+    while(capturing){
+        if(board->intrWait(100000000) == -1)
+            continue;
+        do{
+            for(i=0;i<len;i++)
+                block[i] = board->in16(AD_DATA);
+            if(board->in16(INTERRUPT) & ADC_FIFO_OVF){
+                capFifoOverflows++;
+                board->out16(TRIGGER, 0x2081);
+                board->out16(MUXCHAN, mux);
+                board->out16(AD_FIFOCLR, 0);
+                board->out16(TRIGGER, (0x2081 & ~ADC_TRIGSRC) | ADC_TRIG_PACER);
+            }
+            board->out16(INTERRUPT, 0x60c0 | ADC_INTE | ADC_INT_HALF | ADC_HALF_CLR);
+			// Push the block (in two parts where the ring wraps)
+            head = capRing.head;
+            if(CAPTURE_RING_SIZE - (head - capRing.tail) < len)
+                capOverruns += len;
+            else{
+                first = head & CAPTURE_RING_MASK;
+                n = CAPTURE_RING_SIZE - first < len ? CAPTURE_RING_SIZE - first : len;
+                memcpy(&capRing.data[first], block, n*sizeof(uint16_t));
+                memcpy(&capRing.data[0], block + n, (len - n)*sizeof(uint16_t));
+				// Samples must be visible before the new head
+                __sync_synchronize();
+                capRing.head = head + len;
+            }
+        }while(capturing && (board->in16(INTERRUPT) & ADC_HALF_STAT));
+        board->intrUnmask(adc_irq, iid);
+    }
+	// Stop the pacer
+    board->out16(TRIGGER, 0x2081);
+    board->out16(INTERRUPT, 0x60c0);
+    board->out16(AD_FIFOCLR, 0);
+    board->intrDetach(iid);
+    captureDone = true;
+    return NULL;
+}
+/* Consumer thread: write capRing to the file (descriptor in pointer) in
+blocks of CAPTURE_BLOCK samples, and the rest once the capture stops */
+void* CaptureWriter(void* pointer){
+    int fd = (int)(intptr_t)pointer;
+    unsigned int tail, n;
+    bool done;
+    while(1){
+        done = captureDone;
+        tail = capRing.tail;
+        n = capRing.head - tail;
+        if(n == 0 && done)
+            break;
+        if(n < CAPTURE_BLOCK && !done){
+            delay(10);
+            continue;
+        }
+		// Contiguous part up to the end of the ring
+        if(n > CAPTURE_BLOCK)
+            n = CAPTURE_BLOCK;
+        if(n > CAPTURE_RING_SIZE - (tail & CAPTURE_RING_MASK))
+            n = CAPTURE_RING_SIZE - (tail & CAPTURE_RING_MASK);
+        __sync_synchronize();
+        if(write(fd, &capRing.data[tail & CAPTURE_RING_MASK], n*sizeof(uint16_t))
+                != (ssize_t)(n*sizeof(uint16_t))){
+            perror("capture write");
+            capturing = false;
+            break;
+        }
+        capWritten += n;
+		// Release the space only after the samples are written
+        __sync_synchronize();
+        capRing.tail = tail + n;
+    }
+    return NULL;
+}
+
+
+//*************************************************************//
+//                 Streaming playback
+//*************************************************************//
+/* Play file once through DAC0 at rate samples/s (0 = from the file)
+
+The file can be far larger than memory. StreamReader reads it in
+sequential pread() calls of STREAM_BLOCK samples and converts them into
+strRing, keeping up to depth blocks ahead of the output. The pages it
+has read are dropped from the cache behind it, so an hours-long replay
+does not push everything else out. A mapping is not used: it would not
+fit the address space of a 32-bit target, and --rt locks it all. The
+output thread (StreamOut) only reads strRing and never waits on the
+file: a sample that is not converted in time is an underrun and the DAC
+holds the last one. Stops at the end of the file, after seconds (if > 0)
+or when a key is pressed. A negative rate (benchmarks) outputs samples
+as fast as they come.
+*/
+int runStream(const char* file, float rate, int depth, float seconds){
+    StreamSource S;
+    pthread_t reader, output;
+    struct timespec t0, t1;
+    double wall;
+    int tick = 0;
+    if(!streamOpen(file, rate, &S))
+        return 1;
+	// Ring of a power of two blocks
+    for(strRing.size=STREAM_BLOCK;strRing.size < (unsigned long)depth*STREAM_BLOCK;strRing.size*=2);
+    strRing.data = malloc(strRing.size*sizeof(uint16_t));
+    if(strRing.data == NULL){
+        perror("runStream");
+        close(S.fd);
+        return 1;
+    }
+    strRing.head = strRing.tail = strRing.next = strRing.seen = 0;
+    strRing.eof = false;
+    strUnderruns = strRead = 0;
+    memset(&dacTrace[0], 0, sizeof(dacTrace[0]));
+    streaming = true;
+    streamDone = false;
+    if(S.rate > 0)
+        printf("\nStreaming %llu samples (%.1f s) at %.1f S/s%s from %s, %lu samples prefetched\n",
+            S.samples, S.samples/S.rate, S.rate, S.pacer_div ? " (pacer)" : "", file, strRing.size);
+    else
+        printf("\nStreaming %llu samples from %s as fast as possible\n", S.samples, file);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_create(&reader, NULL, &StreamReader, &S);
+	// Let the reader get ahead before the output starts
+    while(strRing.head < strRing.size/2 && !strRing.eof)
+        delay(1);
+    pthread_create(&output, NULL, &StreamOut, &S);
+	// Progress once a second until the end, the time limit or a key
+    if(seconds <= 0)
+        printf("Press Enter to stop\n");
+    while(!streamDone && (seconds <= 0 || tick < seconds*10) && (seconds > 0 || tcischars(0) == 0)){
+        delay(100);
+        if(++tick % 10 == 0){
+            printf("\r%6d s %14llu samples %5.1f%% buffered %10llu underruns", tick/10,
+                strRing.next, 100.0*(strRing.head - strRing.next)/strRing.size, strUnderruns);
+            fflush(stdout);
+        }
+    }
+    streaming = false;
+    pthread_join(output, NULL);
+    pthread_join(reader, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+    printf("\n%llu samples in %.2f s (%.1f S/s, %.1f MB/s read), %llu underruns\n",
+        strRing.next, wall, strRing.next/wall, strRead/wall/1e6, strUnderruns);
+    if(S.rate > 0 && !S.pacer_div)
+        printf("Lateness p99 %.1f us, max %.1f us, %llu clock restarts\n",
+            histPercentile(dacTrace[0].hist, 0.99)/1000.0, dacTrace[0].max_late/1000.0,
+            dacTrace[0].slips);
+    close(S.fd);
+    free(strRing.data);
+    strRing.data = NULL;
+    return strUnderruns != 0;
+}
+/* Open a stream file: a --capture file (first channel, ADC counts at
++/-10V, as the DAC codes) or raw 32-bit floats in volts. CSV files have
+to be parsed line by line and are only played as --awg tables */
+bool streamOpen(const char* file, float rate, StreamSource* S){
+    CaptureHeader hdr;
+    struct stat st;
+    unsigned int div1, div2;
+    const char* ext = strrchr(file, '.');
+    memset(S, 0, sizeof(*S));
+    if(ext != NULL && (strcmp(ext, ".csv") == 0 || strcmp(ext, ".txt") == 0)){
+        printf("%s: CSV files cannot be streamed, load them with --awg.\n", file);
+        return false;
+    }
+    if((S->fd = open(file, O_RDONLY)) == -1 || fstat(S->fd, &st) == -1){
+        perror(file);
+        if(S->fd != -1)
+            close(S->fd);
+        return false;
+    }
+    S->stride = sizeof(float);
+    S->rate = rate != 0 ? rate : STREAM_RATE;
+    if(pread(S->fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) && memcmp(hdr.magic, CAPTURE_MAGIC, 4) == 0){
+        S->capture = true;
+        S->first = hdr.header_size;
+        S->stride = (hdr.channels ? hdr.channels : 1)*sizeof(uint16_t);
+        if(rate == 0)
+            S->rate = hdr.rate*sizeof(uint16_t)/S->stride;
+    }
+    S->samples = (st.st_size - S->first)/S->stride;
+    if(S->samples == 0){
+        printf("No samples in %s.\n", file);
+        close(S->fd);
+        return false;
+    }
+	// Board timed if the pacer can divide down to the rate
+    if(usePacer && S->rate > 0){
+        if(PACER_CLOCK/S->rate < PACER_MINDIV - 0.5 || PACER_CLOCK/S->rate > PACER_MAXTOTAL + 0.5){
+            printf("Paced stream rate must be in the range [%.4f, %d] S/s\n",
+                (double)PACER_CLOCK/PACER_MAXTOTAL, PACER_CLOCK/PACER_MINDIV);
+            close(S->fd);
+            return false;
+        }
+        S->pacer_div = pacerSplit((uint32_t)lrint(PACER_CLOCK/S->rate), &div1, &div2);
+        S->rate = (double)PACER_CLOCK/S->pacer_div;
+    }
+    else if(S->rate > AWG_MAX_RATE){
+        printf("Software timed stream rate must be at most %d S/s (use --pacer)\n", AWG_MAX_RATE);
+        close(S->fd);
+        return false;
+    }
+    return true;
+}
+/* Reader thread: convert the file into strRing a block at a time while
+there is a free block. Waits on nothing but the file and a full ring */
+void* StreamReader(void* pointer){
+    StreamSource* S = (StreamSource*)pointer;
+    unsigned long long left = S->samples, head;
+    off_t pos = S->first, dropped = 0;
+    size_t want, got;
+    ssize_t r = 0;
+    uint16_t* out;
+    char* raw;
+    float v;
+    int i, n;
+    raw = malloc((size_t)STREAM_BLOCK*S->stride);
+    if(raw == NULL){
+        perror("StreamReader");
+        strRing.eof = true;
+        return NULL;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+	// Larger read-ahead by the file system
+    posix_fadvise(S->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    while(streaming && left > 0){
+        head = strRing.head;
+        if(strRing.size - (head - strRing.tail) < STREAM_BLOCK){
+            delay(1);
+            continue;
+        }
+        n = left < STREAM_BLOCK ? (int)left : STREAM_BLOCK;
+        want = (size_t)n*S->stride;
+        for(got=0;got < want;got+=r){
+            r = pread(S->fd, raw + got, want - got, pos + got);
+            if(r <= 0)
+                break;
+        }
+		// A file that got shorter ends at the last whole sample
+        if(got < want){
+            if(r < 0)
+                perror("stream read");
+            n = got/S->stride;
+            left = n;
+        }
+        strRead += got;
+        pos += got;
+        left -= n;
+		// Blocks never wrap: the ring is a whole number of them
+        out = &strRing.data[head & (strRing.size - 1)];
+        if(S->capture)
+            for(i=0;i<n;i++)
+                memcpy(&out[i], raw + (size_t)i*S->stride, sizeof(uint16_t));
+        else
+            for(i=0;i<n;i++){
+                memcpy(&v, raw + (size_t)i*sizeof(float), sizeof(float));
+                out[i] = streamCode(v);
+            }
+		// Samples must be visible before the new head
+        __sync_synchronize();
+        strRing.head = head + n;
+#ifdef POSIX_FADV_DONTNEED
+        if(pos - dropped >= STREAM_DROP){
+            posix_fadvise(S->fd, dropped, pos - dropped, POSIX_FADV_DONTNEED);
+            dropped = pos;
+        }
+#endif
+    }
+    free(raw);
+    strRing.eof = true;
+    return NULL;
+}
+/* Output thread: one ring sample per tick of the sample clock (software
+timed), or FIFO blocks for the pacer. An underrun outputs the last
+sample again and the clock goes on, so the file keeps its timing once
+the reader catches up */
+void* StreamOut(void* pointer){
+    StreamSource* S = (StreamSource*)pointer;
+    uint16_t v = 0x7FFF;
+    Ticker T;
+    int r;
+    rtOutput();
+    if(!board->ioPriv()){
+        streamDone = true;
+        return NULL;
+    }
+    if(S->pacer_div){
+        streamPaced(S);
+        streamDone = true;
+        return NULL;
+    }
+    board->out16(DA_CTLREG, STREAM_CTLREG);
+    board->out16(DA_FIFOCLR, 0);
+    if(S->rate > 0)
+        tickerStart(&T, 1e9/S->rate, &dacTrace[0]);
+    while(streaming && (r = streamNext(&v)) >= 0){
+        if(S->rate < 0){
+			// As fast as possible: wait for the reader instead
+            if(r == 0){
+                sched_yield();
+                continue;
+            }
+            board->out16(DA_Data, v);
+            continue;
+        }
+        if(r == 0)
+            strUnderruns++;
+        board->out16(DA_Data, v);
+        tickerWait(&T);
+    }
+    streamDone = true;
+    return NULL;
+}
+/* Pacer clocked stream output (called by StreamOut), refilled in half
+FIFO blocks as PushDACPaced does. A refill the ring cannot complete is
+an underrun: the FIFO is topped up with what there is and runs dry if
+the reader does not catch up before it is empty */
+void streamPaced(StreamSource* S){
+    unsigned short paced_ctl = (STREAM_CTLREG & ~DAC_START) | DAC_PACER_SRC;
+    unsigned int sleep_ms;
+    uint16_t v = 0x7FFF;
+    int n = 0;
+    sleep_ms = (unsigned int)(1000.0*DAC_FIFO_SIZE/8*S->pacer_div/PACER_CLOCK);
+    if(sleep_ms<1) sleep_ms=1;
+    if(sleep_ms>50) sleep_ms=50;
+    board->out16(DA_CTLREG, paced_ctl);
+    board->out16(DA_FIFOCLR, 0);
+    if(streamFIFO(DAC_FIFO_SIZE, &v) < 0)
+        return;
+    dacPacer(S->pacer_div);
+    board->out16(DA_CTLREG, paced_ctl | DAC_START);
+    while(streaming && n >= 0){
+        delay(sleep_ms);
+        while(n >= 0 && (board->in16(DA_CTLREG) & DAC_HALF_EMPTY)){
+            if((n = streamFIFO(DAC_FIFO_HALF, &v)) >= 0 && n < DAC_FIFO_HALF){
+				// Short only because the file ends is not an underrun
+                if(!strRing.eof)
+                    strUnderruns++;
+                break;
+            }
+        }
+    }
+	// Let the FIFO drain at the end of the file, then stop the pacer
+    if(n < 0)
+        delay((unsigned int)(1000.0*DAC_FIFO_SIZE*S->pacer_div/PACER_CLOCK) + 1);
+    board->out16(DA_CTLREG, paced_ctl);
+}
+/* Write up to n ring samples to the DAC FIFO and return how many, or -1
+once the whole file has been output */
+int streamFIFO(int n, uint16_t* v){
+    int i, r = 0;
+    for(i=0;i<n && (r = streamNext(v)) > 0;i++)
+        board->out16(DA_Data, *v);
+    return (i == 0 && r < 0) ? -1 : i;
+}
+/* Next ring sample into *v: 1, 0 if the reader is behind (underrun, *v
+unchanged) or -1 at the end of the file. The head is read only when the
+samples seen before are used up, and the tail is published once per
+block, so a sample costs the output thread a load and a compare */
+static inline int streamNext(uint16_t* v){
+    StreamRing* R = &strRing;
+    bool eof;
+    if(R->next == R->seen){
+        eof = R->eof;
+        R->seen = R->head;
+		// Samples must be read after the head
+        __sync_synchronize();
+        if(R->next == R->seen)
+            return eof ? -1 : 0;
+    }
+    *v = R->data[R->next & (R->size - 1)];
+    if((++R->next & (STREAM_BLOCK - 1)) == 0){
+		// Block read before the reader may reuse it
+        __sync_synchronize();
+        R->tail = R->next;
+    }
+    return 1;
+}
+// DAC code of v volts at +/-10V (rounded, clipped to the DAC range)
+static inline uint16_t streamCode(float v){
+    float c = 0x7FFF + v/(float)STREAM_RES + 0.5f;
+    if(!(c >= 0))
+        return 0;
+    if(c >= 65535)
+        return 65535;
+    return (uint16_t)c;
+}
+
+
+//*************************************************************//
+//            Supporting Programs
+//*************************************************************//
+// Supporting function: check whether DAC will have negative data
+bool hasNegative(DACField* D){
+    if( (D->mean-D->amp) < 0)
+        return true;
+    return false;
+}
+// Supporting function: check absolute maximum value
+short checkAbsMax(float mean, float amp){
+    float absMax=0;
+    if(fabs(mean+amp)>fabs(mean-amp))
+        absMax = fabs(mean+amp);
+    else
+        absMax = fabs(mean-amp);
+    if(absMax<5)
+        return 1;
+    else if(absMax<10)
+        return 2;
+    else {
+        printf("\nError: The absolute maximum is more than 10V.\n");
+        printf("Either reset the data field or select small absolute value.\n");
+        return 0;
+    }
+}
+// Function to directly change the parameters of the DAC0
+void change(bool onSignal, int wvty, float f, float m, float a){
+    changeChannel(&DAC, onSignal, wvty, f, m, a);
+}
+// Change the parameters of one DAC channel (MainMutex held)
+void changeChannel(DACField* D, bool onSignal, int wvty, float f, float m, float a){
+	/* In DDS mode a change of frequency alone is a single word write:
+	the running PushDAC picks up the new phase increment on its next tick */
+    if(useDDS && !D->resetWave && D->isOn==onSignal && D->waveform_type==wvty
+        && D->mean==m && D->amp==a){
+        D->freq=f;
+        D->phase_incr=ddsIncrement(f);
+        storeParams(D);
+        return;
+    }
+    D->waveform_type=wvty;
+    D->freq=f;
+    D->mean=m;
+    D->amp=a;
+    D->resetWave=true;
+    D->isOn=onSignal;
+    storeParams(D);
+	// Wake WaveGenManager
+    waveRequest++;
+    pthread_cond_signal(&WaveCond);
+}
+/* Wait until WaveGenManager has handled change request seq (MainMutex
+held by the caller, released while waiting). False on a 1 s timeout */
+bool waitWaveAck(unsigned int seq){
+    struct timespec deadline;
+    int64_t t = monoNow() + 1000000000;
+    deadline.tv_sec = t/1000000000;
+    deadline.tv_nsec = t%1000000000;
+    while(isOperating && (int)(waveDone - seq) < 0)
+        if(pthread_cond_timedwait(&AckCond, &MainMutex, &deadline) == ETIMEDOUT)
+            return false;
+    return true;
+}
+// Clear isOperating and wake the threads waiting on the condition variables
+void stopProgram(){
+    pthread_mutex_lock(&MainMutex);
+    isOperating = false;
+    pthread_cond_broadcast(&WaveCond);
+    pthread_cond_broadcast(&AckCond);
+    pthread_mutex_unlock(&MainMutex);
+}
+//Set the change field to be equal to initial DAC parameters
+void setChangeField(ChangeField* CF){
+    loadChangeField(&DAC, CF);
+}
+//Set the change field to the parameters of channel D
+void loadChangeField(DACField* D, ChangeField* CF){
+    WaveParams P;
+    loadParams(D, &P);
+    (*CF).waveform_type=P.waveform_type;
+    (*CF).freq=P.freq;
+    (*CF).mean=P.mean;
+    (*CF).amp=P.amp;
+    (*CF).isOn=P.isOn;
+}
+/* Publish D's parameters to the seqlock snapshot (writers hold MainMutex)
+
+param_seq is odd while the snapshot is being written, so readers can
+tell a half-updated copy and read again. */
+void storeParams(DACField* D){
+    D->param_seq++;
+    __sync_synchronize();
+    D->param.isOn = D->isOn;
+    D->param.waveform_type = D->waveform_type;
+    D->param.DAC_mode = D->DAC_mode;
+    D->param.pacer_div = D->pacer_div;
+    D->param.samples_per_period = D->samples_per_period;
+    D->param.output_res = D->output_res;
+    D->param.mean = D->mean;
+    D->param.freq = D->freq;
+    D->param.amp = D->amp;
+    D->param.phase_incr = D->phase_incr;
+    __sync_synchronize();
+    D->param_seq++;
+}
+// Read a consistent parameter snapshot without taking a lock
+void loadParams(DACField* D, WaveParams* P){
+    unsigned int seq;
+    do{
+        while((seq = D->param_seq) & 1)
+            ;
+        __sync_synchronize();
+        *P = *(volatile WaveParams*)&D->param;
+        __sync_synchronize();
+    }while(D->param_seq != seq);
+}
+
+//*************************************************************//
+//                        Board access
+//*************************************************************//
+/*
+Register accesses and the board interrupt go through board, selected at
+start-up with --board. The PCI-DAS 1602 backend (QNX only) is port I/O,
+the PCI server and kernel interrupts. The simulated backend is the
+register-level model below, which runs on any POSIX system, can record
+every DAC data write with its time (--sim-record) and play Port A and
+the analog inputs from a script (--sim-script).
+*/
+#ifdef __QNX__
+static void* pciHandle;				// PCI server handle of the board
+static struct sigevent pciEvent;	// Interrupt event for InterruptWait
+
+bool pciAttach(struct pci_dev_info* info){
+    if(pci_attach(0)<0) {
+      perror("pci_attach");
+      return false;
+      }
+    if ((pciHandle=pci_attach_device(0, PCI_SHARE|PCI_INIT_ALL, 0, info))==0) {
+      perror("pci_attach_device");
+      return false;
+      }
+    return true;
+}
+uintptr_t pciMap(uint64_t badr){
+    return mmap_device_io(0x0f, badr);
+}
+bool pciIOPriv(){
+    return ThreadCtl(_NTO_TCTL_IO, 0) != -1;
+}
+void pciDetach(){
+    pci_detach_device(pciHandle);
+}
+void pciOut8(uintptr_t port, uint8_t val){
+    out8(port, val);
+}
+void pciOut16(uintptr_t port, uint16_t val){
+    out16(port, val);
+}
+uint8_t pciIn8(uintptr_t port){
+    return in8(port);
+}
+uint16_t pciIn16(uintptr_t port){
+    return in16(port);
+}
+// The interrupt is masked when it fires until pciIntrUnmask
+int pciIntrAttach(int irq){
+    SIGEV_INTR_INIT(&pciEvent);
+    return InterruptAttachEvent(irq, &pciEvent, _NTO_INTR_FLAGS_TRK_MSK);
+}
+void pciIntrDetach(int id){
+    InterruptDetach(id);
+}
+int pciIntrWait(uint64_t timeout){
+    TimerTimeout(CLOCK_MONOTONIC, _NTO_TIMEOUT_INTR, NULL, &timeout, NULL);
+    return InterruptWait(0, NULL);
+}
+void pciIntrUnmask(int irq, int id){
+    InterruptUnmask(irq, id);
+}
+const BoardOps boardPCI = {"PCI-DAS 1602", pciAttach, pciMap, pciIOPriv, pciDetach,
+    pciOut8, pciOut16, pciIn8, pciIn16, pciIntrAttach, pciIntrDetach, pciIntrWait, pciIntrUnmask};
+#endif
+const BoardOps boardSim = {"simulated", simAttach, simMap, simIOPriv, simDetach,
+    simOut8, simOut16, simIn8, simIn16, simIntrAttach, simIntrDetach, simIntrWait, simIntrUnmask};
+
+//*************************************************************//
+//                 Output sink (WAV or raw file)
+//*************************************************************//
+/* Record what DAC0 outputs to file at rate S/s
+
+The board is wrapped (boardTap) so that every DAC data, control and
+FIFO clear write, and every pacer divisor byte, is queued with the time
+it was made, whichever thread or output mode made it. The output
+thread never blocks on the sink: events that do not fit in sinkRing are
+counted and dropped. SinkWriter replays the events through a model of
+the DAC (see sinkEvent), converts the DAC0 codes to volts with the range
+in the control word and resamples the held output to a uniform rate.
+The file is WAV (32-bit float, mono) if its name ends in .wav, raw
+32-bit floats otherwise, written in SINK_BLOCK sample blocks.
+*/
+bool sinkStart(const char* file, float rate){
+    SinkState* S = &sinkState;
+    const char* ext = strrchr(file, '.');
+    memset(S, 0, sizeof(*S));
+    if(sinkRing.ev == NULL)
+        sinkRing.ev = malloc(SINK_RING_SIZE*sizeof(SinkEvent));
+    S->buf = malloc(SINK_BLOCK*sizeof(float));
+    S->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(sinkRing.ev == NULL || S->buf == NULL || S->fd == -1){
+        perror(file);
+        free(S->buf);
+        if(S->fd != -1)
+            close(S->fd);
+        return false;
+    }
+    S->wav = ext != NULL && strcmp(ext, ".wav") == 0;
+    S->rate = rate;
+    S->period = 1e9/rate;
+    S->name = file;
+	// The samples follow the header, written again with their count at the end
+    if(S->wav && (!sinkHeader(S) || lseek(S->fd, 44, SEEK_SET) != 44)){
+        perror(file);
+        close(S->fd);
+        free(S->buf);
+        return false;
+    }
+	// No slot of an earlier sink may look ready
+    memset(sinkRing.ev, 0, SINK_RING_SIZE*sizeof(SinkEvent));
+    sinkRing.head = sinkRing.tail = 0;
+    sinkDropped = 0;
+	// Every later register access goes through the tap
+    sinkBoard = board;
+    boardTap = *board;
+    boardTap.out8 = tapOut8;
+    boardTap.out16 = tapOut16;
+    boardTap.detach = tapDetach;
+    sinking = true;
+    pthread_create(&sinkThread, NULL, &SinkWriter, NULL);
+    __sync_synchronize();
+    board = &boardTap;
+    return true;
+}
+// Stop the sink: write out the queued events and close the file
+void sinkStop(){
+    SinkState* S = &sinkState;
+    if(!sinking)
+        return;
+    board = sinkBoard;
+    sinking = false;
+    pthread_join(sinkThread, NULL);
+	// Conversions still due from the FIFO, then the last sample held
+    sinkAdvance(S, (double)monoNow());
+    if(S->started)
+        sinkPut(S, S->held);
+    if(S->n && write(S->fd, S->buf, S->n*sizeof(float)) != (ssize_t)(S->n*sizeof(float)))
+        perror(S->name);
+    S->samples += S->n;
+    S->n = 0;
+    if(S->wav && !sinkHeader(S))
+        perror(S->name);
+    close(S->fd);
+    free(S->buf);
+    printf("%llu samples (%.3f s at %.0f S/s) written to %s, %llu events dropped, %llu holds cut\n",
+        S->samples, S->samples/S->rate, S->rate, S->name, sinkDropped, S->gaps);
+}
+/* Make a DAC register write and queue it for SinkWriter
+
+Both output threads write the DAC outside --dual, so the ring takes
+events from several threads without a lock: a slot is reserved by
+compare-and-swap on the head once the write is made, and marked ready
+once its event is written. Nothing is held across the port write, so a
+thread preempted here delays no other one (SinkWriter waits for the
+slot). Writes made by two threads at the same instant may be queued in
+either order. */
+static inline void sinkWrite(uintptr_t port, uint16_t val, int kind, bool wide){
+    unsigned long long h;
+    SinkEvent* E;
+    if(wide)
+        sinkBoard->out16(port, val);
+    else
+        sinkBoard->out8(port, val);
+    h = __atomic_load_n(&sinkRing.head, __ATOMIC_RELAXED);
+    do{
+		// The slot is free once SinkWriter has taken the event before it
+        if(h - __atomic_load_n(&sinkRing.tail, __ATOMIC_ACQUIRE) >= SINK_RING_SIZE){
+            __atomic_fetch_add(&sinkDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }while(!__atomic_compare_exchange_n(&sinkRing.head, &h, h + 1, true,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    E = &sinkRing.ev[h & SINK_RING_MASK];
+    E->t = monoNow();
+    E->kind = kind;
+    E->val = val;
+	// Event before its ready mark
+    __atomic_store_n(&E->ready, (uint32_t)(h + 1), __ATOMIC_RELEASE);
+}
+void tapOut8(uintptr_t port, uint8_t val){
+    if(port == PACER2)
+        sinkWrite(port, val, SINK_PACER2, false);
+    else if(port == PACER3)
+        sinkWrite(port, val, SINK_PACER3, false);
+    else if(port == PACERCTL && (val & 0xc0) != 0 && (val & 0xc0) != 0xc0)
+        sinkWrite(port, val, SINK_PACERCTL, false);
+    else
+        sinkBoard->out8(port, val);
+}
+void tapOut16(uintptr_t port, uint16_t val){
+    if(port == DA_Data)
+        sinkWrite(port, val, SINK_DATA, true);
+    else if(port == DA_CTLREG)
+        sinkWrite(port, val, SINK_CTL, true);
+    else if(port == DA_FIFOCLR)
+        sinkWrite(port, val, SINK_FIFOCLR, true);
+    else
+        sinkBoard->out16(port, val);
+}
+void tapDetach(){
+    sinkStop();
+    board->detach();
+}
+/* Thread replaying sinkRing into the file, in slot order. A slot that is
+reserved but not yet written stops the replay until it is ready */
+void* SinkWriter(void* pointer){
+    SinkState* S = &sinkState;
+    unsigned long long tail = sinkRing.tail;
+    SinkEvent* E;
+    (void)pointer;
+    rtDemote();
+    while(1){
+        E = &sinkRing.ev[tail & SINK_RING_MASK];
+        if(__atomic_load_n(&E->ready, __ATOMIC_ACQUIRE) != (uint32_t)(tail + 1)){
+            if(!sinking && __atomic_load_n(&sinkRing.head, __ATOMIC_ACQUIRE) == tail)
+                break;
+            delay(10);
+            continue;
+        }
+        sinkEvent(S, E);
+		// Event read before the slot is given back
+        __atomic_store_n(&sinkRing.tail, ++tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+/* One register write, in time order (from sinkWrite). Direct conversions
+happen at the write. Samples written with the pacer as source queue in
+the FIFO and are converted one per pacer tick from one tick after the
+pacer starts, as on the board: a tick that finds the FIFO empty converts
+nothing */
+void sinkEvent(SinkState* S, const SinkEvent* E){
+    bool run;
+    int k;
+    sinkAdvance(S, (double)E->t);
+    switch(E->kind){
+        case SINK_DATA: {
+            if(S->ctl & DAC_PACER_SRC){
+                if(S->fifo_count < DAC_FIFO_SIZE)
+                    S->fifo[(S->fifo_head + S->fifo_count++) % DAC_FIFO_SIZE] = E->val;
+            }
+            else if(S->ctl & DAC_START)
+                sinkEmit(S, (double)E->t, E->val);
+            break;
+        }
+        case SINK_CTL: {
+            run = (E->val & DAC_PACER_SRC) && (E->val & DAC_START) && S->div[0] && S->div[1];
+            if(run && !S->running){
+                S->tick = (double)S->div[0]*S->div[1]*1e9/PACER_CLOCK;
+                S->t_next = E->t + S->tick;
+            }
+            S->running = run;
+			// Both channels newly selected: the next write is DAC0's
+            if((E->val & 0x60) == 0x60 && (S->ctl & 0x60) != 0x60)
+                S->pair = 0;
+            S->ctl = E->val;
+            break;
+        }
+        case SINK_FIFOCLR: { S->fifo_head = S->fifo_count = 0; S->pair = 0; break;}
+        case SINK_PACERCTL: { S->msb[(E->val >> 6) - 1] = false; break;}
+        case SINK_PACER2:
+        case SINK_PACER3: {
+            k = E->kind == SINK_PACER3;
+            S->div[k] = S->msb[k] ? (S->div[k] & 0x00ff) | (E->val << 8) : (S->div[k] & 0xff00) | E->val;
+            S->msb[k] = !S->msb[k];
+            break;
+        }
+    }
+}
+// Pacer conversions up to time t
+void sinkAdvance(SinkState* S, double t){
+    if(!S->running)
+        return;
+    while(S->t_next <= t){
+        if(S->fifo_count == 0){
+			// Underrun: skip the ticks up to t
+            S->t_next += (floor((t - S->t_next)/S->tick) + 1)*S->tick;
+            return;
+        }
+        sinkEmit(S, S->t_next, S->fifo[S->fifo_head]);
+        S->fifo_head = (S->fifo_head + 1) % DAC_FIFO_SIZE;
+        S->fifo_count--;
+        S->t_next += S->tick;
+    }
+}
+/* A conversion at time t. Only DAC0's are kept: with both channels
+selected (--dual) the writes alternate DAC0, DAC1 (see PushDACDual). The
+output holds the last conversion, so every output sample before t gets
+the held volts */
+void sinkEmit(SinkState* S, double t, uint16_t code){
+    int sel = S->ctl & 0x60;
+    if(sel == 0x60){
+        S->pair ^= 1;
+        if(!S->pair)
+            return;
+    }
+    else if(sel != 0x20)
+        return;
+    if(!S->started){
+        S->started = true;
+        S->t_out = t;
+    }
+	// The DAC was not written for a long time (output stopped)
+    if(t - S->t_out > SINK_GAP_NS){
+        S->gaps++;
+        S->t_out = t - SINK_GAP_NS;
+    }
+    while(S->t_out < t){
+        sinkPut(S, S->held);
+        S->t_out += S->period;
+    }
+    S->held = dacVolts(code, (S->ctl >> 8) & 3);
+}
+// Append an output sample, writing whole blocks
+void sinkPut(SinkState* S, float v){
+    S->buf[S->n++] = v;
+    if(S->n < SINK_BLOCK)
+        return;
+    if(write(S->fd, S->buf, SINK_BLOCK*sizeof(float)) != SINK_BLOCK*sizeof(float))
+        perror(S->name);
+    S->samples += SINK_BLOCK;
+    S->n = 0;
+}
+// Write the WAV header for the samples written so far
+bool sinkHeader(SinkState* S){
+    uint8_t h[44];
+    uint32_t data = (uint32_t)(S->samples*sizeof(float)), v;
+    uint16_t w;
+    memcpy(h, "RIFF", 4);
+    v = 36 + data; memcpy(h + 4, &v, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    v = 16; memcpy(h + 16, &v, 4);
+    w = 3; memcpy(h + 20, &w, 2);				// IEEE float
+    w = 1; memcpy(h + 22, &w, 2);				// Mono
+    v = (uint32_t)S->rate; memcpy(h + 24, &v, 4);
+    v = (uint32_t)S->rate*sizeof(float); memcpy(h + 28, &v, 4);
+    w = sizeof(float); memcpy(h + 32, &w, 2);
+    w = 32; memcpy(h + 34, &w, 2);
+    memcpy(h + 36, "data", 4);
+    memcpy(h + 40, &data, 4);
+    return pwrite(S->fd, h, sizeof(h), 0) == sizeof(h);
+}
+// Volts of a DAC code in DAC mode mode (see chooseBestRes)
+float dacVolts(uint16_t code, int mode){
+    switch(mode){
+        case 0: return (code - 0x7FFF)*152.59e-6f;
+        case 1: return (code - 0x7FFF)*305.14e-6f;
+        case 2: return code*76.29e-6f;
+        default: return code*152.59e-6f;
+    }
+}
+
+//*************************************************************//
+//                      Simulated board
+//*************************************************************//
+/*
+Register-level model of the PCI-DAS 1602 (board backend "sim").
+
+BADRn is mapped to port n*0x1000. Every write is stored per port so that
+reads of plain registers return the last value written. The DAC is
+modelled with its FIFO: with DAC_PACER_SRC set, data writes queue in the
+FIFO and the pacer (counters 1 and 2 of the BADR3 + 8..B 8254 in
+cascade, PACER_CLOCK/(div1*div2)) converts one sample per tick, worked
+out lazily from CLOCK_MONOTONIC on every access. Without the pacer, each
+data write is converted at once. ADC conversions complete immediately: a
+start converts CHL (or CHL..CHH in burst mode) into the ADC FIFO from
+simSetADC's inputs and raises the end-of-acquisition interrupt if it is
+enabled. With the ADC pacer as conversion source (counters 1 and 2 of
+the BADR3 + 0..3 8254 in cascade, modelled like the DAC pacer) each tick
+converts the next channel of the scan, or in burst mode the whole scan,
+which then raises end-of-acquisition. With adc_stamp set, paced samples
+add the scan number to the input, so a capture can be checked for gaps.
+An interrupt is pending until simIntrWait takes it or it is cleared in
+INTERRUPT. Clearing half full raises it again while the FIFO is still
+half full. Port A reads the inputs set by simSetDIO.
+With a record started (simRecord), every DAC data write is kept with its
+CLOCK_MONOTONIC time.
+*/
+#define SIM_BARS		5
+#define SIM_BAR_SIZE	0x10
+#define SIM_IRQ			11
+#define SIM_RECORD_BITS	20						// DAC writes kept by the record (the latest)
+#define SIM_RECORD_SIZE	(1<<SIM_RECORD_BITS)
+#define SIM_RECORD_MASK	(SIM_RECORD_SIZE-1)
+#define SIM_SCRIPT_MAX	4096					// Events in an input script
+#define SIM_LOST_MAX	256						// Losses kept with their times (simLost)
+#define STALL_SPANS		4096					// Host delays kept by hostStalls
+#define STALL_SPAN_NS	500000					// Shortest host delay kept as a cause of a loss
+#define SIM_EVENT_DIO	0						// Script event: Port A inputs
+#define SIM_EVENT_ADC	1						// Script event: analog input
+
+// One recorded DAC data write
+typedef struct {
+    int64_t t;								// Time of the write (CLOCK_MONOTONIC ns)
+    uint16_t code;							// Value written
+    uint16_t fifo;							// 1 if queued in the FIFO for the pacer
+} SimWrite;
+
+// One input script event (--sim-script)
+typedef struct {
+    double t;								// Time from the script start (s)
+    int kind;								// SIM_EVENT_DIO or SIM_EVENT_ADC
+    int ch;									// Analog input
+    uint16_t val;							// Port A inputs or ADC counts
+} SimEvent;
+
+typedef struct {
+    uint16_t reg[SIM_BARS][SIM_BAR_SIZE];	// Last value written to each port
+    uint16_t fifo[DAC_FIFO_SIZE];			// DAC FIFO
+    int fifo_head;
+    int fifo_count;
+    uint16_t dac_out;						// Sample currently on the DAC output
+    uint16_t dac_div[2];					// DAC pacer divisors (PACER2 and PACER3)
+    int dac_msb[2];							// Next counter 1/2 byte is the MSB
+    bool paced;								// Pacer running and clocking the DAC
+    struct timespec pacer_start;			// Time the pacer was started
+    unsigned long long ticks;				// Pacer ticks accounted for
+    unsigned long long conversions;			// Samples converted by the DAC
+    int64_t first_conv, last_conv;			// Times of the first and last data write converted (ns)
+    unsigned long long underruns;			// Pacer ticks that found the FIFO empty
+    unsigned long long overflows;			// Data writes dropped on a full FIFO
+    unsigned long long writes[SIM_BARS][SIM_BAR_SIZE];	// Port writes since simReset
+    unsigned long long reads[SIM_BARS][SIM_BAR_SIZE];	// Port reads since simReset
+    uint16_t adc_input[16];					// Analog inputs (ADC counts)
+    uint8_t dio_in;							// Port A inputs (simSetDIO)
+    int64_t dio_time;						// Time Port A last changed (ns)
+    uint16_t adc_fifo[ADC_FIFO_SIZE];		// ADC FIFO
+    int adc_head;
+    int adc_count;
+    uint16_t adc_div[2];					// ADC pacer divisors (TIMER1 and TIMER2)
+    int adc_msb[2];							// Next counter 1/2 byte is the MSB
+    bool adc_paced;							// ADC pacer clocking conversions
+    struct timespec adc_start;				// Time the ADC pacer was started
+    unsigned long long adc_ticks;			// ADC pacer ticks accounted for
+    bool adc_ovf;							// ADC FIFO overflowed (until FIFO cleared)
+    bool adc_stamp;							// Paced samples add the scan number
+    unsigned long long adc_overflows;		// Paced conversions lost on a full FIFO
+    int64_t dac_seen, adc_seen;				// Times the DAC and ADC models were last brought up to date (ns)
+    int lost;								// DAC underruns and ADC overflows since simReset, as
+    int64_t lost_from[SIM_LOST_MAX];		// the unattended spans they happened in (ns)
+    int64_t lost_to[SIM_LOST_MAX];
+    unsigned long long irq_raised;			// ADC interrupts raised
+    bool irq_pending;						// Interrupt not yet taken by simIntrWait
+    SimWrite* rec;							// Record of the DAC data writes, NULL if not recording
+    unsigned long long rec_count;			// DAC data writes recorded
+    pthread_cond_t irq_cond;
+    pthread_mutex_t lock;
+} SimBoard;
+
+SimBoard sim = {.lock = PTHREAD_MUTEX_INITIALIZER, .irq_cond = PTHREAD_COND_INITIALIZER};
+SimEvent simScript[SIM_SCRIPT_MAX];			// Input script (simScriptStart)
+int simScriptCount = 0;
+int64_t simScriptStarted;					// Time the script started (ns)
+
+// Convert a simulated port number to its BADR index (-1 if unmapped)
+static int simBar(uintptr_t port){
+    int bar = (int)(port >> 12) - 1;
+    if(bar < 0 || bar >= SIM_BARS || (port & 0xfff) >= SIM_BAR_SIZE)
+        return -1;
+    return bar;
+}
+/* Note a loss (DAC FIFO empty or ADC FIFO full) in the span from to to
+in which nobody accessed the model. A loss found again at the next
+access (the FIFO not yet refilled or drained) extends the last span
+(sim.lock held) */
+static void simLost(int64_t from, int64_t to){
+    if(sim.lost > 0 && sim.lost <= SIM_LOST_MAX && sim.lost_to[sim.lost - 1] == from){
+        sim.lost_to[sim.lost - 1] = to;
+        return;
+    }
+    if(sim.lost < SIM_LOST_MAX){
+        sim.lost_from[sim.lost] = from;
+        sim.lost_to[sim.lost] = to;
+    }
+    sim.lost++;
+}
+// Convert the pacer ticks elapsed since the last access (sim.lock held)
+static void simDACService(){
+    struct timespec now;
+    unsigned long long target, n, used;
+    if(!sim.paced || sim.dac_div[0]==0 || sim.dac_div[1]==0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    target = (unsigned long long)(((now.tv_sec - sim.pacer_start.tv_sec)*1e9
+        + (now.tv_nsec - sim.pacer_start.tv_nsec)) * PACER_CLOCK / 1e9
+        / ((double)sim.dac_div[0]*sim.dac_div[1]));
+    if(target <= sim.ticks)
+        return;
+    n = target - sim.ticks;
+    used = n < (unsigned long long)sim.fifo_count ? n : (unsigned long long)sim.fifo_count;
+    if(used){
+        sim.fifo_head = (int)((sim.fifo_head + used - 1) % DAC_FIFO_SIZE);
+        sim.dac_out = sim.fifo[sim.fifo_head];
+        sim.fifo_head = (sim.fifo_head + 1) % DAC_FIFO_SIZE;
+        sim.fifo_count -= (int)used;
+    }
+    sim.conversions += used;
+    sim.underruns += n - used;
+    sim.ticks = target;
+    if(n > used)
+        simLost(sim.dac_seen, now.tv_sec*1000000000LL + now.tv_nsec);
+    sim.dac_seen = now.tv_sec*1000000000LL + now.tv_nsec;
+}
+// Raise the board interrupt if src is the enabled source (sim.lock held)
+static void simRaise(uint16_t src){
+    if((sim.reg[1][0] & ADC_INTE) && (sim.reg[1][0] & ADC_INTSEL) == src){
+        sim.irq_raised++;
+        sim.irq_pending = true;
+        pthread_cond_broadcast(&sim.irq_cond);
+    }
+}
+// ADC software start: convert into the ADC FIFO (sim.lock held)
+static void simADCStart(){
+    uint16_t mux = sim.reg[1][2];
+    int ch, chl = mux & 0xf;
+    int chh = (sim.reg[1][4] & ADC_BURST) ? (mux >> 4) & 0xf : chl;
+    for(ch=chl;ch<=chh && sim.adc_count<ADC_FIFO_SIZE;ch++)
+        sim.adc_fifo[(sim.adc_head + sim.adc_count++) % ADC_FIFO_SIZE] = sim.adc_input[ch];
+    simRaise(ADC_INT_EOA);
+}
+/* Convert the ADC pacer ticks elapsed since the last access, one sample
+per tick, or CHL..CHH per tick in burst mode (sim.lock held) */
+static void simADCService(){
+    struct timespec now;
+    unsigned long long target, k, s;
+    uint16_t mux = sim.reg[1][2];
+    int chl = mux & 0xf, nch = ((mux >> 4) & 0xf) - chl + 1, per, j;
+    bool below_half = sim.adc_count < ADC_FIFO_HALF;
+    if(!sim.adc_paced)
+        return;
+    if(nch < 1)
+        nch = 1;
+    per = (sim.reg[1][4] & ADC_BURST) ? nch : 1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    target = (unsigned long long)(((now.tv_sec - sim.adc_start.tv_sec)*1e9
+        + (now.tv_nsec - sim.adc_start.tv_nsec)) * PACER_CLOCK / 1e9
+        / ((double)sim.adc_div[0]*sim.adc_div[1]));
+    if(target <= sim.adc_ticks)
+        return;
+    for(k=sim.adc_ticks;k<target && sim.adc_count+per<=ADC_FIFO_SIZE;k++)
+        for(j=0;j<per;j++){
+            s = k*per + j;
+            sim.adc_fifo[(sim.adc_head + sim.adc_count++) % ADC_FIFO_SIZE] =
+                sim.adc_input[chl + s%nch] + (sim.adc_stamp ? (uint16_t)(s/nch) : 0);
+        }
+    if(k < target){
+        sim.adc_ovf = true;
+        sim.adc_overflows += (target - k)*per;
+        simLost(sim.adc_seen, now.tv_sec*1000000000LL + now.tv_nsec);
+    }
+    sim.adc_seen = now.tv_sec*1000000000LL + now.tv_nsec;
+    sim.adc_ticks = target;
+    if(per > 1)
+        simRaise(ADC_INT_EOA);
+    if(below_half && sim.adc_count >= ADC_FIFO_HALF)
+        simRaise(ADC_INT_HALF);
+}
+// Clear the DAC counters between measurements
+void simReset(){
+    pthread_mutex_lock(&sim.lock);
+    simDACService();
+    sim.conversions = 0;
+    sim.underruns = 0;
+    sim.overflows = 0;
+    memset(sim.writes, 0, sizeof(sim.writes));
+    memset(sim.reads, 0, sizeof(sim.reads));
+    sim.adc_overflows = 0;
+    sim.lost = 0;
+    pthread_mutex_unlock(&sim.lock);
+}
+// Set simulated analog input ch (ADC counts)
+void simSetADC(int ch, uint16_t val){
+    pthread_mutex_lock(&sim.lock);
+    sim.adc_input[ch & 0xf] = val;
+    pthread_mutex_unlock(&sim.lock);
+}
+// Set the simulated Port A inputs, noting when they change
+void simSetDIO(uint8_t val){
+    pthread_mutex_lock(&sim.lock);
+    if(val != sim.dio_in)
+        sim.dio_time = monoNow();
+    sim.dio_in = val;
+    pthread_mutex_unlock(&sim.lock);
+}
+
+// Number of writes to a port since simReset
+unsigned long long simWrites(uintptr_t port){
+    int bar = simBar(port);
+    unsigned long long n;
+    if(bar < 0)
+        return 0;
+    pthread_mutex_lock(&sim.lock);
+    n = sim.writes[bar][port & 0xfff];
+    pthread_mutex_unlock(&sim.lock);
+    return n;
+}
+// Number of reads of a port since simReset
+unsigned long long simReads(uintptr_t port){
+    int bar = simBar(port);
+    unsigned long long n;
+    if(bar < 0)
+        return 0;
+    pthread_mutex_lock(&sim.lock);
+    n = sim.reads[bar][port & 0xfff];
+    pthread_mutex_unlock(&sim.lock);
+    return n;
+}
+
+void simOut16(uintptr_t port, uint16_t val){
+    int bar = simBar(port);
+    if(bar < 0)
+        return;
+    pthread_mutex_lock(&sim.lock);
+    simDACService();
+    simADCService();
+    sim.reg[bar][port & 0xfff] = val;
+    sim.writes[bar][port & 0xfff]++;
+    if(port == DA_CTLREG){
+        bool paced = (val & DAC_PACER_SRC) && (val & DAC_START);
+        if(paced && !sim.paced){
+            clock_gettime(CLOCK_MONOTONIC, &sim.pacer_start);
+            sim.ticks = 0;
+            sim.dac_seen = monoNow();
+        }
+        sim.paced = paced;
+    }
+    else if(port == DA_FIFOCLR){
+        sim.fifo_head = 0;
+        sim.fifo_count = 0;
+    }
+    else if(port == AD_FIFOCLR){
+        sim.adc_head = 0;
+        sim.adc_count = 0;
+        sim.adc_ovf = false;
+    }
+    else if(port == TRIGGER){
+        bool paced = (val & ADC_TRIGSRC) == ADC_TRIG_PACER;
+        if(paced && !sim.adc_paced){
+            clock_gettime(CLOCK_MONOTONIC, &sim.adc_start);
+            sim.adc_ticks = 0;
+            sim.adc_seen = monoNow();
+        }
+        sim.adc_paced = paced && sim.adc_div[0] && sim.adc_div[1];
+    }
+    else if(port == INTERRUPT){
+        // Clearing drops a latched interrupt, half full is raised again if still true
+        if(val & (ADC_HALF_CLR | ADC_EOA_CLR))
+            sim.irq_pending = false;
+        if((val & ADC_HALF_CLR) && sim.adc_count >= ADC_FIFO_HALF)
+            simRaise(ADC_INT_HALF);
+    }
+    else if(port == AD_DATA)
+        simADCStart();
+    else if(port == DA_Data){
+        if(sim.rec != NULL){
+            sim.rec[sim.rec_count & SIM_RECORD_MASK].t = monoNow();
+            sim.rec[sim.rec_count & SIM_RECORD_MASK].code = val;
+            sim.rec[sim.rec_count & SIM_RECORD_MASK].fifo = (sim.reg[1][8] & DAC_PACER_SRC) != 0;
+            sim.rec_count++;
+        }
+        // Queue in the FIFO when the pacer is the conversion source
+        if(sim.reg[1][8] & DAC_PACER_SRC){
+            if(sim.fifo_count < DAC_FIFO_SIZE){
+                sim.fifo[(sim.fifo_head + sim.fifo_count) % DAC_FIFO_SIZE] = val;
+                sim.fifo_count++;
+            }
+            else
+                sim.overflows++;
+        }
+        else if(sim.reg[1][8] & DAC_START){
+            sim.dac_out = val;
+            sim.last_conv = monoNow();
+            if(sim.conversions++ == 0)
+                sim.first_conv = sim.last_conv;
+        }
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+uint16_t simIn16(uintptr_t port){
+    int bar = simBar(port);
+    uint16_t val;
+    if(bar < 0)
+        return 0xffff;
+    pthread_mutex_lock(&sim.lock);
+    simDACService();
+    simADCService();
+    val = sim.reg[bar][port & 0xfff];
+    sim.reads[bar][port & 0xfff]++;
+    if(port == DA_CTLREG)
+        val = sim.fifo_count <= DAC_FIFO_HALF ? DAC_HALF_EMPTY : 0;
+    else if(port == INTERRUPT)
+        val = (val & ~(ADC_FIFO_OVF | ADC_HALF_STAT)) | (sim.adc_ovf ? ADC_FIFO_OVF : 0)
+            | (sim.adc_count >= ADC_FIFO_HALF ? ADC_HALF_STAT : 0);
+    else if(port == AD_DATA){
+        val = 0;
+        if(sim.adc_count){
+            val = sim.adc_fifo[sim.adc_head];
+            sim.adc_head = (sim.adc_head + 1) % ADC_FIFO_SIZE;
+            sim.adc_count--;
+        }
+    }
+    pthread_mutex_unlock(&sim.lock);
+    return val;
+}
+void simOut8(uintptr_t port, uint8_t val){
+    int bar = simBar(port), k;
+    if(bar < 0)
+        return;
+    pthread_mutex_lock(&sim.lock);
+    simDACService();
+    sim.reg[bar][port & 0xfff] = val;
+    sim.writes[bar][port & 0xfff]++;
+    if(port == PACERCTL && (val & 0xc0) != 0 && (val & 0xc0) != 0xc0)
+        sim.dac_msb[(val >> 6) - 1] = 0;	// DAC counter 1 or 2 reloaded, LSB first
+    else if(port == COUNTCTL && (val & 0xc0) != 0 && (val & 0xc0) != 0xc0)
+        sim.adc_msb[(val >> 6) - 1] = 0;	// ADC counter 1 or 2 reloaded
+    else if(port == TIMER1 || port == TIMER2){
+        k = port == TIMER1 ? 0 : 1;
+        if(sim.adc_msb[k])
+            sim.adc_div[k] = (sim.adc_div[k] & 0x00ff) | (val << 8);
+        else
+            sim.adc_div[k] = (sim.adc_div[k] & 0xff00) | val;
+        sim.adc_msb[k] = !sim.adc_msb[k];
+    }
+    else if(port == PACER2 || port == PACER3){
+        k = port == PACER2 ? 0 : 1;
+        if(sim.dac_msb[k])
+            sim.dac_div[k] = (sim.dac_div[k] & 0x00ff) | (val << 8);
+        else
+            sim.dac_div[k] = (sim.dac_div[k] & 0xff00) | val;
+        sim.dac_msb[k] = !sim.dac_msb[k];
+    }
+    pthread_mutex_unlock(&sim.lock);
+}
+uint8_t simIn8(uintptr_t port){
+    int bar = simBar(port);
+    uint8_t val;
+    if(bar < 0)
+        return 0xff;
+    pthread_mutex_lock(&sim.lock);
+    val = port == DIO_PORTA ? sim.dio_in : (uint8_t)sim.reg[bar][port & 0xfff];
+    sim.reads[bar][port & 0xfff]++;
+    pthread_mutex_unlock(&sim.lock);
+    return val;
+}
+
+/* Board found at BADRn = n*0x1000 on SIM_IRQ. Starts the recording of
+the DAC writes (--sim-record) and the input script (--sim-script) */
+bool simAttach(struct pci_dev_info* info){
+    int i;
+    for(i=0;i<SIM_BARS;i++)
+        info->CpuBaseAddress[i] = 0x1000*(i+1);
+    info->Irq = SIM_IRQ;
+    if(simRecordFile != NULL && !simRecord(true))
+        printf("Out of memory for the DAC write record.\n");
+    if(simScriptFile != NULL && !simScriptStart(simScriptFile))
+        return false;
+    return true;
+}
+uintptr_t simMap(uint64_t badr){
+    return (uintptr_t)badr;
+}
+bool simIOPriv(){
+    return true;
+}
+// Write the DAC write record to --sim-record on the way out
+void simDetach(){
+    if(simRecordFile != NULL && sim.rec != NULL)
+        simRecordDump(simRecordFile);
+}
+/* Start (with an empty record) or stop recording the DAC data writes.
+The last SIM_RECORD_SIZE writes are kept */
+bool simRecord(bool on){
+    SimWrite* rec = on ? malloc(SIM_RECORD_SIZE*sizeof(SimWrite)) : NULL;
+    SimWrite* old;
+    if(on && rec == NULL)
+        return false;
+    pthread_mutex_lock(&sim.lock);
+    old = sim.rec;
+    sim.rec = rec;
+    sim.rec_count = 0;
+    pthread_mutex_unlock(&sim.lock);
+    free(old);
+    return true;
+}
+// Copy the valid part of the record to out, oldest first, and return the number of writes
+unsigned long simRecordCopy(SimWrite* out){
+    unsigned long long first, k;
+    pthread_mutex_lock(&sim.lock);
+    first = sim.rec_count > SIM_RECORD_SIZE ? sim.rec_count - SIM_RECORD_SIZE : 0;
+    for(k=first;k<sim.rec_count;k++)
+        out[k - first] = sim.rec[k & SIM_RECORD_MASK];
+    pthread_mutex_unlock(&sim.lock);
+    return (unsigned long)(k - first);
+}
+// Write the DAC write record to a file, one write per line
+void simRecordDump(const char* file){
+    SimWrite* copy = malloc(SIM_RECORD_SIZE*sizeof(SimWrite));
+    unsigned long n, i;
+    FILE* fd;
+    if(copy == NULL || (fd = fopen(file, "w")) == NULL){
+        perror(file);
+        free(copy);
+        return;
+    }
+    n = simRecordCopy(copy);
+    fprintf(fd, "# time_ns code fifo (1 = queued for the pacer)\n");
+    for(i=0;i<n;i++)
+        fprintf(fd, "%lld %u %d\n", (long long)copy[i].t, copy[i].code, copy[i].fifo);
+    fclose(fd);
+    free(copy);
+    printf("%lu DAC writes written to %s (%llu recorded)\n", n, file, sim.rec_count);
+}
+/* Load an input script and play it from now on (thread SimScript).
+Each line is "<seconds> dio <value>" (Port A inputs, 0x.. for hex) or
+"<seconds> adc <channel> <volts>" (+/-10V), in time order */
+bool simScriptStart(const char* file){
+    char line[128], kind[8];
+    double t, v;
+    long val;
+    int ch, number = 0;
+    FILE* fd;
+    pthread_t tid;
+    if((fd = fopen(file, "r")) == NULL){
+        perror(file);
+        return false;
+    }
+    simScriptCount = 0;
+    while(fgets(line, sizeof(line), fd) != NULL && simScriptCount < SIM_SCRIPT_MAX){
+        number++;
+        if(sscanf(line, " %7s", kind) != 1 || kind[0] == '#')
+            continue;
+        if(sscanf(line, "%lf dio %li", &t, &val) == 2){
+            simScript[simScriptCount].kind = SIM_EVENT_DIO;
+            simScript[simScriptCount].ch = 0;
+            simScript[simScriptCount].val = (uint16_t)(val & 0xff);
+        }
+        else if(sscanf(line, "%lf adc %d %lf", &t, &ch, &v) == 3 && ch >= 0 && ch < 16){
+            simScript[simScriptCount].kind = SIM_EVENT_ADC;
+            simScript[simScriptCount].ch = ch;
+            v = v*32768/10 + 32768;
+            simScript[simScriptCount].val = (uint16_t)(v < 0 ? 0 : v > 65535 ? 65535 : lrint(v));
+        }
+        else{
+            printf("%s:%d: expected <seconds> dio <value> or <seconds> adc <channel> <volts>\n", file, number);
+            continue;
+        }
+        if(simScriptCount && t < simScript[simScriptCount - 1].t){
+            printf("%s:%d: times must not go back\n", file, number);
+            continue;
+        }
+        simScript[simScriptCount++].t = t;
+    }
+    fclose(fd);
+    if(simScriptCount == 0){
+        printf("%s has no input event.\n", file);
+        return false;
+    }
+    simScriptStarted = monoNow();
+    if(pthread_create(&tid, NULL, &SimScript, NULL) != 0)
+        return false;
+    pthread_detach(tid);
+    return true;
+}
+// Thread applying the script events at their times
+void* SimScript(void* pointer){
+    struct timespec ts;
+    int64_t at;
+    int i;
+    (void)pointer;
+    for(i=0;i<simScriptCount;i++){
+        at = simScriptStarted + (int64_t)(simScript[i].t*1e9);
+        ts.tv_sec = at/1000000000;
+        ts.tv_nsec = at%1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        if(simScript[i].kind == SIM_EVENT_DIO)
+            simSetDIO((uint8_t)simScript[i].val);
+        else
+            simSetADC(simScript[i].ch, simScript[i].val);
+    }
+    return NULL;
+}
+
+// Board interrupt: simIntrWait returns once per interrupt raised
+int simIntrAttach(int irq){
+    if(irq != SIM_IRQ)
+        return -1;
+    pthread_mutex_lock(&sim.lock);
+    sim.irq_pending = false;
+    pthread_mutex_unlock(&sim.lock);
+    return 1;
+}
+void simIntrDetach(int id){
+    (void)id;
+}
+void simIntrUnmask(int irq, int id){
+    (void)irq;
+    (void)id;
+}
+/* Wait up to timeout ns for the pending interrupt. While the ADC pacer
+runs, the thread wakes when the FIFO is due to reach half full, or at
+the next tick in burst mode, so that the lazy model raises the
+interrupt in time */
+int simIntrWait(uint64_t timeout){
+    struct timespec start, now, wake;
+    double left, step, tick, due;
+    int rc = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(&sim.lock);
+    while(1){
+        simADCService();
+        if(sim.irq_pending)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = timeout ? timeout/1e9 - ((now.tv_sec - start.tv_sec)
+            + (now.tv_nsec - start.tv_nsec)/1e9) : 3600;
+        if(left <= 0){
+            rc = ETIMEDOUT;
+            break;
+        }
+        step = left;
+        if(sim.adc_paced && ((sim.reg[1][4] & ADC_BURST) || sim.adc_count < ADC_FIFO_HALF)){
+            tick = (double)sim.adc_div[0]*sim.adc_div[1]/PACER_CLOCK;
+            due = (sim.adc_ticks + ((sim.reg[1][4] & ADC_BURST) ? 1 : ADC_FIFO_HALF - sim.adc_count))*tick
+                - ((now.tv_sec - sim.adc_start.tv_sec) + (now.tv_nsec - sim.adc_start.tv_nsec)/1e9);
+            if(due < step)
+                step = due > 0 ? due : 0;
+        }
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += (long)(step*1e9) % 1000000000L + 1000;
+        wake.tv_sec += (time_t)step + wake.tv_nsec/1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&sim.irq_cond, &sim.lock, &wake);
+    }
+    sim.irq_pending = false;
+    pthread_mutex_unlock(&sim.lock);
+    if(rc){
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+#ifndef __QNX__
+// QNX kernel calls of non-QNX builds
+int ThreadCtl(int cmd, void* data){
+    cpu_set_t set;
+    int cpu;
+	// Runmask: bit n lets the calling thread run on CPU n
+    if(cmd == _NTO_TCTL_RUNMASK){
+        CPU_ZERO(&set);
+        for(cpu=0;cpu<32;cpu++)
+            if((uintptr_t)data & (1u << cpu))
+                CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set);
+    }
+    return 0;
+}
+unsigned delay(unsigned int msec){
+    struct timespec ts;
+    ts.tv_sec = msec/1000;
+    ts.tv_nsec = (msec%1000)*1000000L;
+    nanosleep(&ts, NULL);
+    return 0;
+}
+int nanospin_ns(unsigned long nsec){
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    while((unsigned long)((now.tv_sec - start.tv_sec)*1000000000L
+        + now.tv_nsec - start.tv_nsec) < nsec);
+    return 0;
+}
+int tcischars(int fd){
+    int n = 0;
+    if(ioctl(fd, FIONREAD, &n) < 0)
+        return 0;
+    return n;
+}
+#endif
+
+//*************************************************************//
+//                         Benchmarks
+//*************************************************************//
+// Benchmarks are selected with --bench <name> and run in place of the UI
+int runBenchmark(const char* name){
+	// These count what the simulated board sees
+    const char* simBenches[] = {"pacer", "iocount", "adcscan", "capture", "drift",
+        "stream", "burst", "board", "sink"};
+    int k;
+    for(k=0;k<(int)(sizeof(simBenches)/sizeof(simBenches[0]));k++)
+        if(strcmp(name, simBenches[k]) == 0 && (sinking ? sinkBoard : board) != &boardSim){
+            printf("--bench %s needs the simulated board (--board sim).\n", name);
+            return 1;
+        }
+    if(strcmp(name, "pacer") == 0)
+        return benchPacer();
+    if(strcmp(name, "iocount") == 0)
+        return benchIOCount();
+    if(strcmp(name, "adcscan") == 0)
+        return benchADCScan();
+    if(strcmp(name, "capture") == 0)
+        return benchCapture();
+    if(strcmp(name, "drift") == 0)
+        return benchDrift();
+    if(strcmp(name, "stream") == 0)
+        return benchStream();
+    if(strcmp(name, "burst") == 0)
+        return benchBurst();
+    if(strcmp(name, "board") == 0)
+        return benchBoard();
+    if(strcmp(name, "sink") == 0)
+        return benchSink();
+    if(strcmp(name, "manager") == 0)
+        return benchManager();
+    if(strcmp(name, "seqlock") == 0)
+        return benchSeqlock();
+    if(strcmp(name, "wavegen") == 0)
+        return benchWaveGen();
+    if(strcmp(name, "trace") == 0)
+        return benchTrace();
+    if(strcmp(name, "rt") == 0)
+        return benchRT();
+    if(strcmp(name, "sweep") == 0)
+        return benchSweep();
+    if(strcmp(name, "mod") == 0)
+        return benchMod();
+    if(strcmp(name, "seq") == 0)
+        return benchSeq();
+    if(strcmp(name, "dash") == 0)
+        return benchDash();
+    if(strcmp(name, "ctrl") == 0)
+        return benchCtrl();
+    if(strcmp(name, "status") == 0)
+        return benchStatus();
+    if(strcmp(name, "awg") == 0)
+        return benchAWG();
+    printf("Unknown benchmark: %s\n", name);
+    return 1;
+}
+
+/* Paced output on the simulated board
+
+Runs PushDAC in paced mode for 2 s at several frequencies and reports
+the conversions done by the simulated pacer, FIFO underruns, the output
+frequency they give and the process CPU use. Fails if a refill overflows
+the FIFO or the output frequency is off by more than 1%. Underruns only
+depend on how late the host wakes the thread and are reported as is.
+*/
+int benchPacer(){
+    float freqs[] = {0.5, 10, 100, 1000, 1750, 5000};
+    int k, failed = 0;
+    pthread_t tid;
+    struct timespec t0, t1, c0, c1;
+    double wall, cpu, fout;
+    usePacer = true;
+    printf("\n%10s%8s%8s%14s%12s%14s%8s\n", "Freq(Hz)", "Spp", "Div",
+        "Conversions", "Underruns", "Freq out(Hz)", "CPU %");
+    for(k=0;k<(int)(sizeof(freqs)/sizeof(freqs[0]));k++){
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, freqs[k], 0, 1);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        DAC.pushAlive = 1;
+        pthread_mutex_unlock(&MainMutex);
+        simReset();
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0);
+        pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+        sleep(2);
+        DAC.isOn = false;
+        pthread_join(tid, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1);
+        wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+        cpu = (c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec)/1e9;
+        fout = sim.conversions/(double)DAC.samples_per_period/wall;
+        printf("%10.2f%8d%8u%14llu%12llu%14.3f%8.2f\n", freqs[k],
+            DAC.samples_per_period, DAC.pacer_div, sim.conversions,
+            sim.underruns, fout, 100*cpu/wall);
+        if(sim.overflows || !DAC.pacer_div || fabs(fout - freqs[k]) > 0.01*freqs[k])
+            failed = 1;
+    }
+    printf("\nPacer benchmark %s\n", failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Port writes per period
+
+Counts every port write made by PushDAC on the simulated board while it
+outputs a 100Hz sine for 1 s, in software timed and in paced mode. The
+software loop must write the control register and clear the FIFO once
+per waveform. In both modes there must be exactly one data write per
+sample output (ticks of the timing trace, samples counted by fillFIFO),
+and the recorded data writes must step through the table one sample at
+a time, so a duplicated or dropped write fails.
+*/
+int benchIOCount(){
+    int mode, failed = 0;
+    unsigned long long ctl, clr, data, pacer, periods, samples, k, bad;
+    SimWrite* rec;
+    unsigned long n;
+    pthread_t tid;
+    rec = malloc(SIM_RECORD_SIZE*sizeof(SimWrite));
+    if(rec == NULL || !simRecord(true)){
+        printf("Out of memory for the DAC write record.\n");
+        free(rec);
+        return 1;
+    }
+    printf("\n%10s%10s%10s%10s%10s%10s%10s%12s%16s\n", "Mode", "Spp", "CTLREG",
+        "FIFOCLR", "Pacer", "Data", "Samples", "Out of seq", "Writes/period");
+    for(mode=0;mode<2;mode++){
+        usePacer = mode;
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, 100, 0, 1);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        DAC.pushAlive = 1;
+        pthread_mutex_unlock(&MainMutex);
+        memset(&dacTrace[0], 0, sizeof(dacTrace[0]));
+        DAC.fifo_samples = 0;
+        simReset();
+        simRecord(true);
+        pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+        sleep(1);
+        DAC.isOn = false;
+        pthread_join(tid, NULL);
+        ctl = simWrites(DA_CTLREG);
+        clr = simWrites(DA_FIFOCLR);
+        data = simWrites(DA_Data);
+        pacer = simWrites(PACERCTL) + simWrites(PACER2) + simWrites(PACER3);
+        samples = mode ? DAC.fifo_samples : dacTrace[0].head;
+        periods = data/DAC.samples_per_period;
+		// Write k must be table sample k (the waveform does not change)
+        n = simRecordCopy(rec);
+        bad = 0;
+        for(k=0;k<n;k++)
+            if(rec[k].code != DAC.published->data[k % DAC.samples_per_period])
+                bad++;
+        printf("%10s%10d%10llu%10llu%10llu%10llu%10llu%12llu%16.3f\n",
+            mode ? "Paced" : "Software", DAC.samples_per_period, ctl, clr,
+            pacer, data, samples, bad, periods ? (double)(ctl + clr + pacer + data)/periods : 0.0);
+        if(data != samples || n != data || bad || periods == 0)
+            failed = 1;
+        if(!mode && (ctl != 1 || clr != 1))
+            failed = 1;
+    }
+    simRecord(simRecordFile != NULL);
+    free(rec);
+    printf("\nPort write count %s (software mode: 1 CTLREG + 1 FIFOCLR per "
+        "waveform, exactly 1 data write per sample, in table order)\n", failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* ADC knob scan on the simulated board
+
+Checks 100 scans of adcScan against the register model: no software
+start, one end of acquisition interrupt and two data reads per scan,
+both channels read back in order and no end-of-conversion polling. Every
+10th scan follows a late one, so bursts left behind would be read in
+place of the new values. Then
+runs PeripheralInputs and times how long a knob change takes to reach
+adc_in (must be below 10 ms), and counts the thread's wakeups (only the
+scan interrupts, at most ADC_KNOB_HZ a second), its ADC data reads (two
+per wakeup) and its CPU use.
+*/
+int benchADCScan(){
+    const int n = 100;
+    uint16_t v[ADC_SCAN_CHANNELS];
+    int k, bad = 0, failed;
+    long lat, max_lat = 0;
+    double sum_lat = 0, cpu, wakeups;
+    unsigned long long starts, polls, irqs, reads;
+    pthread_t tid;
+    struct timespec t0, t1, c0, c1, pause = {0, 100000};
+    if(!adcAttach()){
+        printf("ADC interrupt could not be attached\n");
+        return 1;
+    }
+    simReset();
+    irqs = sim.irq_raised;
+    for(k=0;k<n;k++){
+		// Every 10th scan follows a late one, taken after several bursts
+        if(k % 10 == 9){
+            delay(3*ADC_KNOB_MS);
+            adcScan(v);
+        }
+        simSetADC(0, (uint16_t)(k*13));
+        simSetADC(1, (uint16_t)(0xffff - k));
+        if(!adcScan(v) || v[0] != (uint16_t)(k*13) || v[1] != (uint16_t)(0xffff - k))
+            bad++;
+    }
+    starts = simWrites(AD_DATA);
+    polls = simReads(MUXCHAN);
+    reads = simReads(AD_DATA);
+    irqs = sim.irq_raised - irqs;
+    adcDetach();
+    printf("\n%d scans: %d wrong, %llu software starts, %llu interrupts, %llu data reads, %llu EOC polls\n",
+        n, bad, starts, irqs, reads, polls);
+    if(reads != (unsigned long long)(n + n/10)*ADC_SCAN_CHANNELS)
+        bad++;
+	// Knob response through the running PeripheralInputs thread
+    pthread_create(&tid, NULL, &PeripheralInputs, NULL);
+    delay(20);
+    for(k=1;k<=20;k++){
+        simSetADC(1, (uint16_t)(k*1000));
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        while(adc_in[1] != (uint16_t)(k*1000))
+            nanosleep(&pause, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        lat = (t1.tv_sec - t0.tv_sec)*1000000000L + t1.tv_nsec - t0.tv_nsec;
+        sum_lat += lat;
+        if(lat > max_lat)
+            max_lat = lat;
+        delay(13);
+    }
+	// Wakeups and CPU use of the thread alone (this thread sleeps)
+    simReset();
+    irqs = sim.irq_raised;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sleep(1);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    irqs = sim.irq_raised - irqs;
+    starts += simWrites(AD_DATA);
+    reads = simReads(AD_DATA);
+    stopProgram();
+    pthread_join(tid, NULL);
+    cpu = ((c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec)/1e9)
+        / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9);
+    wakeups = irqs / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9);
+    printf("Knob response: mean %.2f ms, max %.2f ms\n", sum_lat/20/1e6, max_lat/1e6);
+    printf("PeripheralInputs: %.1f wakeups/s, %.1f ADC data reads/s, CPU use %.2f %%\n", wakeups,
+        reads / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9), 100*cpu);
+    failed = bad || polls || starts || irqs == 0 || wakeups > 1.1*ADC_KNOB_HZ
+        || reads > (irqs + 1)*ADC_SCAN_CHANNELS || max_lat >= 10000000;
+    printf("\nADC scan %s (paced, no software start or polling, knob latency below 10 ms)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* ADC capture on the simulated board
+
+Captures 2 channels for 3 s at 100 kS/s and 200 kS/s and reads the file
+back. The simulated inputs are 0 and 0x8000, and paced samples add the
+scan number, so every channel must count up by one per scan. Both rates
+must be sustained: fails on any ring overrun, ADC FIFO overflow or gap
+in the file, or if the header does not match the file. Checks first
+that the ADC pacer is the BADR3 + 0..3 8254 and leaves the DAC pacer alone.
+The host stalls longer than the FIFO lasts are counted alongside (a
+thread sleeping 1 ms at a time at the capture thread's policy), as no
+reader can prevent those overflows. CaptureADC runs SCHED_FIFO (--rt
+priority, or RT_BENCH_PRIO) so that the writer cannot delay it. An
+overflow is excused if the host also kept the sleeping thread waiting
+(STALL_SPAN_NS or more) within the FIFO's length before it, and then
+only with the two gaps (one per channel) of the restarted scan.
+*/
+volatile bool stallRun;
+volatile unsigned long long stallCount;
+volatile int64_t stallLimit;
+int stallSpans;									//Host delays of STALL_SPAN_NS or more, kept in
+int64_t stallFrom[STALL_SPANS], stallTo[STALL_SPANS];	//the spans they happened in (ns)
+/* Count the host stalls longer than stallLimit ns and keep the delays of
+STALL_SPAN_NS or more (also used by benchStream). Runs at the policy of
+the output threads (rtOutput), so that the rest of the process does not
+count as the host */
+void* hostStalls(void* arg){
+    struct timespec ts;
+    int64_t next, from, late;
+    (void)arg;
+    rtOutput();
+    next = monoNow();
+    while(stallRun){
+        from = next;
+        next += 1000000;
+        ts.tv_sec = next/1000000000;
+        ts.tv_nsec = next%1000000000;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        late = monoNow() - next;
+        if(late > stallLimit)
+            stallCount++;
+        if(late >= STALL_SPAN_NS && stallSpans < STALL_SPANS){
+            stallFrom[stallSpans] = from;
+            stallTo[stallSpans++] = monoNow();
+        }
+        next = monoNow();
+    }
+    return NULL;
+}
+/* Losses of the simulated board (simLost) with no host delay in them or
+in the fifo ns before them (the FIFO filled or emptied then) */
+int lostUnexplained(int64_t fifo){
+    int i, j, n;
+    pthread_mutex_lock(&sim.lock);
+	// Losses beyond the ones kept cannot be checked
+    n = sim.lost > SIM_LOST_MAX ? sim.lost - SIM_LOST_MAX : 0;
+    for(i=0;i<sim.lost && i<SIM_LOST_MAX;i++){
+        for(j=0;j<stallSpans;j++)
+            if(sim.lost_from[i] - fifo < stallTo[j] && stallFrom[j] < sim.lost_to[i])
+                break;
+        if(j == stallSpans)
+            n++;
+    }
+    pthread_mutex_unlock(&sim.lock);
+    return n;
+}
+int benchCapture(){
+    const char* file = "/tmp/wavegen_capture.bin";
+    float rates[] = {100000, 200000};
+    CaptureHeader hdr;
+    uint16_t buf[CAPTURE_BLOCK];
+    uint16_t expect[2];
+    unsigned long long n, gaps;
+    struct timespec c0, c1;
+    pthread_t stall;
+    double cpu;
+    int k, i, r, lost, prio = rtPrio, failed = 0;
+    FILE* fd;
+    simSetADC(0, 0);
+    simSetADC(1, 0x8000);
+    simReset();
+    sim.adc_stamp = true;
+    adcPacer(100000);
+    printf("\nADC pacer: %llu writes to its 8254, %llu to the DAC pacer\n",
+        simWrites(COUNTCTL) + simWrites(TIMER1) + simWrites(TIMER2),
+        simWrites(PACERCTL) + simWrites(PACER1) + simWrites(PACER2) + simWrites(PACER3));
+    if(simWrites(TIMER1) != 2 || simWrites(TIMER2) != 2
+            || simWrites(PACERCTL) + simWrites(PACER1) + simWrites(PACER2) + simWrites(PACER3))
+        failed = 1;
+	// CaptureADC above CaptureWriter and the rest of the process
+    if(!rtPrio)
+        rtPrio = RT_BENCH_PRIO;
+    printf("\n%10s%12s%12s%10s%10s%8s%14s%14s\n", "Rate(S/s)", "Samples",
+        "Overruns", "Overflow", "Gaps", "CPU %", "Host stalls", "Not in stall");
+    for(k=0;k<2;k++){
+        stallLimit = (int64_t)(1e9*(ADC_FIFO_SIZE - ADC_FIFO_HALF)/rates[k]);
+        stallCount = stallSpans = 0;
+        stallRun = true;
+        simReset();
+        pthread_create(&stall, NULL, &hostStalls, NULL);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0);
+        runCapture(file, rates[k], 2, 3);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1);
+        stallRun = false;
+        pthread_join(stall, NULL);
+        lost = lostUnexplained((int64_t)(1e9*ADC_FIFO_SIZE/rates[k]));
+        cpu = (c1.tv_sec - c0.tv_sec) + (c1.tv_nsec - c0.tv_nsec)/1e9;
+		// Read back: channel c must be input + scan number
+        fd = fopen(file, "rb");
+        if(fd == NULL || fread(&hdr, sizeof(hdr), 1, fd) != 1){
+            printf("Cannot read %s\n", file);
+            return 1;
+        }
+        gaps = n = 0;
+        expect[0] = 0;
+        expect[1] = 0x8000;
+        while((r = fread(buf, sizeof(uint16_t), CAPTURE_BLOCK, fd)) > 0){
+            for(i=0;i<r;i++,n++){
+                if(buf[i] != expect[n%2])
+                    gaps++;
+                expect[n%2] = buf[i] + 1;
+            }
+        }
+        fclose(fd);
+        printf("%10.0f%12llu%12llu%10llu%10llu%8.2f%14llu%14d\n", hdr.rate, n,
+            (unsigned long long)hdr.overruns, capFifoOverflows, gaps, 100*cpu/3, stallCount, lost);
+        if(capOverruns || lost || gaps > 2*capFifoOverflows || hdr.samples != n || hdr.channels != 2
+                || memcmp(hdr.magic, CAPTURE_MAGIC, 4) || n < 0.9*rates[k]*3)
+            failed = 1;
+    }
+    printf("CaptureADC policy: %s\n", rtActive ? "SCHED_FIFO" : "default (no privileges for SCHED_FIFO)");
+    rtPrio = prio;
+    sim.adc_stamp = false;
+    remove(file);
+    printf("\nADC capture %s (own pacer, no ring overruns, FIFO overflows or gaps outside host stalls)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Long-run rate of the software timed output
+
+Runs the software timed PushDAC for 3 s at 10, 100 and 1000Hz (100
+samples per period) and measures the rate of the data writes from the
+first to the last one, next to the relative timing PushDAC used before
+(out16 then nanospin_ns of the period less the write cost). Fails if the
+deadline timed rate is off by more than 100 ppm at up to 10 kS/s.
+*/
+void* driftRelative(void* arg){
+    long nanospin_time = (long)(1e9/(DAC.freq*DAC.samples_per_period));
+    int i = 0;
+    (void)arg;
+    board->out16(DA_CTLREG, 0x0a23);
+    while(keepPushing(&DAC)){
+        board->out16(DA_Data, DAC.data[i]);
+        if(++i == DAC.samples_per_period)
+            i = 0;
+        nanospin_ns(nanospin_time - calib.write_ns);
+    }
+    return NULL;
+}
+int benchDrift(){
+    float freqs[] = {10, 100, 1000};
+    double rate, ppm[2];
+    int k, mode, failed = 0;
+    pthread_t tid;
+    usePacer = false;
+    useDDS = false;
+    printf("\n%10s%12s%18s%18s\n", "Freq(Hz)", "Rate(S/s)", "Deadline (ppm)", "Relative (ppm)");
+    for(k=0;k<(int)(sizeof(freqs)/sizeof(freqs[0]));k++){
+        for(mode=0;mode<2;mode++){
+            pthread_mutex_lock(&MainMutex);
+            change(true, 1, freqs[k], 0, 1);
+            WaveformGen(&DAC);
+            publishWave(&DAC);
+            DAC.pushAlive = 1;
+            pthread_mutex_unlock(&MainMutex);
+            simReset();
+            pthread_create(&tid, NULL, mode ? &driftRelative : &PushDAC, (void *)&DAC);
+            sleep(3);
+            DAC.isOn = false;
+            pthread_join(tid, NULL);
+            rate = (sim.conversions - 1)/((sim.last_conv - sim.first_conv)/1e9);
+            ppm[mode] = (rate/(freqs[k]*100) - 1)*1e6;
+        }
+        printf("%10.0f%12.0f%18.1f%18.1f\n", freqs[k], freqs[k]*100, ppm[0], ppm[1]);
+        if(freqs[k]*100 <= 10000 && fabs(ppm[0]) > 100)
+            failed = 1;
+    }
+    printf("\nSoftware timing drift %s (deadline timed rate within 100 ppm up to 10 kS/s)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Sustained rate of a multi-GB stream replay
+
+Writes a STREAM_BENCH_MB file of floats (a ramp over the DAC range),
+drops it from the cache and replays it through the simulated DAC as fast
+as the output goes, reporting the sustained samples/s, the read rate and
+the peak memory use. Then plays it paced at 100 kS/s for 3 s. Fails if a
+sample is lost (DAC conversions and the last code must match the file),
+if the memory use grows with the file, or if the paced replay underruns,
+in the ring or in the simulated DAC FIFO. The output thread runs
+SCHED_FIFO for the paced replay (--rt priority, or RT_BENCH_PRIO), and
+the host stalls longer than half a FIFO lasts (5.12 ms) are counted
+alongside, as no thread can refill the FIFO through those: a DAC FIFO
+underrun is only excused if the host also kept hostStalls waiting within
+the FIFO's length before it.
+*/
+int benchStream(){
+    const char* file = "/tmp/wavegen_stream.f32";
+    unsigned long long total = (unsigned long long)STREAM_BENCH_MB*1024*1024/sizeof(float), k;
+    float* block;
+    struct rusage ru;
+    struct timespec t0, t1;
+    double wall;
+    long rss0;
+    int fd, i, failed = 0;
+    bool pacer = usePacer;
+    int prio = rtPrio, lost;
+    pthread_t stall;
+    block = malloc(STREAM_BLOCK*sizeof(float));
+    fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(block == NULL || fd == -1){
+        perror(file);
+        return 1;
+    }
+	// Sample k is DAC code k%65536, in volts
+    printf("\nWriting %d MB to %s\n", STREAM_BENCH_MB, file);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(k=0;k<total;k+=STREAM_BLOCK){
+        for(i=0;i<STREAM_BLOCK;i++)
+            block[i] = (((k + i) & 0xffff) - 0x7FFF)*(float)STREAM_RES;
+        if(write(fd, block, STREAM_BLOCK*sizeof(float)) != STREAM_BLOCK*sizeof(float)){
+            perror(file);
+            close(fd);
+            remove(file);
+            return 1;
+        }
+    }
+    fsync(fd);
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
+    free(block);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+    printf("%llu samples written in %.2f s\n", total, wall);
+	// Replay as fast as possible
+    getrusage(RUSAGE_SELF, &ru);
+    rss0 = ru.ru_maxrss;
+    simReset();
+    usePacer = false;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    runStream(file, -1, STREAM_DEPTH, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1e9;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("\n%-28s%14.0f\n", "Sustained samples/s", strRing.next/wall);
+    printf("%-28s%14.1f\n", "File read (MB/s)", strRead/wall/1e6);
+    printf("%-28s%14llu\n", "DAC conversions", sim.conversions);
+    printf("%-28s%14ld\n", "Peak RSS growth (kB)", ru.ru_maxrss - rss0);
+    if(strRing.next != total || sim.conversions != total
+            || sim.dac_out != ((total - 1) & 0xffff)
+            || ru.ru_maxrss - rss0 > (long)(4*STREAM_DEPTH*STREAM_BLOCK*sizeof(uint16_t)/1024) + 16384)
+        failed = 1;
+	// Real-time replay for 3 s, board timed
+    usePacer = true;
+    if(rtPrio == 0)
+        rtPrio = RT_BENCH_PRIO;
+    simReset();
+    stallLimit = (int64_t)(1e9*DAC_FIFO_HALF/100000);
+    stallCount = stallSpans = 0;
+    stallRun = true;
+    pthread_create(&stall, NULL, &hostStalls, NULL);
+    runStream(file, 100000, STREAM_DEPTH, 3);
+    stallRun = false;
+    pthread_join(stall, NULL);
+    lost = lostUnexplained((int64_t)(1e9*DAC_FIFO_SIZE/100000));
+    printf("%-28s%14llu\n", "Paced underruns", strUnderruns);
+    printf("%-28s%14llu\n", "Simulated FIFO underruns", sim.underruns);
+    printf("%-28s%14llu\n", "Host stalls", stallCount);
+    printf("%-28s%14d\n", "Underruns not in stall", lost);
+    if(strUnderruns || lost || strRing.next < 0.9*100000*3)
+        failed = 1;
+    usePacer = pacer;
+    rtPrio = prio;
+    remove(file);
+    printf("\nStreaming playback %s (every sample output, bounded memory, no ring underruns or DAC FIFO underruns outside host stalls)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Trigger to first sample latency of a triggered burst
+
+Runs DAC0 in burst mode (3 periods of a 1kHz sine on Port A bit 4) on
+the simulated board, software timed and then paced, and raises the
+trigger bit BURST_BENCH_N times. The latency is taken from the simulated
+edge to the first conversion (with the pacer, its first tick) and shown
+next to the latency the output thread measured itself. Fails if a burst
+is not exactly 3 periods followed by the mean, or if the median latency
+is above BURST_BENCH_NS.
+*/
+int benchBurst(){
+    long lat[BURST_BENCH_N];
+    int64_t first;
+    unsigned long long expect;
+    pthread_t tid;
+    int k, mode, spp, bad, failed = 0;
+    uint32_t div;
+    int32_t center;
+    bool pacer = usePacer;
+    useDDS = false;
+    useDual = false;
+    burst.cycles = 3;
+    burst.bit = 4;
+    burst.falling = false;
+    printf("\n%10s%8s%12s%12s%12s%14s%14s\n", "Timing", "Bursts", "Median ns", "99% ns", "Max ns",
+        "Own median ns", "Own max ns");
+    for(mode=0;mode<2;mode++){
+        usePacer = mode;
+        memset(&burstStats, 0, sizeof(burstStats));
+        simSetDIO(0);
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, 1000, 0, 5);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        DAC.pushAlive = 1;
+        spp = DAC.samples_per_period;
+        div = DAC.pacer_div;
+        center = DAC.published->center;
+        pthread_mutex_unlock(&MainMutex);
+        pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+        delay(20);
+        bad = 0;
+        for(k=0;k<BURST_BENCH_N;k++){
+            simReset();
+            simSetDIO(0x10);
+            while(burstStats.triggers == (unsigned long long)k)
+                delay(1);
+			// 3 ms of burst, and the paced FIFO draining to the mean
+            delay(mode ? 60 : 10);
+            pthread_mutex_lock(&sim.lock);
+            if(mode)
+                first = (int64_t)sim.pacer_start.tv_sec*1000000000 + sim.pacer_start.tv_nsec
+                    + (int64_t)div*1000000000/PACER_CLOCK;
+            else
+                first = sim.first_conv;
+            lat[k] = (long)(first - sim.dio_time);
+			// Burst, then the mean (queued behind it when paced) and the mean held while armed
+            expect = 3ULL*spp + 1 + mode;
+            if(sim.conversions != expect || sim.dac_out != center)
+                bad++;
+            pthread_mutex_unlock(&sim.lock);
+            simSetDIO(0);
+            delay(2);
+        }
+        DAC.isOn = false;
+        pthread_join(tid, NULL);
+        qsort(lat, BURST_BENCH_N, sizeof(long), cmpLong);
+        printf("%10s%8d%12ld%12ld%12ld%14lld%14lld\n", mode ? "Paced" : "Software", BURST_BENCH_N - bad,
+            lat[BURST_BENCH_N/2], lat[BURST_BENCH_N*99/100], lat[BURST_BENCH_N - 1],
+            (long long)histPercentile(burstStats.hist, 0.5), (long long)burstStats.max);
+        if(bad || lat[BURST_BENCH_N/2] > BURST_BENCH_NS)
+            failed = 1;
+    }
+    burst.cycles = 0;
+    usePacer = pacer;
+    printf("\nTriggered burst %s (every burst exactly 3 periods then the mean, median latency under %d us)\n",
+        failed ? "FAILED" : "passed", BURST_BENCH_NS/1000);
+    return failed;
+}
+
+/* Board access cost, recorded output jitter and scripted inputs
+
+Times DAC data writes through board against direct calls of the
+simulated backend. Then records 1 s of software timed DDS output with
+the recording simulator and works out the write rate and the jitter of
+the write intervals from the timestamps alone. Last, plays a script that
+changes Port A and analog input 0 and reads them back through board.
+Fails if a write is missing from the record, the rate is off by more
+than 1%, or a scripted input is seen more than BOARD_BENCH_NS late.
+*/
+int benchBoard(){
+    const char* file = "/tmp/wavegen_script.txt";
+    const int n = 1000000;
+    SimWrite* rec;
+    long* gap;
+    unsigned long m, k;
+    double ns[2], rate, period = 1e9/DDS_RATE;
+    int64_t t0, seen[3] = {0, 0, 0};
+    struct timespec a, b;
+    pthread_t tid;
+    FILE* fd;
+    int i, failed = 0;
+	// Cost of the indirection
+    for(i=0;i<2;i++){
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for(k=0;k<n;k++)
+            if(i)
+                board->out16(DA_Data, (uint16_t)k);
+            else
+                simOut16(DA_Data, (uint16_t)k);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        ns[i] = ((b.tv_sec - a.tv_sec)*1e9 + (b.tv_nsec - a.tv_nsec))/n;
+    }
+    printf("\n%-28s%14.2f\n", "Direct write (ns)", ns[0]);
+    printf("%-28s%14.2f\n", "Write through board (ns)", ns[1]);
+	// 1 s of software timed DDS output, recorded
+    rec = malloc(SIM_RECORD_SIZE*sizeof(SimWrite));
+    gap = malloc(SIM_RECORD_SIZE*sizeof(long));
+    if(rec == NULL || gap == NULL || !simRecord(true)){
+        printf("Out of memory for the record.\n");
+        return 1;
+    }
+    usePacer = false;
+    useDual = false;
+    useDDS = true;
+    simReset();
+    pthread_mutex_lock(&MainMutex);
+    change(true, 1, 1000, 0, 5);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    DAC.pushAlive = 1;
+    pthread_mutex_unlock(&MainMutex);
+    pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+    delay(1000);
+    DAC.isOn = false;
+    pthread_join(tid, NULL);
+    m = simRecordCopy(rec);
+    simRecord(false);
+    for(k=1;k<m;k++)
+        gap[k-1] = labs((long)(rec[k].t - rec[k-1].t - period));
+    qsort(gap, m - 1, sizeof(long), cmpLong);
+    rate = (m - 1)/((rec[m-1].t - rec[0].t)/1e9);
+    printf("\n%-28s%14lu\n", "DAC writes recorded", m);
+    printf("%-28s%14llu\n", "DAC conversions", sim.conversions);
+    printf("%-28s%14.1f\n", "Write rate (S/s)", rate);
+    printf("%-28s%14ld\n", "Interval jitter p50 (ns)", gap[(m - 1)/2]);
+    printf("%-28s%14ld\n", "Interval jitter p99 (ns)", gap[(m - 1)*99/100]);
+    printf("%-28s%14ld\n", "Interval jitter max (ns)", gap[m - 2]);
+	// The CTLREG/FIFOCLR writes are not DAC data writes
+    if(m != sim.conversions || fabs(rate - DDS_RATE) > 0.01*DDS_RATE)
+        failed = 1;
+    free(rec);
+    free(gap);
+    useDDS = false;
+	// Scripted inputs, polled through board every 1 ms
+    if((fd = fopen(file, "w")) == NULL){
+        perror(file);
+        return 1;
+    }
+    fprintf(fd, "# bench script\n0.05 dio 0x0a\n0.10 adc 0 2.5\n0.15 dio 0x05\n");
+    fclose(fd);
+    simSetDIO(0);
+    simSetADC(0, 0x8000);
+    if(!simScriptStart(file))
+        return 1;
+    t0 = simScriptStarted;
+    while(monoNow() - t0 < 300000000){
+        if(!seen[0] && board->in8(DIO_PORTA) == 0x0a)
+            seen[0] = monoNow() - t0;
+        pthread_mutex_lock(&sim.lock);
+        if(!seen[1] && sim.adc_input[0] == 0x8000 + 8192)
+            seen[1] = monoNow() - t0;
+        pthread_mutex_unlock(&sim.lock);
+        if(!seen[2] && board->in8(DIO_PORTA) == 0x05)
+            seen[2] = monoNow() - t0;
+        delay(1);
+    }
+    remove(file);
+    printf("\n%-28s%14.1f%14.1f%14.1f\n", "Script events seen (ms)", seen[0]/1e6, seen[1]/1e6, seen[2]/1e6);
+    for(i=0;i<3;i++)
+        if(seen[i] < (i + 1)*50000000 || seen[i] > (i + 1)*50000000 + BOARD_BENCH_NS)
+            failed = 1;
+    printf("\nBoard access %s (every DAC write recorded at the DDS rate, scripted inputs on time)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Output sink cost and file contents
+
+Times DAC data writes through the tap of the sink against the board
+under it, writing a raw file that must hold every sample, and with two
+threads writing at once, whose events must all be queued and replayed
+in the slots reserved (the ring has no lock to wait on). Then sinks 1 s
+of a 1kHz 5V sine, software timed and board paced, reads each WAV back
+and works out the frequency from the rising zero crossings (see
+sinkRead) and the peak. Glitches are periods the file shows cut or
+stretched by a late output thread or an underrun, as they were output.
+Fails if a file is short, an event is dropped, the frequency is off by
+more than SINK_BENCH_TOL or the peak by more than 2%.
+*/
+void* sinkBenchWriter(void* arg){
+    int k, n = *(const int*)arg;
+    for(k=0;k<n;k++)
+        board->out16(DA_Data, (uint16_t)k);
+    return NULL;
+}
+int benchSink(){
+    const char* file[2] = {"/tmp/wavegen_sink.f32", "/tmp/wavegen_sink.wav"};
+    const char* names[2] = {"Software", "Paced"};
+    const int n = 200000;
+    unsigned long long samples;
+    unsigned long glitches;
+    double ns[3], freq, peak;
+    struct timespec a, b;
+    struct stat st;
+    pthread_t tid, two[2];
+    int i, k, failed = 0;
+    if(sinking){
+        printf("--bench sink writes its own files, run it without --sink.\n");
+        return 1;
+    }
+	// Cost of the tap
+    for(i=0;i<2;i++){
+        if(i && !sinkStart(file[0], SINK_RATE))
+            return 1;
+        board->out16(DA_CTLREG, STREAM_CTLREG);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        for(k=0;k<n;k++)
+            board->out16(DA_Data, (uint16_t)k);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        ns[i] = ((b.tv_sec - a.tv_sec)*1e9 + (b.tv_nsec - a.tv_nsec))/n;
+    }
+    sinkStop();
+    if(stat(file[0], &st) != 0 || st.st_size != (off_t)(sinkState.samples*sizeof(float)) || sinkDropped)
+        failed = 1;
+	// Two threads through the tap at once
+    if(!sinkStart(file[0], SINK_RATE))
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for(i=0;i<2;i++)
+        pthread_create(&two[i], NULL, &sinkBenchWriter, (void*)&n);
+    for(i=0;i<2;i++)
+        pthread_join(two[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    ns[2] = ((b.tv_sec - a.tv_sec)*1e9 + (b.tv_nsec - a.tv_nsec))/(2*n);
+    sinkStop();
+    if(sinkDropped || sinkRing.head != 2*(unsigned long long)n || sinkRing.tail != sinkRing.head)
+        failed = 1;
+    remove(file[0]);
+    printf("\n%-28s%14.2f\n", "Write (ns)", ns[0]);
+    printf("%-28s%14.2f\n", "Write through the sink (ns)", ns[1]);
+    printf("%-28s%14.2f\n", "Same, 2 threads (ns)", ns[2]);
+    printf("%-28s%14llu\n", "Events replayed, 2 threads", sinkRing.tail);
+	// 1 s of sine, software timed then paced
+    printf("\n%10s%12s%14s%12s%10s%10s\n", "Timing", "Samples", "Freq (Hz)", "Peak (V)", "Glitches", "Dropped");
+    useDual = false;
+    useDDS = true;
+    for(i=0;i<2;i++){
+        usePacer = i;
+        simReset();
+        if(!sinkStart(file[1], SINK_RATE))
+            return 1;
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, 1000, 0, 5);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        DAC.pushAlive = 1;
+        pthread_mutex_unlock(&MainMutex);
+        pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+        delay(1000);
+        DAC.isOn = false;
+        pthread_join(tid, NULL);
+        sinkStop();
+        if(!sinkRead(file[1], SINK_RATE, &samples, &freq, &peak, &glitches))
+            return 1;
+        printf("%10s%12llu%14.3f%12.4f%10lu%10llu\n", names[i], samples, freq, peak, glitches, sinkDropped);
+        if(samples < 0.9*SINK_RATE || sinkDropped || fabs(freq - 1000) > SINK_BENCH_TOL*1000
+                || fabs(peak - 5) > 0.1)
+            failed = 1;
+        remove(file[1]);
+    }
+    usePacer = false;
+    useDDS = false;
+    printf("\nOutput sink %s (every sample in the file, frequency within %.1f%%, peak within 2%%)\n",
+        failed ? "FAILED" : "passed", SINK_BENCH_TOL*100);
+    return failed;
+}
+/* Read back a WAV file of the sink: samples, frequency and peak. The
+frequency is from the intervals between rising zero crossings within 5%
+of their median, the others (glitches: periods cut or stretched by a
+late output) are counted and left out */
+bool sinkRead(const char* file, float rate, unsigned long long* samples,
+        double* freq, double* peak, unsigned long* glitches){
+    uint8_t h[44];
+    uint32_t data, v;
+    uint16_t fmt;
+    float* buf;
+    float prev = 0;
+    long* cross = NULL;
+    long* gap;
+    unsigned long long k = 0, clean = 0, span = 0;
+    unsigned long n = 0, size = 0, i;
+    size_t m, j;
+    struct stat st;
+    FILE* fd;
+    *peak = 0;
+    if((fd = fopen(file, "rb")) == NULL || fstat(fileno(fd), &st) != 0){
+        perror(file);
+        return false;
+    }
+    if(fread(h, 1, sizeof(h), fd) != sizeof(h)){
+        printf("%s: no WAV header\n", file);
+        fclose(fd);
+        return false;
+    }
+    memcpy(&fmt, h + 20, 2);
+    memcpy(&v, h + 24, 4);
+    memcpy(&data, h + 40, 4);
+    if(memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVEfmt ", 8) || fmt != 3 || v != (uint32_t)rate
+            || data != st.st_size - sizeof(h)){
+        printf("%s: bad WAV header\n", file);
+        fclose(fd);
+        return false;
+    }
+    buf = malloc(SINK_BLOCK*sizeof(float));
+    while(buf != NULL && (m = fread(buf, sizeof(float), SINK_BLOCK, fd)) > 0)
+        for(j=0;j<m;j++,k++){
+            if(prev < 0 && buf[j] >= 0){
+                if(n == size)
+                    cross = realloc(cross, (size = 2*size + 1024)*sizeof(long));
+                if(cross == NULL)
+                    break;
+                cross[n++] = (long)k;
+            }
+            prev = buf[j];
+            *peak = fmax(*peak, fabs(buf[j]));
+        }
+    free(buf);
+    fclose(fd);
+    *samples = k;
+    *freq = 0;
+    *glitches = 0;
+    if(n < 2 || (gap = malloc(n*sizeof(long))) == NULL){
+        free(cross);
+        return true;
+    }
+    for(i=1;i<n;i++)
+        gap[i-1] = cross[i] - cross[i-1];
+    qsort(gap, n - 1, sizeof(long), cmpLong);
+    for(i=1;i<n;i++)
+        if(labs(cross[i] - cross[i-1] - gap[(n - 1)/2]) > gap[(n - 1)/2]/20)
+            (*glitches)++;
+        else{
+            clean++;
+            span += cross[i] - cross[i-1];
+        }
+    *freq = clean*rate/(double)span;
+    free(gap);
+    free(cross);
+    return true;
+}
+
+/* Parameter change latency
+
+Times change() to waitWaveAck() through a running WaveGenManager for 500
+changes (each regenerates the waveform and swaps it into the running
+PushDAC), next to the time WaveformGen and publishWave take on their own.
+*/
+int benchManager(){
+    const int n = 500;
+    long lat[500], gen[500];
+    double sum_lat = 0, sum_gen = 0;
+    int k, lost = 0;
+    pthread_t tid;
+    struct timespec t0, t1;
+    pthread_create(&tid, NULL, &WaveGenManager, NULL);
+    for(k=0;k<n;k++){
+        pthread_mutex_lock(&MainMutex);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        change(true, 1 + k%3, 100 + k, 0, 1 + k%2);
+        if(!waitWaveAck(waveRequest))
+            lost++;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        lat[k] = (t1.tv_sec - t0.tv_sec)*1000000000L + t1.tv_nsec - t0.tv_nsec;
+		// Regeneration alone, for comparison
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        gen[k] = (t1.tv_sec - t0.tv_sec)*1000000000L + t1.tv_nsec - t0.tv_nsec;
+        pthread_mutex_unlock(&MainMutex);
+        sum_lat += lat[k];
+        sum_gen += gen[k];
+        delay(2);
+    }
+    stopProgram();
+    pthread_join(tid, NULL);
+    qsort(lat, n, sizeof(long), cmpLong);
+    qsort(gen, n, sizeof(long), cmpLong);
+    printf("\n%-28s%12s%12s%12s%12s\n", "(us)", "mean", "p50", "p99", "max");
+    printf("%-28s%12.1f%12.1f%12.1f%12.1f\n", "change() -> acknowledged",
+        sum_lat/n/1000, lat[n/2]/1000.0, lat[n*99/100]/1000.0, lat[n-1]/1000.0);
+    printf("%-28s%12.1f%12.1f%12.1f%12.1f\n", "WaveformGen + publishWave",
+        sum_gen/n/1000, gen[n/2]/1000.0, gen[n*99/100]/1000.0, gen[n-1]/1000.0);
+    printf("\n%d/%d changes not acknowledged within 1 s\n", lost, n);
+    return lost != 0;
+}
+
+/* Snapshot consistency under concurrent change()
+
+Four writer threads call change() under MainMutex (as the UI and the
+peripheral thread do) with parameters tied to one counter k:
+freq = k, mean = k/1000, amp = k/500, waveform = k%3+1. A reader checks
+every snapshot from loadParams for that relation, and also reads the
+DACField fields directly to show the torn reads the snapshot prevents.
+*/
+volatile bool seqlockRun;
+void* seqlockWriter(void* arg){
+    int k = (int)(intptr_t)arg;
+    while(seqlockRun){
+        pthread_mutex_lock(&MainMutex);
+        change(false, k%3 + 1, (float)k, k/1000.0f, k/500.0f);
+        pthread_mutex_unlock(&MainMutex);
+        k = (k + 7) % 10000 + 1;
+    }
+    return NULL;
+}
+int benchSeqlock(){
+    pthread_t writer[4];
+    struct timespec t0, now;
+    WaveParams P;
+    unsigned long long reads = 0, bad = 0, torn = 0;
+    int k, f;
+    seqlockRun = true;
+	// Start from parameters that satisfy the relation (k = 1)
+    pthread_mutex_lock(&MainMutex);
+    change(false, 2, 1.0f, 1/1000.0f, 1/500.0f);
+    pthread_mutex_unlock(&MainMutex);
+    for(k=0;k<4;k++)
+        pthread_create(&writer[k], NULL, &seqlockWriter, (void*)(intptr_t)(k*2500 + 1));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do{
+        loadParams(&DAC, &P);
+        f = (int)P.freq;
+        if(P.mean != f/1000.0f || P.amp != f/500.0f || P.waveform_type != f%3 + 1)
+            bad++;
+		// Same check on the unsynchronised fields
+        f = (int)DAC.freq;
+        if(DAC.mean != f/1000.0f || DAC.amp != f/500.0f)
+            torn++;
+        reads++;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }while(now.tv_sec - t0.tv_sec < 3);
+    seqlockRun = false;
+    for(k=0;k<4;k++)
+        pthread_join(writer[k], NULL);
+    printf("\n%llu snapshots read, %llu writes\n", reads, (unsigned long long)waveRequest);
+    printf("Inconsistent snapshots (loadParams): %llu\n", bad);
+    printf("Torn reads (direct DACField access): %llu\n", torn);
+    return bad != 0;
+}
 
-		// Remove unneeded bits
-		digital_in = digital_in & 0x0f;
+/* Fixed-point WaveformGen against the double precision version
 
-		// Check if switch configuration has changed
-		if(digital_in != digital_in_old) ADC_Refresh = true;
+waveformRef is WaveformGen as it was before the unit tables: sinf and a
+double division per sample. Every waveform is generated at 100 and 1024
+samples per period over a grid of means and amplitudes covering the four
+DAC ranges, and compared sample by sample. Fails if any sample differs
+by more than 1 LSB. Timing is for the whole regeneration (range and
+sampling choice included) with the unit tables already cached, as the
+best of 20 batches of 100 calls.
+*/
+void waveformRef(DACField* D, unsigned short* out){
+    int i=0;
+    double delta_incr, dummy, res;
+    unsigned short offset=0;
+    chooseBestRes(D);
+    chooseSampling(D);
+    res = D->output_res/1000000;
+    if(D->DAC_mode<2)
+        offset+=0x7FFF;
+    switch (D->waveform_type){
+        case 1: {
+                 delta_incr=2.0*PI/D->samples_per_period;
+                 for(i=0;i<D->samples_per_period;i++) {
+                     dummy= (sinf((float)(i*delta_incr)))* D->amp + D->mean;
+                     out[i]= (unsigned short)(offset + dummy/res);
+                 }
+                 break;
+                }
+        case 2: {
+                 delta_incr=4*D->amp/D->samples_per_period;
+                 for(i=0;i<D->samples_per_period/4;i++)
+                     out[i]= (unsigned short)(offset + (delta_incr*i +D->mean)/res);
+                 for(;i<(3*D->samples_per_period/4);i++)
+                     out[i]= (unsigned short)(offset + (2*D->amp-delta_incr*i +D->mean)/res);
+                 for(;i<D->samples_per_period;i++)
+                     out[i]= (unsigned short)(offset + (-4*D->amp+delta_incr*i +D->mean)/res);
+                 break;
+                }
+        case 3: {
+                 for(i=0;i<D->samples_per_period/2;i++)
+                     out[i]= (unsigned short)(offset + (D->amp + D->mean)/res);
+                 for(;i<D->samples_per_period;i++)
+                     out[i]= (unsigned short)(offset + (-D->amp + D->mean)/res);
+                break;
+                }
+        }
+}
+int benchWaveGen(){
+    const int reps = 100;
+    float means[] = {-6, -2.5, 0, 0.3, 2.5, 4.9, 6};
+    float amps[] = {0.01, 0.5, 1, 2.4, 3.7};
+    int spps[] = {100, DDS_TABLE_SIZE};
+    unsigned short ref[MAX_SAMPLES];
+    unsigned long long samples = 0, exact = 0;
+    int type, s, m, a, i, r, b, d, max_diff = 0;
+    double t, t_ref, t_fix;
+    struct timespec t0, t1;
+    usePacer = false;
+    printf("\n%10s%6s%14s%14s%10s\n", "Type", "Spp", "double (us)", "fixed (us)", "Speedup");
+    for(type=1;type<=3;type++){
+        for(s=0;s<2;s++){
+			// Software timing gives 100 samples per period, DDS the full table
+            useDDS = (spps[s] == DDS_TABLE_SIZE);
+			// Compare over means and amplitudes within +/-10V
+            for(m=0;m<(int)(sizeof(means)/sizeof(means[0]));m++)
+                for(a=0;a<(int)(sizeof(amps)/sizeof(amps[0]));a++){
+                    if(fabs(means[m]) + amps[a] >= 10)
+                        continue;
+                    DAC.waveform_type = type;
+                    DAC.freq = 100;
+                    DAC.mean = means[m];
+                    DAC.amp = amps[a];
+                    WaveformGen(&DAC);
+                    waveformRef(&DAC, ref);
+                    for(i=0;i<DAC.samples_per_period;i++){
+                        d = abs((int)DAC.data[i] - (int)ref[i]);
+                        if(d > max_diff)
+                            max_diff = d;
+                        exact += (d == 0);
+                        samples++;
+                    }
+                }
+			// Time both versions on one setting
+            DAC.mean = 0.3;
+            DAC.amp = 2.4;
+            t_ref = t_fix = 1e9;
+            for(b=0;b<20;b++){
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                for(r=0;r<reps;r++)
+                    waveformRef(&DAC, ref);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                t = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/reps/1000;
+                if(t < t_ref)
+                    t_ref = t;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                for(r=0;r<reps;r++)
+                    WaveformGen(&DAC);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                t = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/reps/1000;
+                if(t < t_fix)
+                    t_fix = t;
+            }
+            printf("%10s%6d%14.2f%14.2f%10.1f\n", type == 1 ? "Sine" : type == 2 ? "Triangle" : "Square",
+                DAC.samples_per_period, t_ref, t_fix, t_ref/t_fix);
+        }
+    }
+    useDDS = false;
+    printf("\n%llu samples compared: %llu bit exact, max difference %d LSB\n",
+        samples, exact, max_diff);
+    printf("Fixed-point WaveformGen %s (error bound 1 LSB)\n", max_diff <= 1 ? "passed" : "FAILED");
+    return max_diff > 1;
+}
 
-		digital_in_old = digital_in;
+/* Timing trace cost and consistency
 
-		// Continue if the peripheral input is turned off
-		if (!(digital_in & 0x08))  continue;
+Times traceRecord, loop included (best of 5 batches of 10M samples).
+Then runs the software timed PushDAC at 100Hz for 2 s while another
+thread copies the trace ring every 200 us: every copy must have
+increasing deadlines and no sample released before its deadline. Fails if recording costs more than 10 ns per sample or a copy
+is inconsistent. The lateness histogram is shown as in the UI.
+*/
+volatile bool traceRun;
+unsigned long long traceCopies, traceBad;
+void* traceReader(void* arg){
+    static TraceEntry copy[TRACE_SIZE];
+    struct timespec pause = {0, 200000};
+    int i, n;
+    (void)arg;
+    while(traceRun){
+        nanosleep(&pause, NULL);
+        n = traceCopy(&dacTrace[0], copy);
+        for(i=0;i<n;i++)
+            if(copy[i].actual < copy[i].deadline || (i && copy[i].deadline <= copy[i-1].deadline)){
+                traceBad++;
+                break;
+            }
+        traceCopies++;
+    }
+    return NULL;
+}
+int benchTrace(){
+    static TimingTrace t;
+    const long n = 10000000;
+    int64_t t0, best = -1, d;
+    double cost;
+    long i;
+    int r, failed;
+    pthread_t tid, reader;
+    for(r=0;r<5;r++){
+        t0 = monoNow();
+        for(i=0;i<n;i++)
+            traceRecord(&t, i*1000, i*1000 + (i & 0xffff));
+        d = monoNow() - t0;
+        if(best < 0 || d < best)
+            best = d;
+    }
+    cost = (double)best/n;
+    printf("\ntraceRecord: %.2f ns per sample\n", cost);
+	// Trace a running output thread while it is being read
+    usePacer = false;
+    useDDS = false;
+    pthread_mutex_lock(&MainMutex);
+    change(true, 1, 100, 0, 1);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    DAC.pushAlive = 1;
+    pthread_mutex_unlock(&MainMutex);
+    dacTrace[0].clear = 1;
+    traceRun = true;
+    pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+    pthread_create(&reader, NULL, &traceReader, NULL);
+    sleep(2);
+    traceRun = false;
+    pthread_join(reader, NULL);
+    DAC.isOn = false;
+    pthread_join(tid, NULL);
+    printf("%llu copies of the trace ring, %llu inconsistent\n\n", traceCopies, traceBad);
+    showTrace(&dacTrace[0], "DAC0");
+    failed = cost > 10 || traceBad != 0 || traceCopies == 0;
+    printf("Timing trace %s (recording cost below 10 ns, consistent copies)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
 
-		else {
-			// Assume the DAC to be on
-			isOn = true;
-			switch ((digital_in & 0x03)) {
-				case 1: { wavef = 1; break; }
-				case 2: { wavef = 2; break; }
-				case 3: { wavef = 3; break; }
-				// Set isOn to be off is bit 0 and 1 are off
-				default:   { isOn = false; break; }
-			}
-			/* Only set the hasChanged flag if the current
-			configuration is different from the previous one */
-			if (CField.waveform_type != wavef) {
-				CField.waveform_type = wavef;
-				hasChanged = true;
-			}
-			if (CField.isOn != isOn) {
-				CField.isOn = isOn;
-				hasChanged = true;
-			}
-			// Get the bit value of bit 2
-			mean_amp = ((digital_in & 0x04) >> 2);
-			/*
-			ADC[0] - for mean and amplitude
-			- check whether the difference in new & old values is
-			more than threshold before trying to change
-			*/
-			if (abs((int)adc_in[0] - (int)old_adc_in[0]) > THRESHOLD) {
-				// Change amplitude if bit 2 is set
-				if (mean_amp == 1) {
-					temp = (float)(adc_in[0]) * 10 / 65535;
-					// Range checking
-					if (fabs(DAC.mean + temp) < 9.8 && fabs(DAC.mean - temp) < 9.8) {
-						CField.amp = temp;
-						hasChanged = true;
-					}
-				}
-				// Change mean if bit 2 is not set
-				else {
-					temp = (float)(adc_in[0]) * 10 / 32767 - 10;
-					// Range checking
-					if (fabs(DAC.amp + temp) < 9.8 && fabs(DAC.amp - temp) < 9.8) {
-						CField.mean = temp;
-						hasChanged = true;
-					}
-				}
-			}
-			/*
-			ADC[1] - dedicated for frequency
-			- check whether the difference in new & old values is
-			more than threshold before trying to change
-			*/
-			if (abs((int)adc_in[1] - (int)old_adc_in[1])>THRESHOLD) {
-				// Minimum input required (> 0x01)
-				if (adc_in[1] > 0x0001) {
-					CField.freq = (float)(adc_in[1]) * HIGHESTFREQ / 65535;
-					hasChanged = true;
-				}
-				else{
-					CField.freq = (float)(0x0001) * HIGHESTFREQ / 65535;
-					hasChanged = true;
-				}
-			}
+/* Output jitter with and without the real-time policy
 
-			// Change the value(s) if hasChanged flag is set
-			if (hasChanged) {
-			    ADC_Refresh = true;
-				// Use of mutex when changing shared global variables
-				pthread_mutex_lock(&MainMutex);
-				change(CField.isOn, wavef, CField.freq, CField.mean, CField.amp);
-				pthread_mutex_unlock(&MainMutex);
-                hasChanged = false;
-				// Load new values to old values array
-                old_adc_in[0] = adc_in[0];
-                old_adc_in[1] = adc_in[1];
-			}
-		}
-	}
-	return(0);
+Runs the software timed PushDAC at 10Hz (1 kS/s) for 3 s while one busy
+thread per CPU competes at the default policy, first with the default
+policy for the output thread, then SCHED_FIFO (--rt priority, or
+RT_BENCH_PRIO) pinned to CPU 0 (or --cpu) with the memory locked.
+Compares the lateness of the samples (timing trace). Fails if the policy
+was applied and p99 lateness did not improve; without the privileges
+for SCHED_FIFO only the first run is meaningful and nothing fails.
+*/
+volatile bool rtLoadRun;
+void* rtLoad(void* arg){
+    volatile unsigned long x = 0;
+    (void)arg;
+    while(rtLoadRun)
+        x++;
+    return NULL;
+}
+int benchRT(){
+    int prio = rtPrio ? rtPrio : RT_BENCH_PRIO;
+    int cpu = rtCPU >= 0 ? rtCPU : 0;
+    int mode, k, ncpu, failed = 0;
+    int64_t p99[2];
+    bool applied = false;
+    pthread_t tid, load[32];
+    ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(ncpu < 1)
+        ncpu = 1;
+    if(ncpu > 32)
+        ncpu = 32;
+    usePacer = false;
+    useDDS = false;
+    printf("\n%d busy threads at the default policy\n", ncpu);
+    printf("\n%14s%12s%12s%12s%12s%10s\n", "Policy", "p50 (us)", "p99 (us)",
+        "p99.9 (us)", "max (us)", "Restarts");
+    for(mode=0;mode<2;mode++){
+        rtPrio = mode ? prio : 0;
+        rtCPU = mode ? cpu : -1;
+        rtSetup();
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, 10, 0, 1);
+        WaveformGen(&DAC);
+        publishWave(&DAC);
+        DAC.pushAlive = 1;
+        pthread_mutex_unlock(&MainMutex);
+        rtLoadRun = true;
+        for(k=0;k<ncpu;k++)
+            pthread_create(&load[k], NULL, &rtLoad, NULL);
+        dacTrace[0].clear = 1;
+        pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+        sleep(3);
+        DAC.isOn = false;
+        pthread_join(tid, NULL);
+        rtLoadRun = false;
+        for(k=0;k<ncpu;k++)
+            pthread_join(load[k], NULL);
+        if(mode)
+            applied = rtActive;
+        p99[mode] = histPercentile(dacTrace[0].hist, 0.99);
+        printf("%14s%12.1f%12.1f%12.1f%12.1f%10llu\n",
+            !mode ? "default" : applied ? "SCHED_FIFO" : "(not applied)",
+            histPercentile(dacTrace[0].hist, 0.5)/1000.0, p99[mode]/1000.0,
+            histPercentile(dacTrace[0].hist, 0.999)/1000.0, dacTrace[0].max_late/1000.0,
+            dacTrace[0].slips);
+    }
+    munlockall();
+    rtPrio = 0;
+    rtCPU = -1;
+    if(applied && p99[1] >= p99[0])
+        failed = 1;
+    printf("\nReal-time policy %s\n", !applied ? "not applied (needs privileges)"
+        : failed ? "FAILED (p99 lateness not lower)" : "passed (p99 lateness lower)");
+    return failed;
 }
 
+/* Sweep frequency and phase accuracy
 
+Steps the sweep engine through a linear and a logarithmic sweep (10Hz
+to 2kHz in 1 s at the software DDS rate) and compares every tick with
+the ideal chirp: the frequency f(t) and the phase, the integral of f.
+The summed phase trails the integral by half a tick of the frequency
+slope, which is taken out. Then times ddsStep with and without a sweep,
+and runs a repeated sweep with dwell through PushDAC. Fails if the
+frequency is off by more than the DDS step, the phase by more than
+0.01 cycle, or the live run does not complete its sweeps.
+*/
+int benchSweep(){
+    const float f0 = 10, f1 = 2000, T = 1;
+    double rate, t, f, cyc, ideal, ferr, perr, ns[2];
+    unsigned long long k, n, wraps;
+    uint32_t phase, old;
+    volatile uint32_t sink = 0;
+    pthread_t tid;
+    struct timespec t0, t1;
+    int mode, failed = 0;
+    usePacer = false;
+    useDual = false;
+    useDDS = true;
+    rate = ddsRate();
+    n = (unsigned long long)(T*rate);
+    printf("\n%12s%22s%22s%14s\n", "Sweep", "Max freq error (Hz)", "Max phase error (cyc)", "ns/tick");
+    for(mode=0;mode<2;mode++){
+        sweep.on = true;
+        sweep.log = mode;
+        sweep.start = f0;
+        sweep.stop = f1;
+        sweep.seconds = T;
+        sweep.dwell = 0;
+        sweep.repeat = 1;
+        sweepStart(&sweepRun);
+        phase = 0;
+        wraps = 0;
+        ferr = perr = 0;
+        for(k=0;k<n;k++){
+            t = k/rate;
+            f = mode ? f0*pow(f1/f0, t/T) : f0 + (f1 - f0)*t/T;
+			// Phase reached at tick k, in cycles
+            cyc = wraps + phase/4294967296.0;
+            ideal = mode ? f0*T/log(f1/f0)*(pow(f1/f0, t/T) - 1) : f0*t + (f1 - f0)*t*t/(2*T);
+            ideal -= (f - f0)/(2*rate);
+            if(fabs(cyc - ideal) > perr)
+                perr = fabs(cyc - ideal);
+            old = phase;
+            phase += ddsStep(&DAC);
+            if(phase < old)
+                wraps++;
+            if(fabs((phase - old)*rate/4294967296.0 - f) > ferr)
+                ferr = fabs((phase - old)*rate/4294967296.0 - f);
+        }
+		// Cost per tick, the sweep held at the stop frequency after its one repeat
+        sweep.repeat = 0;
+        sweep.gen++;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(k=0;k<10*n;k++)
+            sink += ddsStep(&DAC);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns[mode] = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/(10*n);
+        printf("%12s%22.6f%22.6f%14.2f\n", mode ? "Logarithmic" : "Linear", ferr, perr, ns[mode]);
+        if(ferr > 1.5*rate/4294967296.0 + 1e-6*f1 || perr > 0.01)
+            failed = 1;
+    }
+    sweep.on = false;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(k=0;k<10*n;k++)
+        sink += ddsStep(&DAC);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("%12s%22s%22s%14.2f\n", "No sweep", "", "",
+        ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/(10*n));
+	// Live: 4 sweeps of 0.2 s with 0.05 s dwell, then the stop frequency
+    sweep.on = true;
+    sweep.log = true;
+    sweep.seconds = 0.2;
+    sweep.dwell = 0.05;
+    sweep.repeat = 4;
+    sweep.gen++;
+    pthread_mutex_lock(&MainMutex);
+    change(true, 1, f0, 0, 1);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    DAC.pushAlive = 1;
+    pthread_mutex_unlock(&MainMutex);
+    pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+    delay(1500);
+    DAC.isOn = false;
+    pthread_join(tid, NULL);
+    printf("\nLive sweep: %llu/4 sweeps, ended at %.2f Hz (stop %.0f Hz)\n", sweepRun.sweeps,
+        sweepFreq(), f1);
+    if(sweepRun.sweeps != 4 || fabs(sweepFreq() - f1) > 0.01)
+        failed = 1;
+    sweep.on = false;
+    useDDS = false;
+    printf("\nFrequency sweep %s (frequency within the DDS step, phase continuous within 0.01 cycle)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
 
-//*************************************************************//
-//            Supporting Programs
-//*************************************************************//
-// Supporting function: check whether DAC will have negative data
-bool hasNegative(){
-    if( (DAC.mean-DAC.amp) < 0)
-        return true;
-    return false;
+/* Modulation depth accuracy and cost per sample
+
+Runs the DDS sample and step functions of DAC0 for 1 s of paced ticks
+(100 kS/s) with a 1kHz sine carrier (0V mean, 5V) and a 50Hz sine
+modulator, once per mode, and measures the output codes ddsSample gives,
+in volts. AM: the envelope (the peak of each carrier half period) must
+go from amp*(1-d)/(1+d) to amp. FM: the frequency from the intervals
+between rising zero crossings must go from f-dev to f+dev. PM: the shift
+of the rising zero crossings from those of the carrier must go from
+-dev to +dev. PM also runs at its 180 degree bound, where the shift at
+the 5th crossing (the modulator's first peak) must have the sign of the
+deviation. Then times a sample and a step per mode. Fails if a bound is
+off by more than sampling the carrier once per tick and the modulator
+once per carrier period (half period for AM) allows, or a sample takes
+longer than a pacer tick.
+*/
+int benchMod(){
+    const char* names[] = {"None", "AM", "FM", "PM", "PM180"};
+    const int modes[] = {MOD_NONE, MOD_AM, MOD_FM, MOD_PM, MOD_PM};
+    const float depths[] = {0, 0.5, 200, 90, 180};
+    double rate, res, v, prev, t, t_prev, x, hi, lo, peak, expect_hi, expect_lo, ns, tol, at;
+    unsigned long long k, n, crossings;
+    uint32_t phase;
+    volatile uint32_t sink = 0;
+    struct timespec t0, t1;
+    WaveBuffer* w;
+    int c, mode, window, failed = 0;
+    usePacer = true;
+    useDual = false;
+    useDDS = true;
+    sweep.on = false;
+    rate = ddsRate();
+    n = (unsigned long long)rate;
+    window = (int)lrint(rate/2000);
+    pthread_mutex_lock(&MainMutex);
+    change(false, 1, 1000, 0, 5);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    pthread_mutex_unlock(&MainMutex);
+    w = takeWave(&DAC);
+    res = DAC.output_res/1000000;
+    printf("\n%6s%14s%14s%14s%14s%10s\n", "Mode", "Low", "Expected", "High", "Expected", "ns/tick");
+    for(c=0;c<5;c++){
+        mode = modes[c];
+        modSet(mode, 1, 50, depths[c]);
+        modRun.phase = 0;
+        modRun.m = 0;
+        phase = 0;
+        hi = -1e9;
+        lo = 1e9;
+        peak = 0;
+        prev = t_prev = 0;
+        crossings = 0;
+        at = 0;
+        for(k=0;k<n;k++){
+            v = ((int)ddsSample(&DAC, w, phase) - w->center)*res;
+            phase += ddsStep(&DAC);
+			// AM: envelope, the peak of each carrier half period
+            peak = fmax(peak, fabs(v));
+            if(mode == MOD_AM && (k + 1) % window == 0){
+                hi = fmax(hi, peak);
+                lo = fmin(lo, peak);
+                peak = 0;
+            }
+			// Rising zero crossing, between this sample and the one before
+            if(k && prev < 0 && v >= 0){
+                t = (k - 1 + prev/(prev - v))/rate;
+                crossings++;
+                x = mode == MOD_PM ? (crossings/1000.0 - t)*1000*360 : 1/(t - t_prev);
+                if(mode != MOD_AM && (mode == MOD_PM || crossings > 1)){
+                    hi = fmax(hi, x);
+                    lo = fmin(lo, x);
+                }
+                if(crossings == 5)
+                    at = x;
+                t_prev = t;
+            }
+            prev = v;
+        }
+        switch(mode){
+            case MOD_AM: { expect_hi = 5; expect_lo = 5*(1 - 0.5)/(1 + 0.5);
+                           tol = 5*(1 - cos(M_PI*1000/rate)) + 5*(1 - cos(M_PI*50/2000)) + 2*res; break;}
+            case MOD_FM: { expect_hi = 1000 + depths[c]; expect_lo = 1000 - depths[c];
+                           tol = depths[c]*(1 - cos(M_PI*50/1000)) + 0.01; break;}
+			// Past 90 degrees the shift moves the crossings further from the modulator samples
+            case MOD_PM: { expect_hi = depths[c]; expect_lo = -depths[c];
+                           tol = depths[c]*(1 - cos(M_PI*50/1000*fmax(1, depths[c]/90))) + 0.01;
+                           if(at <= 0) failed = 1;
+                           break;}
+            default: { expect_hi = expect_lo = 1000; tol = 0.01; break;}
+        }
+		// Time a sample and a step
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(k=0;k<10*n;k++){
+            sink += ddsSample(&DAC, w, phase);
+            phase += ddsStep(&DAC);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/(10*n);
+        printf("%6s%14.4f%14.4f%14.4f%14.4f%10.2f\n", names[c], lo, expect_lo, hi, expect_hi, ns);
+        if(fabs(hi - expect_hi) > tol || fabs(lo - expect_lo) > tol || ns > 1e9/rate)
+            failed = 1;
+    }
+    modSet(MOD_NONE, 0, 0, 0);
+    usePacer = false;
+    useDDS = false;
+    printf("\nModulation %s (AM envelope, FM frequency and PM shift of the output at their bounds, "
+        "each sample within a pacer tick)\n", failed ? "FAILED" : "passed");
+    return failed;
 }
-// Supporting function: check absolute maximum value
-short checkAbsMax(float mean, float amp){
-    float absMax=0;
-    if(fabs(mean+amp)>fabs(mean-amp))
-        absMax = fabs(mean+amp);
-    else
-        absMax = fabs(mean-amp);
-    if(absMax<5)
+
+/* Playlist segment boundaries and switch cost
+
+Loads a playlist of four segments (sine, square, triangle and ramp of
+different lengths, means and ranges) played 3 times, checks that the
+ramp table rises from mean-amp to mean+amp, and that loading a file with
+no valid segment hands the list not yet taken back unchanged. Then steps
+the DDS sample and step functions of DAC0 through the list, comparing
+every tick with the sample of the segment it should be in at a phase
+kept apart. Then checks that the output holds the last mean, times a
+tick with a looping playlist and plays the list live through PushDAC.
+Fails if a sample is off, a segment is a tick too long or short, a tick
+takes longer than a software tick, or the live run asks WaveGenManager
+for a change.
+*/
+int benchSeq(){
+    const char* file = "/tmp/wavegen_seq.txt";
+    const char* bad = "/tmp/wavegen_seq_bad.txt";
+    const char* lines[] = {"# bench playlist", "0.01 -sin 1000 0 5", "",
+        "0.0205 -squ 2000 2 1", "0.00735 -tri 333 -1 3", "0.0042 -saw 500 0.5 2"};
+    const SeqSegment* R;
+    double rate, ns[2];
+    unsigned long long k, n, ticks = 0, wrong = 0;
+    uint32_t phase, ref;
+    volatile uint32_t sink = 0;
+    unsigned int requests;
+    struct timespec t0, t1;
+    pthread_t tid;
+    ChangeField CF;
+    const Playlist* L;
+    WaveBuffer* w;
+    FILE* fd;
+    int p, i, loop, failed = 0;
+    double res;
+    usePacer = false;
+    useDual = false;
+    useDDS = true;
+    sweep.on = false;
+    modSet(MOD_NONE, 0, 0, 0);
+    rate = ddsRate();
+    n = (unsigned long long)rate;
+    pthread_mutex_lock(&MainMutex);
+    change(false, 1, 1000, 0, 5);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    pthread_mutex_unlock(&MainMutex);
+    w = takeWave(&DAC);
+    for(loop=0;loop<2;loop++){
+        if((fd = fopen(file, "w")) == NULL){
+            perror(file);
+            return 1;
+        }
+        for(i=0;i<6;i++)
+            fprintf(fd, "%s\n", lines[i]);
+        fprintf(fd, "repeat %d\n", loop ? 0 : 3);
+        fclose(fd);
+        pthread_mutex_lock(&MainMutex);
+        if(!seqLoad(file, &CF)){
+            pthread_mutex_unlock(&MainMutex);
+            return 1;
+        }
+        pthread_mutex_unlock(&MainMutex);
+        L = seqPublished;
+        if(loop == 0){
+			// Ramp from mean-amp to mean+amp, in the list's DAC range
+            R = &L->seg[3];
+            res = 2.0*R->amp*(DDS_TABLE_SIZE - 1)/DDS_TABLE_SIZE/(R->data[DDS_TABLE_SIZE - 1] - R->data[0]);
+            for(i=1;i<DDS_TABLE_SIZE && R->data[i] >= R->data[i-1];i++);
+            printf("\n%-28s%14.4f%14.4f\n", "Ramp from, last step (V)", R->mean - (R->center - R->data[0])*res,
+                R->mean + (R->data[DDS_TABLE_SIZE - 1] - R->center)*res);
+            if(i < DDS_TABLE_SIZE || fabs((R->center - R->data[0])*res - R->amp) > 2*res
+                    || L->seg[0].waveform_type != 1 || R->waveform_type != SEQ_RAMP)
+                failed = 1;
+			// A reload with no valid segment gives the pending list back as it was
+            if((fd = fopen(bad, "w")) != NULL){
+                fprintf(fd, "0.01 -xyz 100 0 1\n");
+                fclose(fd);
+            }
+            pthread_mutex_lock(&MainMutex);
+            if(seqLoad(bad, &CF) || seqPending != L || L->count != 4 || L->seg[0].waveform_type != 1){
+                printf("Pending playlist lost by a failed reload\n");
+                failed = 1;
+            }
+            pthread_mutex_unlock(&MainMutex);
+            remove(bad);
+        }
+        seqTake(&seqRun);
+        phase = ref = 0;
+        if(loop == 0){
+			// Every tick of every segment, then the held mean
+            for(p=0;p<3;p++)
+                for(i=0;i<L->count;i++)
+                    for(k=0;k<L->seg[i].ticks;k++){
+                        if(ddsSample(&DAC, w, phase) != L->seg[i].data[ref >> DDS_SHIFT])
+                            wrong++;
+                        phase += ddsStep(&DAC);
+                        ref += L->seg[i].incr;
+                        ticks++;
+                    }
+            for(k=0;k<1000;k++){
+                if(ddsSample(&DAC, w, phase) != L->seg[L->count - 1].center)
+                    wrong++;
+                phase += ddsStep(&DAC);
+            }
+            printf("\n%-28s%14llu\n", "Ticks played", ticks);
+            printf("%-28s%14llu\n", "Samples off", wrong);
+            printf("%-28s%14llu\n", "Passes", seqRun.passes);
+            if(wrong || !seqRun.done || seqRun.passes != 3)
+                failed = 1;
+        }
+		// Cost per tick, once with the looping list and once without a list
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for(k=0;k<10*n;k++){
+            sink += ddsSample(&DAC, w, phase);
+            phase += ddsStep(&DAC);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        ns[loop] = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/(10*n);
+    }
+    seqStop();
+    seqTake(&seqRun);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(k=0;k<10*n;k++){
+        sink += ddsSample(&DAC, w, phase);
+        phase += ddsStep(&DAC);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("%-28s%14.2f\n", "ns/tick with a playlist", ns[1]);
+    printf("%-28s%14.2f\n", "ns/tick without", ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec))/(10*n));
+    if(ns[1] > 1e9/rate)
+        failed = 1;
+	// Live: the list played 3 times by PushDAC, then the mean held
+    if((fd = fopen(file, "w")) != NULL){
+        for(i=0;i<6;i++)
+            fprintf(fd, "%s\n", lines[i]);
+        fprintf(fd, "repeat 3\n");
+        fclose(fd);
+    }
+    pthread_mutex_lock(&MainMutex);
+    if(seqLoad(file, &CF))
+        change(true, CF.waveform_type, CF.freq, CF.mean, CF.amp);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    DAC.pushAlive = 1;
+    requests = waveRequest;
+    pthread_mutex_unlock(&MainMutex);
+    pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+    delay(500);
+    printf("\nLive playlist: %llu/3 passes, %s, %u change requests during playback\n", seqRun.passes,
+        seqRun.done ? "holding the mean" : "still playing", waveRequest - requests);
+    if(seqRun.passes != 3 || !seqRun.done || waveRequest != requests)
+        failed = 1;
+    DAC.isOn = false;
+    pthread_join(tid, NULL);
+    seqStop();
+    useDDS = false;
+    remove(file);
+    printf("\nPlaylist %s (sample-accurate segments, no manager round trip)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Dashboard frame cost and screen contents
+
+Draws DASH_BENCH_FRAMES frames of the status screen to a file while the
+analog inputs change every frame as a turning knob would, the switches
+every 100 frames, and the DAC configuration is hidden or shown every
+250 frames. Times rendering and drawing. At the end of every 250 frames
+the escape sequences written so far are replayed into a model terminal
+and its screen is compared with the frame. Fails if the screen differs,
+or if a frame costs more than a quarter of a full redraw or more than
+one write().
+*/
+int benchDash(){
+    const char* file = "/tmp/wavegen_dash.txt";
+    static Dash S;
+    static char frame[DASH_TEXT];
+    uintptr_t dio = digital_in;
+    uint16_t adc = adc_in[0];
+    unsigned long long bytes = 0, writes = 0;
+    int64_t t0, t1, render = 0, draw = 0;
+    size_t len = 0;
+    FILE* f;
+    int fd, k, n, full = 0, failed = 0;
+    if((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1){
+        perror(file);
         return 1;
-    else if(absMax<10)
-        return 2;
-    else {
-        printf("\nError: The absolute maximum is more than 10V.\n");
-        printf("Either reset the data field or select small absolute value.\n");
-        return 0;
     }
+    dashStart(&S, fd);
+    for(k=0;k<DASH_BENCH_FRAMES;k++){
+        adc_in[0] = 0x8000 + 16*k;
+        digital_in = (k/100) & 0x0f;
+        t0 = monoNow();
+        if((f = fmemopen(frame, sizeof(frame), "w")) == NULL){
+            perror("fmemopen");
+            close(fd);
+            return 1;
+        }
+        showStatus(f, (k/250) % 2 == 1);
+        len = ftell(f);
+        fclose(f);
+        t1 = monoNow();
+        n = dashFrame(&S, frame, len);
+        draw += monoNow() - t1;
+        render += t1 - t0;
+        if(k == 0)
+            full = n;
+        else{
+            bytes += n;
+            writes += n > 0;
+        }
+        if(k % 250 == 249 && !dashReplay(file, frame, len))
+            failed = 1;
+    }
+    dashStop(&S);
+    close(fd);
+    adc_in[0] = adc;
+    digital_in = dio;
+    printf("\n%-28s%14zu\n", "Frame text (bytes)", len);
+    printf("%-28s%14d\n", "Full redraw (bytes)", full);
+    printf("%-28s%14.1f\n", "Changed frame (bytes)", (double)bytes/(DASH_BENCH_FRAMES - 1));
+    printf("%-28s%14.2f\n", "write() per frame", (double)writes/(DASH_BENCH_FRAMES - 1));
+    printf("%-28s%14.2f\n", "Render (us)", render/1e3/DASH_BENCH_FRAMES);
+    printf("%-28s%14.2f\n", "Diff and write (us)", draw/1e3/DASH_BENCH_FRAMES);
+    if(bytes > (unsigned long long)full*(DASH_BENCH_FRAMES - 1)/4
+            || writes > DASH_BENCH_FRAMES - 1)
+        failed = 1;
+    remove(file);
+    printf("\nDashboard %s (screen matches the frames, a changed frame under a quarter of a redraw)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
 }
-// Function to directly change the parameters of the DAC
-void change(bool onSignal, int wvty, float f, float m, float a){
-    DAC.waveform_type=wvty;
-    DAC.freq=f;
-    DAC.mean=m;
-    DAC.amp=a;
-    DAC.resetWave=true;
-    DAC.isOn=onSignal;
+/* Play the escape sequences of file into a model terminal (cursor
+position, erase display and erase line) and compare the screen with the
+frame text */
+bool dashReplay(const char* file, const char* text, size_t len){
+    static char scr[DASH_ROWS][DASH_COLS+1];
+    const char* end = text + len;
+    const char* nl;
+    int r = 0, c = 0, p[2], np, ch, i, w;
+    FILE* fd;
+    if((fd = fopen(file, "r")) == NULL){
+        perror(file);
+        return false;
+    }
+    memset(scr, ' ', sizeof(scr));
+    while((ch = fgetc(fd)) != EOF){
+        if(ch != '\033'){
+            if(r < DASH_ROWS && c < DASH_COLS)
+                scr[r][c] = ch;
+            c++;
+            continue;
+        }
+        if(fgetc(fd) != '[')
+            continue;
+        p[0] = p[1] = 0;
+        np = 0;
+        while((ch = fgetc(fd)) != EOF && ((ch >= '0' && ch <= '9') || ch == ';' || ch == '?')){
+            if(ch == ';')
+                np = 1;
+            else if(ch != '?')
+                p[np] = 10*p[np] + ch - '0';
+        }
+        if(ch == 'H'){
+            r = (p[0] ? p[0] : 1) - 1;
+            c = (p[1] ? p[1] : 1) - 1;
+        }
+        else if(ch == 'J')
+            memset(scr, ' ', sizeof(scr));
+        else if(ch == 'K' && r < DASH_ROWS)
+            for(i=c;i<DASH_COLS;i++)
+                scr[r][i] = ' ';
+    }
+    fclose(fd);
+	// Every row of the frame, then blank rows
+    for(r=0;r<DASH_ROWS;r++){
+        w = 0;
+        if(text < end){
+            if((nl = memchr(text, '\n', end - text)) == NULL)
+                nl = end;
+            w = nl - text < DASH_COLS ? (int)(nl - text) : DASH_COLS;
+            if(memcmp(scr[r], text, w) != 0)
+                break;
+            text = nl + 1;
+        }
+        for(i=w;i<DASH_COLS && scr[r][i] == ' ';i++);
+        if(i < DASH_COLS)
+            break;
+    }
+    if(r < DASH_ROWS)
+        printf("Screen row %d differs from the frame.\n", r + 1);
+    return r == DASH_ROWS;
 }
-//Set the change field to be equal to initial DAC parameters
-void setChangeField(ChangeField* CF){
-    (*CF).waveform_type=DAC.waveform_type;
-    (*CF).freq=DAC.freq;
-    (*CF).mean=DAC.mean;
-    (*CF).amp=DAC.amp;
-    (*CF).isOn=DAC.isOn;
+
+/* Control command round trip and rate
+
+Serves the control endpoint at a scratch path with WaveGenManager
+running, and sends CTRL_BENCH_N commands of each kind from a client in
+this process, one at a time, timing each round trip. The commands are
+status queries, frequency changes and amplitude changes. A frequency
+change regenerates the waveform, or is one word with --dds. Then sends
+values out of range, an unknown command and a missing channel. Fails if
+a reply is missing, a change is not in its reply, or a bad command is
+applied.
+*/
+int benchCtrl(){
+#ifdef __QNX__
+    const char* path = "/dev/wavegen_bench";
+#else
+    const char* path = "/tmp/wavegen_bench.sock";
+#endif
+    const char* names[] = {"Status", "Frequency", "Amplitude"};
+    const int ops[] = {CTRL_STATUS, CTRL_FREQ, CTRL_AMP};
+    const CtrlCommand bad[] = {{CTRL_FREQ, 0, -1}, {CTRL_FREQ, 0, 1e6}, {CTRL_AMP, 0, 20},
+        {CTRL_MEAN, 0, -9.5}, {CTRL_TYPE, 0, 7}, {CTRL_ON, 0, 2}, {99, 0, 0}, {CTRL_STATUS, 2, 0}};
+    const int expect[] = {CTRL_ERANGE, CTRL_ERANGE, CTRL_ERANGE, CTRL_ERANGE, CTRL_ERANGE,
+        CTRL_ERANGE, CTRL_EOP, CTRL_ECHAN};
+    const int nbad = sizeof(bad)/sizeof(bad[0]);
+    static long lat[CTRL_BENCH_N];
+    CtrlCommand C;
+    CtrlReply R;
+    WaveParams P;
+    double sum;
+    int64_t t0, start;
+    pthread_t tid;
+    int fd, i, k, rejected = 0, failed = 0;
+    pthread_create(&tid, NULL, &WaveGenManager, NULL);
+    pthread_mutex_lock(&MainMutex);
+    change(true, 1, 100, 0, 1);
+    waitWaveAck(waveRequest);
+    pthread_mutex_unlock(&MainMutex);
+    if(!ctrlStart(path) || (fd = ctrlOpen(path)) == -1){
+        perror(path);
+        ctrlStop();
+        stopProgram();
+        pthread_join(tid, NULL);
+        return 1;
+    }
+    printf("\n%-14s%12s%12s%12s%12s%14s\n", "(us)", "mean", "p50", "p99", "max", "commands/s");
+    for(i=0;i<3;i++){
+        memset(&C, 0, sizeof(C));
+        C.op = ops[i];
+        sum = 0;
+        start = monoNow();
+        for(k=0;k<CTRL_BENCH_N;k++){
+            C.value = i == 1 ? 100 + k%100 : 1 + (k%4)*0.5;
+            t0 = monoNow();
+            if(ctrlCall(fd, &C, &R) != 0 || R.status != CTRL_OK)
+                break;
+            lat[k] = (long)(monoNow() - t0);
+            sum += lat[k];
+            if((i == 1 && R.params.freq != C.value) || (i == 2 && R.params.amp != C.value))
+                failed = 1;
+        }
+        if(k < CTRL_BENCH_N){
+            printf("%s command %d failed.\n", names[i], k);
+            failed = 1;
+            break;
+        }
+        qsort(lat, CTRL_BENCH_N, sizeof(long), cmpLong);
+        printf("%-14s%12.1f%12.1f%12.1f%12.1f%14.0f\n", names[i], sum/CTRL_BENCH_N/1e3,
+            lat[CTRL_BENCH_N/2]/1e3, lat[CTRL_BENCH_N*99/100]/1e3, lat[CTRL_BENCH_N-1]/1e3,
+            CTRL_BENCH_N/((monoNow() - start)/1e9));
+    }
+	// Bad commands change nothing
+    loadParams(&DAC, &P);
+    for(i=0;i<nbad;i++)
+        if(ctrlCall(fd, &bad[i], &R) == 0 && R.status == expect[i])
+            rejected++;
+    loadParams(&DAC, &R.params);
+    if(rejected != nbad || memcmp(&P, &R.params, sizeof(P)) != 0)
+        failed = 1;
+    printf("\n%-28s%11d/%d\n", "Bad commands rejected", rejected, nbad);
+    close(fd);
+    ctrlStop();
+    stopProgram();
+    pthread_join(tid, NULL);
+    printf("\nControl endpoint %s (every command answered with its change, bad commands rejected)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
+}
+
+/* Status page consistency and cost
+
+Times statusUpdate on a private page, then publishes STATUS_BENCH_NAME
+while DAC0 runs software timed DDS output and the main thread calls
+change() every 2 ms with the amplitude tied to the frequency
+(amp = freq/1000). A reader thread maps the page read-only, as a monitor
+in another process does, and checks every snapshot for that relation.
+Before that, statusStart must refuse a page left under the name by a
+live process (the parent) and keep it, and take over one left by a
+process that has exited, and statusRead must give up on a page left
+in the middle of a snapshot (as by a writer that died) within about
+STATUS_READ_MS. Fails on a torn or abandoned snapshot, on any of these
+checks, or if the output rate in the page is more than STATUS_BENCH_TOL
+off DDS_RATE.
+*/
+volatile bool statusBenchRun;
+unsigned long long statusReads, statusRetries, statusTorn;
+double statusReadNs;
+void* statusBenchReader(void* arg){
+    const StatusPage* S = arg;
+    StatusPage P;
+    int64_t t0 = monoNow();
+    int r;
+    while(statusBenchRun){
+        if((r = statusRead(S, &P)) < 0)
+            statusTorn++;
+        else{
+            statusRetries += r;
+            if(P.dac[0].amp != P.dac[0].freq/1000)
+                statusTorn++;
+        }
+        statusReads++;
+    }
+    statusReadNs = (double)(monoNow() - t0)/statusReads;
+    return NULL;
+}
+// Leave a page named STATUS_BENCH_NAME as process pid would
+void statusBenchPlant(int pid){
+    StatusPage P;
+    int fd;
+    memset(&P, 0, sizeof(P));
+    P.magic = STATUS_MAGIC;
+    P.size = sizeof(P);
+    P.pid = pid;
+    shm_unlink(STATUS_BENCH_NAME);
+    if((fd = shm_open(STATUS_BENCH_NAME, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1)
+        return;
+    if(write(fd, &P, sizeof(P)) != sizeof(P))
+        perror(STATUS_BENCH_NAME);
+    close(fd);
+}
+int benchStatus(){
+    const StatusPage* S;
+    StatusPage *local, first, last;
+    pthread_t reader, tid;
+    double update_ns, rate, abandoned_ms;
+    int64_t t0;
+    float f;
+    int k, dead, refused, kept, given_up, failed = 0;
+	// Only the page of this benchmark
+    statusStop();
+	// A live owner keeps its page, an exited one loses it
+    statusBenchPlant(getppid());
+    refused = !statusStart(STATUS_BENCH_NAME);
+    kept = statusOwner(STATUS_BENCH_NAME) == getppid();
+    if(!refused)
+        statusStop();
+    if((dead = fork()) == 0)
+        _exit(0);
+    waitpid(dead, NULL, 0);
+    statusBenchPlant(dead);
+    local = calloc(1, sizeof(StatusPage));
+    t0 = monoNow();
+    for(k=0;k<STATUS_BENCH_N;k++)
+        statusUpdate(local);
+    update_ns = (double)(monoNow() - t0)/STATUS_BENCH_N;
+	// Left odd, as by a writer that died during a snapshot
+    local->seq++;
+    t0 = monoNow();
+    given_up = statusRead(local, &first) < 0;
+    abandoned_ms = (monoNow() - t0)/1e6;
+    free(local);
+    usePacer = false;
+    useDual = false;
+    useDDS = true;
+    pthread_mutex_lock(&MainMutex);
+    change(true, 1, 100, 0, 100/1000.0f);
+    WaveformGen(&DAC);
+    publishWave(&DAC);
+    DAC.pushAlive = 1;
+    pthread_mutex_unlock(&MainMutex);
+    if(!statusStart(STATUS_BENCH_NAME) || (S = statusMap(STATUS_BENCH_NAME)) == NULL){
+        printf("No status page %s\n", STATUS_BENCH_NAME);
+        statusStop();
+        return 1;
+    }
+    pthread_create(&tid, NULL, &PushDAC, (void *)&DAC);
+    delay(100);
+    statusRead(S, &first);
+    if(first.pid != getpid())
+        failed = 1;
+    statusBenchRun = true;
+    pthread_create(&reader, NULL, &statusBenchReader, (void*)S);
+    for(k=1;k<=500;k++){
+        f = 100 + k;
+        pthread_mutex_lock(&MainMutex);
+        change(true, 1, f, 0, f/1000.0f);
+        pthread_mutex_unlock(&MainMutex);
+        delay(2);
+    }
+    delay(100);
+    statusBenchRun = false;
+    pthread_join(reader, NULL);
+    statusRead(S, &last);
+    DAC.isOn = false;
+    pthread_join(tid, NULL);
+    munmap((void*)S, sizeof(StatusPage));
+    statusStop();
+    useDDS = false;
+    rate = (last.ticks[0] - first.ticks[0])/((last.time - first.time)/1e9);
+    printf("\n%-32s%14.1f\n", "statusUpdate (ns)", update_ns);
+    printf("%-32s%14.1f\n", "statusRead (ns)", statusReadNs);
+    printf("%-32s%14llu\n", "Snapshots read", statusReads);
+    printf("%-32s%14llu\n", "Retries", statusRetries);
+    printf("%-32s%14llu\n", "Torn snapshots", statusTorn);
+    printf("%-32s%14llu\n", "Page updates", (unsigned long long)(last.updates - first.updates));
+    printf("%-32s%14llu\n", "Changes seen", (unsigned long long)(last.changes - first.changes));
+    printf("%-32s%14.0f%14.0f\n", "Output rate (S/s), expected", rate, (double)DDS_RATE);
+    printf("%-32s%14s%14s\n", "Live owner: refused, kept", refused ? "yes" : "NO", kept ? "yes" : "NO");
+    printf("%-32s%14s\n", "Exited owner: taken over", first.pid == getpid() ? "yes" : "NO");
+    printf("%-32s%14s%14.1f\n", "Abandoned page: given up, ms", given_up ? "yes" : "NO", abandoned_ms);
+    if(statusTorn || statusReads == 0 || last.dac[0].freq != f || !refused || !kept
+            || !given_up || abandoned_ms > 2*STATUS_READ_MS
+            || fabs(rate/DDS_RATE - 1) > STATUS_BENCH_TOL)
+        failed = 1;
+    printf("\nStatus page %s (consistent snapshots, owner checked, abandoned page given up, output rate within %.0f%%)\n",
+        failed ? "FAILED" : "passed", STATUS_BENCH_TOL*100);
+    return failed;
+}
+
+/* AWG file formats, resampling and scaling
+
+Writes small CSV (header, time and value columns, CRLF), float and
+--capture (2 channels) files, loads each with awgLoad and checks the
+sample count, rate and range, and the settings awgDefault gives (a file
+beyond +/-10V is scaled down to fit). Then resamples each file with
+awgFill, up (linear interpolation, wrapping) and down (average of the
+samples in each output sample), and checks every DAC code against the
+same resampling done in double from the file's volts, and the capture
+file at its own rate through WaveformGen. Fails on any count or range
+that is off, or a code more than 1 away.
+*/
+// Expected DAC codes of the AWG file v[0..n-1] resampled to D (settings in D)
+void awgBenchRef(DACField* D, const double* v, int n, double lo, double hi, double* out){
+    int m = D->samples_per_period, j, s = 0;
+    double x, sum, res = D->output_res/1000000, u;
+    for(j=0;j<m;j++){
+        if(m >= n){
+            x = (double)j*n/m;
+            s = (int)x;
+            u = v[s] + (x - s)*(v[(s + 1)%n] - v[s]);
+        }
+        else{
+            for(sum=0,s=(int)((long long)j*n/m);s<(long long)(j + 1)*n/m;s++)
+                sum += v[s];
+            u = sum/(s - (long long)j*n/m);
+        }
+        u = hi > lo ? (u - (hi + lo)/2)*2/(hi - lo) : 0;
+        out[j] = (D->DAC_mode<2 ? 0x7FFF : 0) + (D->mean + D->amp*u)/res;
+    }
+}
+int benchAWG(){
+    const char* files[] = {"/tmp/wavegen_awg.csv", "/tmp/wavegen_awg.f32",
+        "/tmp/wavegen_awg.bin", "/tmp/wavegen_awg_big.f32"};
+    const char* names[] = {"CSV", "float", "capture", "float 0..30V"};
+    const int n[] = {8, 1000, 600, 64};
+    const float rates[] = {800, 0, 0, 0};
+    double v[1000], expect[4096], res, err, max_err = 0, lo, hi;
+    float f, mean, amp;
+    int sizes[3], k, i, r, bad = 0, failed = 0;
+    uint16_t frame[2];
+    int64_t base;
+    int32_t gain;
+    CaptureHeader hdr;
+    ChangeField CF;
+    FILE* fd;
+    usePacer = false;
+    useDDS = false;
+    printf("\n%-14s%9s%9s%9s%9s%9s%9s%9s\n", "File", "Samples", "Rate", "Min(V)", "Max(V)",
+        "Freq", "Mean", "Amp");
+    for(k=0;k<4;k++){
+		// Sample i of each file, in volts
+        for(i=0;i<n[k];i++)
+            v[i] = k == 0 ? (i < 5 ? i - 2 : 6 - i)
+                : k == 1 ? 3 + 2*sin(2*M_PI*i/n[k])
+                : k == 2 ? ((16384 + i*(32768/n[k])) - 32768)*10.0/32768
+                : 30.0*i/(n[k] - 1);
+        if((fd = fopen(files[k], "wb")) == NULL){
+            perror(files[k]);
+            return 1;
+        }
+        if(k == 0){
+            fprintf(fd, "time,volts\r\n\r\n");
+            for(i=0;i<n[k];i++)
+                fprintf(fd, "%.4f,%g\r\n", i/800.0, v[i]);
+        }
+        else if(k == 2){
+            memset(&hdr, 0, sizeof(hdr));
+            memcpy(hdr.magic, CAPTURE_MAGIC, 4);
+            hdr.version = CAPTURE_VERSION;
+            hdr.header_size = sizeof(hdr);
+            hdr.channels = 2;
+            hdr.rate = 2000;
+            hdr.samples = 2*n[k];
+            fwrite(&hdr, sizeof(hdr), 1, fd);
+            for(i=0;i<n[k];i++){
+                frame[0] = (uint16_t)(16384 + i*(32768/n[k]));
+                frame[1] = (uint16_t)(i*7);
+                fwrite(frame, sizeof(frame), 1, fd);
+            }
+        }
+        else
+            for(i=0;i<n[k];i++){
+                f = (float)v[i];
+                fwrite(&f, sizeof(f), 1, fd);
+            }
+        fclose(fd);
+		// Load, then the settings that replay the file as it is
+        if(!awgLoad(files[k], rates[k])){
+            failed = 1;
+            continue;
+        }
+        for(lo=hi=v[0],i=1;i<n[k];i++){
+            lo = v[i] < lo ? v[i] : lo;
+            hi = v[i] > hi ? v[i] : hi;
+        }
+        awgDefault(&CF);
+        printf("%-14s%9d%9.0f%9.3f%9.3f%9.2f%9.3f%9.3f\n", names[k], awg.samples, awg.rate,
+            awg.min, awg.max, CF.freq, CF.mean, CF.amp);
+        mean = k == 3 ? 4.995 : (hi + lo)/2;
+        amp = k == 3 ? 4.995 : (hi - lo)/2;
+        if(awg.samples != n[k] || fabs(awg.min - lo) > 1e-3 || fabs(awg.max - hi) > 1e-3
+                || fabs(awg.rate - (k == 0 ? 800 : k == 2 ? 1000 : AWG_RATE)) > 1e-3
+                || fabs(CF.freq - awg.rate/n[k]) > 1e-3
+                || fabs(CF.mean - mean) > 1e-3 || fabs(CF.amp - amp) > 1e-3)
+            failed = 1;
+        if(k == 3)
+            break;
+		// Up by 4 (and a ratio that is not whole), down by 2 and by 1000/300
+        DAC.waveform_type = 4;
+        DAC.freq = CF.freq;
+        DAC.mean = CF.mean;
+        DAC.amp = CF.amp;
+        sizes[0] = 4*n[k];
+        sizes[1] = 3*n[k] + 1;
+        sizes[2] = k == 1 ? 300 : n[k]/2;
+        for(r=0;r<3;r++){
+            chooseBestRes(&DAC);
+            DAC.samples_per_period = sizes[r];
+            waveAlloc(&DAC.data, &DAC.capacity, sizes[r]);
+            res = DAC.output_res/1000000;
+            base = (int64_t)(((DAC.DAC_mode<2 ? 0x7FFF : 0) + DAC.mean/res)*((int64_t)1 << WAVE_SHIFT));
+            gain = (int32_t)lrint(DAC.amp/res*(1 << GAIN_SHIFT));
+            awgFill(&DAC, base, gain);
+            awgBenchRef(&DAC, v, n[k], awg.min, awg.max, expect);
+            for(i=0;i<sizes[r];i++){
+                err = abs((int)DAC.data[i] - (int)lrint(expect[i]));
+                max_err = err > max_err ? err : max_err;
+                bad += err > 1;
+            }
+        }
+		// At the file's own rate through WaveformGen: the file's volts
+        if(k == 2){
+            WaveformGen(&DAC);
+            res = DAC.output_res/1000000;
+            if(DAC.samples_per_period != n[k])
+                failed = 1;
+            for(i=0;i<DAC.samples_per_period && i<n[k];i++){
+                err = abs((int)DAC.data[i] - (int)lrint((DAC.DAC_mode<2 ? 0x7FFF : 0) + v[i]/res));
+                max_err = err > max_err ? err : max_err;
+                bad += err > 1;
+            }
+        }
+    }
+    for(k=0;k<4;k++)
+        remove(files[k]);
+    printf("\n%-28s%14d\n", "Codes more than 1 off", bad);
+    printf("%-28s%14.0f\n", "Largest error (codes)", max_err);
+    if(bad)
+        failed = 1;
+    printf("\nAWG files %s (formats, autoscale, resampling within 1 code)\n",
+        failed ? "FAILED" : "passed");
+    return failed;
 }